@@ -0,0 +1,725 @@
+#ifndef LIST_ALLOC_H
+#define LIST_ALLOC_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+/*
+ *  allocators for the containers, following sgi stl_alloc.h.
+ *
+ *  an Alloc here is a class with two static members:
+ *      static void *allocate(size_t n);
+ *      static void deallocate(void *p, size_t n);
+ *  containers never use it directly but through simple_alloc<T, Alloc>,
+ *  which turns "n objects of T" into "n * sizeof(T) bytes".
+ *
+ *  four of them:
+ *      malloc_alloc    every request goes to malloc/free.
+ *      pool_alloc      small requests are served from free lists, one per
+ *                      8-byte size class, refilled from big chunks; large
+ *                      requests fall through to malloc_alloc.
+ *      arena_alloc     bump allocation from a monotonic_arena the caller
+ *                      binds, deallocate() does nothing.
+ *      bound_pool_alloc
+ *                      pool_alloc's free lists, but kept in a node_pool
+ *                      object the caller binds, so each container (or
+ *                      each shard of one) can have a pool of its own.
+ *  alloc (the default of list and rb_tree) stays malloc_alloc.
+ */
+
+
+/*
+ *  the sgi type traits, only the part the containers ask about.
+ */
+struct __true_type {   };
+struct __false_type {  };
+
+template <bool b>
+struct __bool_type {
+    typedef __false_type type;
+};
+
+template <>
+struct __bool_type<true> {
+    typedef __true_type type;
+};
+
+template <class T>
+struct __type_traits {
+    typedef typename __bool_type<std::is_trivially_destructible<T>::value>::type
+            has_trivial_destructor;
+};
+
+
+/*
+ *  construct() and destroy(), from sgi stl_construct.h, the placement
+ *  new / explicit destructor call that create_node()/destroy_node() use.
+ *  construct() forwards whatever it is given, so a node can be built
+ *  from a copy, a moved-from value or constructor arguments alike.
+ */
+template <class T1, class... Args>
+inline void construct(T1 *p, Args&&... args) {
+    new (p) T1(std::forward<Args>(args)...);
+}
+
+template <class T>
+inline void destroy(T *pointer) {
+    pointer->~T();
+}
+
+
+/*
+ *  relocating objects between raw slots: each one is moved and the
+ *  source destroyed right away, so shifting inside an array works as
+ *  long as the direction is right (forward to shift left, backward to
+ *  shift right).
+ */
+template <class T>
+inline void __relocate_forward(T *dst, T *src, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        construct(dst + i, std::move(src[i]));
+        destroy(src + i);
+    }
+}
+
+template <class T>
+inline void __relocate_backward(T *dst, T *src, size_t n) {
+    for (size_t i = n; i-- > 0; ) {
+        construct(dst + i, std::move(src[i]));
+        destroy(src + i);
+    }
+}
+
+
+/*
+ *  what a container may assume about its Alloc. is_monotonic means
+ *  deallocate() is a no-op and the memory is reclaimed as a whole by
+ *  its owner, so a container can drop its nodes without visiting them.
+ *  is_thread_safe means allocate() and deallocate() may be called from
+ *  any thread at once, so a container can build or free its nodes on
+ *  threads other than its owner's.
+ */
+template <class Alloc>
+struct __alloc_traits {
+    typedef __false_type is_monotonic;
+    typedef __false_type is_thread_safe;
+};
+
+
+template <int inst>
+class __malloc_alloc_template {
+public:
+    static void *allocate(size_t n) {
+        void *result = malloc(n);
+        if (0 == result)    throw std::bad_alloc();
+        return result;
+    }
+
+    static void deallocate(void *p, size_t /* n */) {
+        free(p);
+    }
+};
+
+typedef __malloc_alloc_template<0> malloc_alloc;
+typedef malloc_alloc alloc;
+
+template <int inst>
+struct __alloc_traits<__malloc_alloc_template<inst> > {
+    typedef __false_type is_monotonic;
+    typedef __true_type is_thread_safe;
+};
+
+
+/*
+ *  count blocks of n bytes at once, for a container about to build that
+ *  many nodes. each block is given back on its own with deallocate(), as
+ *  if it had come from allocate(). by default these are count calls to
+ *  allocate(), given back again if one of them throws; pool_alloc takes
+ *  the whole batch under one lock and arena_alloc with one bump.
+ */
+template <class Alloc>
+struct __batch_alloc {
+    template <class Ptr>
+    struct rollback {
+        Ptr *out;
+        size_t n;
+        size_t done;
+        ~rollback() {
+            while (done != 0)
+                Alloc::deallocate(out[--done], n);
+        }
+    };
+
+    template <class Ptr>
+    static void allocate(size_t n, Ptr *out, size_t count) {
+        rollback<Ptr> r = { out, n, 0 };
+        for (; r.done < count; ++r.done)
+            out[r.done] = (Ptr)Alloc::allocate(n);
+        r.done = 0;
+    }
+};
+
+
+/*
+ *  the sgi second level allocator (__default_alloc_template).
+ *
+ *  free_list[i] keeps freed blocks of (i + 1) * __ALIGN bytes, linked
+ *  through their own first word, so allocate() and deallocate() are a
+ *  pop and a push. when a list runs dry refill() asks chunk_alloc() for
+ *  __NOBJS blocks at once, carved from one malloc'ed chunk; what is left
+ *  of a chunk is kept in [start_free, end_free) for the next refill.
+ *
+ *  memory is never handed back to the system, deallocate() only puts the
+ *  block back on its free list. threads = true guards the lists with a
+ *  mutex; inst lets independent users get independent pools.
+ */
+template <bool threads, int inst>
+class __pool_alloc_template {
+private:
+    enum { __ALIGN = 8 };
+    enum { __MAX_BYTES = 256 };
+    enum { __NFREELISTS = __MAX_BYTES / __ALIGN };
+    enum { __NOBJS = 20 };
+
+    union obj {
+        union obj *free_list_link;
+        char client_data[1];
+    };
+
+    static obj *free_list[__NFREELISTS];
+    static char *start_free;
+    static char *end_free;
+    static size_t heap_size;
+    static std::mutex pool_mutex;
+
+    /*
+     *  a lock that only locks when the pool is shared between threads.
+     */
+    struct lock {
+        lock() {    if (threads) pool_mutex.lock();  }
+        ~lock() {   if (threads) pool_mutex.unlock();    }
+    };
+
+    static size_t ROUND_UP(size_t bytes) {
+        return (bytes + __ALIGN - 1) & ~((size_t)__ALIGN - 1);
+    }
+
+    static size_t FREELIST_INDEX(size_t bytes) {
+        return (bytes + __ALIGN - 1) / __ALIGN - 1;
+    }
+
+    static void *refill(size_t n);
+    static char *chunk_alloc(size_t size, int &nobjs);
+
+    enum { __BATCH_NOBJS = 16 * __NOBJS };
+
+public:
+    static void *allocate(size_t n) {
+        if (n > (size_t)__MAX_BYTES)
+            return malloc_alloc::allocate(n);
+
+        lock guard;
+        obj **my_free_list = free_list + FREELIST_INDEX(n);
+        obj *result = *my_free_list;
+        if (result == 0)
+            return refill(ROUND_UP(n));
+        *my_free_list = result->free_list_link;
+        return result;
+    }
+
+    static void deallocate(void *p, size_t n) {
+        if (n > (size_t)__MAX_BYTES) {
+            malloc_alloc::deallocate(p, n);
+            return;
+        }
+
+        lock guard;
+        obj *q = (obj*)p;
+        obj **my_free_list = free_list + FREELIST_INDEX(n);
+        q->free_list_link = *my_free_list;
+        *my_free_list = q;
+    }
+
+    template <class Ptr>
+    static void allocate_batch(size_t n, Ptr *out, size_t count);
+};
+
+typedef __pool_alloc_template<false, 0> pool_alloc;
+typedef __pool_alloc_template<true, 0> mt_pool_alloc;
+
+template <int inst>
+struct __alloc_traits<__pool_alloc_template<true, inst> > {
+    typedef __false_type is_monotonic;
+    typedef __true_type is_thread_safe;
+};
+
+template <bool threads, int inst>
+struct __batch_alloc<__pool_alloc_template<threads, inst> > {
+    template <class Ptr>
+    static void allocate(size_t n, Ptr *out, size_t count) {
+        __pool_alloc_template<threads, inst>::allocate_batch(n, out, count);
+    }
+};
+
+
+/*
+ *  called with the lock held and n already rounded up: hands one block
+ *  of n bytes to the caller and strings the rest of the batch onto
+ *  the free list.
+ */
+template <bool threads, int inst>
+void *__pool_alloc_template<threads, inst>::refill(size_t n) {
+    int nobjs = __NOBJS;
+    char *chunk = chunk_alloc(n, nobjs);
+
+    if (1 == nobjs) return chunk;
+
+    obj **my_free_list = free_list + FREELIST_INDEX(n);
+    obj *result = (obj*)chunk;
+    obj *next_obj = (obj*)(chunk + n);
+    *my_free_list = next_obj;
+    for (int i = 1; ; ++i) {
+        obj *current_obj = next_obj;
+        next_obj = (obj*)((char*)next_obj + n);
+        if (nobjs - 1 == i) {
+            current_obj->free_list_link = 0;
+            break;
+        }
+        current_obj->free_list_link = next_obj;
+    }
+    return result;
+}
+
+/*
+ *  count blocks under one lock: whatever is on the free list first, then
+ *  runs carved straight from the chunk, up to __BATCH_NOBJS blocks at a
+ *  time rather than __NOBJS per refill, with nothing strung onto the
+ *  free list on the way.
+ */
+template <bool threads, int inst>
+template <class Ptr>
+void __pool_alloc_template<threads, inst>::allocate_batch(size_t n, Ptr *out, size_t count) {
+    if (n > (size_t)__MAX_BYTES) {
+        __batch_alloc<malloc_alloc>::allocate(n, out, count);
+        return;
+    }
+
+    lock guard;
+    n = ROUND_UP(n);
+    obj **my_free_list = free_list + FREELIST_INDEX(n);
+    size_t i = 0;
+    for (; i < count && *my_free_list != 0; ++i) {
+        out[i] = (Ptr)*my_free_list;
+        *my_free_list = (*my_free_list)->free_list_link;
+    }
+    while (i < count) {
+        int nobjs = count - i < (size_t)__BATCH_NOBJS ? (int)(count - i) : (int)__BATCH_NOBJS;
+        char *chunk = chunk_alloc(n, nobjs);
+        for (int j = 0; j < nobjs; ++j, ++i)
+            out[i] = (Ptr)(chunk + j * n);
+    }
+}
+
+/*
+ *  gets room for nobjs blocks of size bytes, fewer (but at least one) if
+ *  the current chunk is short and the system is out of memory.
+ */
+template <bool threads, int inst>
+char *__pool_alloc_template<threads, inst>::chunk_alloc(size_t size, int &nobjs) {
+    size_t total_bytes = size * nobjs;
+    size_t bytes_left = end_free - start_free;
+    char *result;
+
+    if (bytes_left >= total_bytes) {
+        result = start_free;
+        start_free += total_bytes;
+        return result;
+    }
+    else if (bytes_left >= size) {
+        nobjs = (int)(bytes_left / size);
+        result = start_free;
+        start_free += size * nobjs;
+        return result;
+    }
+
+    // the leftover of the old chunk is too small for this class, but it
+    // is still a multiple of __ALIGN, so give it to its own free list.
+    if (bytes_left > 0) {
+        obj **my_free_list = free_list + FREELIST_INDEX(bytes_left);
+        ((obj*)start_free)->free_list_link = *my_free_list;
+        *my_free_list = (obj*)start_free;
+    }
+
+    size_t bytes_to_get = 2 * total_bytes + ROUND_UP(heap_size >> 4);
+    start_free = (char*)malloc(bytes_to_get);
+    if (0 == start_free) {
+        // no more system memory, try to borrow a block from a bigger class.
+        for (size_t i = size; i <= (size_t)__MAX_BYTES; i += __ALIGN) {
+            obj **my_free_list = free_list + FREELIST_INDEX(i);
+            obj *p = *my_free_list;
+            if (0 != p) {
+                *my_free_list = p->free_list_link;
+                start_free = (char*)p;
+                end_free = start_free + i;
+                return chunk_alloc(size, nobjs);
+            }
+        }
+        end_free = 0;
+        throw std::bad_alloc();
+    }
+    heap_size += bytes_to_get;
+    end_free = start_free + bytes_to_get;
+    return chunk_alloc(size, nobjs);
+}
+
+/*
+ *  a monotonic region: allocate() bumps a pointer through the caller's
+ *  buffer, and when that is used up through blocks taken from malloc,
+ *  each one twice as big as the last. nothing is freed until release(),
+ *  which gives the extra blocks back and rewinds to the start of the
+ *  caller's buffer in time proportional to the number of blocks.
+ */
+class monotonic_arena {
+public:
+    monotonic_arena(void *buffer, size_t size)
+            : initial_buffer((char*)buffer), initial_size(size),
+              next_block_size(size < 1024 ? 1024 : size), blocks(0) {
+        rewind();
+    }
+
+    explicit monotonic_arena(size_t block_size = 4096)
+            : initial_buffer(0), initial_size(0),
+              next_block_size(block_size), blocks(0) {
+        rewind();
+    }
+
+    ~monotonic_arena() {    release();  }
+
+    void *allocate(size_t n) {
+        n = (n + __ALIGN - 1) & ~((size_t)__ALIGN - 1);
+        if ((size_t)(end_free - start_free) < n)
+            new_block(n);
+        char *result = start_free;
+        start_free += n;
+        return result;
+    }
+
+    void release() {
+        while (blocks != 0) {
+            block *next = blocks->next;
+            free(blocks);
+            blocks = next;
+        }
+        rewind();
+    }
+
+private:
+    monotonic_arena(const monotonic_arena &);
+    monotonic_arena &operator=(const monotonic_arena &);
+
+    enum { __ALIGN = alignof(std::max_align_t) };
+
+    union block {
+        block *next;
+        std::max_align_t align;
+    };
+
+    void rewind() {
+        size_t skip = (__ALIGN - (size_t)initial_buffer % __ALIGN) % __ALIGN;
+        if (initial_buffer == 0 || skip > initial_size)
+            start_free = end_free = 0;
+        else {
+            start_free = initial_buffer + skip;
+            end_free = initial_buffer + initial_size;
+        }
+    }
+
+    void new_block(size_t n) {
+        size_t size = next_block_size;
+        while (size < n)
+            size *= 2;
+        block *b = (block*)malloc(sizeof(block) + size);
+        if (0 == b) throw std::bad_alloc();
+        b->next = blocks;
+        blocks = b;
+        start_free = (char*)(b + 1);
+        end_free = start_free + size;
+        next_block_size = size * 2;
+    }
+
+    char *initial_buffer;
+    size_t initial_size;
+    size_t next_block_size;
+    block *blocks;
+    char *start_free;
+    char *end_free;
+};
+
+/*
+ *  the Alloc that hands out memory from the arena bound to the calling
+ *  thread. bind one for as long as the containers using it live:
+ *
+ *      char buf[1 << 16];
+ *      monotonic_arena arena(buf, sizeof buf);
+ *      arena_alloc::scope s(arena);
+ *      list<int, arena_alloc> l;
+ *      ...
+ *      l.release();        // O(1) for trivially destructible T
+ *      arena.release();
+ */
+template <int inst>
+class __arena_alloc_template {
+public:
+    static void *allocate(size_t n) {
+        if (0 == current)   throw std::bad_alloc();
+        return current->allocate(n);
+    }
+
+    static void deallocate(void * /* p */, size_t /* n */) {    }
+
+    static monotonic_arena *bind(monotonic_arena *arena) {
+        monotonic_arena *old = current;
+        current = arena;
+        return old;
+    }
+
+    /*
+     *  binds an arena for a block and restores the previous one after.
+     */
+    class scope {
+    public:
+        explicit scope(monotonic_arena &arena) : old(bind(&arena)) {   }
+        ~scope() {  bind(old);  }
+
+    private:
+        scope(const scope &);
+        scope &operator=(const scope &);
+
+        monotonic_arena *old;
+    };
+
+private:
+    static thread_local monotonic_arena *current;
+};
+
+template <int inst>
+thread_local monotonic_arena *__arena_alloc_template<inst>::current = 0;
+
+typedef __arena_alloc_template<0> arena_alloc;
+
+template <int inst>
+struct __alloc_traits<__arena_alloc_template<inst> > {
+    typedef __true_type is_monotonic;
+    typedef __false_type is_thread_safe;
+};
+
+template <int inst>
+struct __batch_alloc<__arena_alloc_template<inst> > {
+    template <class Ptr>
+    static void allocate(size_t n, Ptr *out, size_t count) {
+        const size_t align = alignof(std::max_align_t);
+        size_t step = (n + align - 1) & ~(align - 1);
+        char *p = (char*)__arena_alloc_template<inst>::allocate(step * count);
+        for (size_t i = 0; i < count; ++i)
+            out[i] = (Ptr)(p + i * step);
+    }
+};
+
+
+/*
+ *  pool_alloc as an object: the same free lists per 8-byte size class,
+ *  but they belong to one pool, with no lock, and the chunks go back to
+ *  malloc when the pool is destroyed. chunks double in size up to
+ *  __MAX_CHUNK. whatever is left of a chunk too small for the next
+ *  refill is cut up onto the free lists it fits.
+ */
+class node_pool {
+public:
+    node_pool() : start_free(0), end_free(0), chunks(0), next_chunk_size(__MIN_CHUNK) {
+        for (int i = 0; i < __NFREELISTS; ++i)
+            free_list[i] = 0;
+    }
+
+    ~node_pool() {  release();  }
+
+    void *allocate(size_t n) {
+        if (n > (size_t)__MAX_BYTES)
+            return malloc_alloc::allocate(n);
+        obj **my_free_list = free_list + FREELIST_INDEX(n);
+        obj *result = *my_free_list;
+        if (result == 0)
+            return refill(ROUND_UP(n));
+        *my_free_list = result->free_list_link;
+        return result;
+    }
+
+    void deallocate(void *p, size_t n) {
+        if (n > (size_t)__MAX_BYTES) {
+            malloc_alloc::deallocate(p, n);
+            return;
+        }
+        obj *q = (obj*)p;
+        obj **my_free_list = free_list + FREELIST_INDEX(n);
+        q->free_list_link = *my_free_list;
+        *my_free_list = q;
+    }
+
+    /*
+     *  gives every chunk back at once, whatever is still allocated from
+     *  them.
+     */
+    void release() {
+        while (chunks != 0) {
+            chunk *next = chunks->next;
+            free(chunks);
+            chunks = next;
+        }
+        for (int i = 0; i < __NFREELISTS; ++i)
+            free_list[i] = 0;
+        start_free = end_free = 0;
+        next_chunk_size = __MIN_CHUNK;
+    }
+
+private:
+    node_pool(const node_pool &);
+    node_pool &operator=(const node_pool &);
+
+    enum { __ALIGN = 8 };
+    enum { __MAX_BYTES = 256 };
+    enum { __NFREELISTS = __MAX_BYTES / __ALIGN };
+    enum { __NOBJS = 20 };
+    enum { __MIN_CHUNK = 4096 };
+    enum { __MAX_CHUNK = 1 << 20 };
+
+    union obj {
+        union obj *free_list_link;
+        char client_data[1];
+    };
+
+    union chunk {
+        chunk *next;
+        std::max_align_t align;
+    };
+
+    static size_t ROUND_UP(size_t bytes) {
+        return (bytes + __ALIGN - 1) & ~((size_t)__ALIGN - 1);
+    }
+
+    static size_t FREELIST_INDEX(size_t bytes) {
+        return (bytes + __ALIGN - 1) / __ALIGN - 1;
+    }
+
+    /*
+     *  n is rounded up already: one block for the caller, the rest of a
+     *  batch of __NOBJS onto the free list.
+     */
+    void *refill(size_t n) {
+        size_t left = end_free - start_free;
+        if (left < n * __NOBJS) {
+            while (left >= (size_t)__ALIGN) {
+                size_t piece = left < (size_t)__MAX_BYTES ? left : (size_t)__MAX_BYTES;
+                deallocate(start_free, piece);
+                start_free += piece;
+                left -= piece;
+            }
+            size_t size = next_chunk_size;
+            while (size < n * __NOBJS)
+                size *= 2;
+            chunk *c = (chunk*)malloc_alloc::allocate(sizeof(chunk) + size);
+            c->next = chunks;
+            chunks = c;
+            start_free = (char*)(c + 1);
+            end_free = start_free + size;
+            if (next_chunk_size < __MAX_CHUNK)
+                next_chunk_size *= 2;
+        }
+        char *result = start_free;
+        obj **my_free_list = free_list + FREELIST_INDEX(n);
+        obj *next = (obj*)(result + n);
+        *my_free_list = next;
+        for (int i = 1; ; ++i) {
+            obj *current = next;
+            next = (obj*)((char*)next + n);
+            if (i == __NOBJS - 1) {
+                current->free_list_link = 0;
+                break;
+            }
+            current->free_list_link = next;
+        }
+        start_free += n * __NOBJS;
+        return result;
+    }
+
+    obj *free_list[__NFREELISTS];
+    char *start_free;
+    char *end_free;
+    chunk *chunks;
+    size_t next_chunk_size;
+};
+
+/*
+ *  the Alloc that serves from the node_pool bound to the calling thread,
+ *  bound the way arena_alloc binds its arena. the pool must be bound
+ *  whenever the container allocates or frees, its constructor and
+ *  destructor included.
+ */
+template <int inst>
+class __bound_pool_alloc_template {
+public:
+    static void *allocate(size_t n) {
+        if (0 == current)   throw std::bad_alloc();
+        return current->allocate(n);
+    }
+
+    static void deallocate(void *p, size_t n) { current->deallocate(p, n);  }
+
+    static node_pool *bind(node_pool *pool) {
+        node_pool *old = current;
+        current = pool;
+        return old;
+    }
+
+    class scope {
+    public:
+        explicit scope(node_pool &pool) : old(bind(&pool)) {   }
+        ~scope() {  bind(old);  }
+
+    private:
+        scope(const scope &);
+        scope &operator=(const scope &);
+
+        node_pool *old;
+    };
+
+private:
+    static thread_local node_pool *current;
+};
+
+template <int inst>
+thread_local node_pool *__bound_pool_alloc_template<inst>::current = 0;
+
+typedef __bound_pool_alloc_template<0> bound_pool_alloc;
+
+
+template <bool threads, int inst>
+typename __pool_alloc_template<threads, inst>::obj *
+__pool_alloc_template<threads, inst>::free_list[__NFREELISTS] = { 0 };
+
+template <bool threads, int inst>
+char *__pool_alloc_template<threads, inst>::start_free = 0;
+
+template <bool threads, int inst>
+char *__pool_alloc_template<threads, inst>::end_free = 0;
+
+template <bool threads, int inst>
+size_t __pool_alloc_template<threads, inst>::heap_size = 0;
+
+template <bool threads, int inst>
+std::mutex __pool_alloc_template<threads, inst>::pool_mutex;
+
+
+#endif //LIST_ALLOC_H
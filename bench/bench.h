@@ -0,0 +1,41 @@
+#ifndef LIST_BENCH_H
+#define LIST_BENCH_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ *  tiny helpers shared by the benchmarks: a wall clock and a sink the
+ *  optimizer cannot see through.
+ */
+class bench_timer {
+public:
+    bench_timer() : start(std::chrono::steady_clock::now()) {  }
+
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+template <class T>
+inline void bench_keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+inline void bench_report(const char *what, size_t ops, double seconds) {
+    printf("%-40s %10.2f Mops/s  (%.3f s)\n", what, ops / seconds / 1e6, seconds);
+}
+
+/*
+ *  benchmarks take the problem size from argv[1] so the default run
+ *  stays short.
+ */
+inline size_t bench_size(int argc, char **argv, size_t def) {
+    return argc > 1 ? (size_t)strtoull(argv[1], 0, 10) : def;
+}
+
+#endif //LIST_BENCH_H
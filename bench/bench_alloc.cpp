@@ -0,0 +1,57 @@
+#include "../map.h"
+#include "bench.h"
+
+/*
+ *  insert/erase churn through the default (malloc) allocator and the
+ *  pooled one: the list keeps a window of n live nodes, pushing at the
+ *  back and erasing at the front; the map keeps about n live keys with
+ *  random inserts and erases.
+ */
+
+template <class Alloc>
+void list_churn(const char *name, size_t n, size_t rounds) {
+    list<int, Alloc> l;
+    for (size_t i = 0; i < n; ++i)
+        l.push_back((int)i);
+
+    bench_timer t;
+    for (size_t i = 0; i < rounds; ++i) {
+        l.push_back((int)i);
+        l.erase(l.begin());
+    }
+    bench_report(name, 2 * rounds, t.seconds());
+    bench_keep(l.front());
+}
+
+template <class Alloc>
+void map_churn(const char *name, size_t n, size_t rounds) {
+    map<int, int, std::less<int>, Alloc> m;
+    unsigned seed = 12345;
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245 + 12345;
+        m[(int)(seed % (2 * n))] = (int)i;
+    }
+
+    bench_timer t;
+    unsigned ins = 777, del = 777;
+    for (size_t i = 0; i < rounds; ++i) {
+        ins = ins * 1103515245 + 12345;
+        m.insert(std::pair<const int, int>((int)(ins % (2 * n)), (int)i));
+        del = del * 22695477 + 1;
+        m.erase((int)(del % (2 * n)));
+    }
+    bench_report(name, 2 * rounds, t.seconds());
+    bench_keep(m.size());
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 100000);
+    size_t rounds = 10 * n;
+
+    printf("live nodes %zu, %zu rounds\n", n, rounds);
+    list_churn<malloc_alloc>("list churn, malloc_alloc", n, rounds);
+    list_churn<pool_alloc>("list churn, pool_alloc", n, rounds);
+    map_churn<malloc_alloc>("map churn, malloc_alloc", n, rounds);
+    map_churn<pool_alloc>("map churn, pool_alloc", n, rounds);
+    return 0;
+}
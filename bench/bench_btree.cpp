@@ -0,0 +1,50 @@
+#include "../btree_map.h"
+#include "bench.h"
+#include <vector>
+
+/*
+ *  btree_map against the rb_tree backed map: random inserts, random
+ *  lookups (all hits) and a full ordered scan.
+ */
+
+template <class Map>
+void run(const char *name, const std::vector<int> &keys) {
+    size_t n = keys.size();
+    char what[64];
+    Map m;
+
+    bench_timer t;
+    for (size_t i = 0; i < n; ++i)
+        m.insert(typename Map::value_type(keys[i], (int)i));
+    snprintf(what, sizeof what, "%s insert", name);
+    bench_report(what, n, t.seconds());
+
+    long sum = 0;
+    bench_timer t2;
+    for (size_t i = 0; i < n; ++i)
+        sum += m.find(keys[(i * 7919) % n])->second;
+    snprintf(what, sizeof what, "%s find", name);
+    bench_report(what, n, t2.seconds());
+
+    bench_timer t3;
+    for (typename Map::const_iterator it = m.begin(); it != m.end(); ++it)
+        sum += it->second;
+    snprintf(what, sizeof what, "%s ordered scan", name);
+    bench_report(what, n, t3.seconds());
+    bench_keep(sum);
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+    std::vector<int> keys(n);
+    unsigned seed = 42;
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245 + 12345;
+        keys[i] = (int)((seed >> 1) ^ (unsigned)(i << 7));
+    }
+
+    printf("%zu random int keys\n", n);
+    run<map<int, int, std::less<int>, pool_alloc> >("map", keys);
+    run<btree_map<int, int> >("btree_map", keys);
+    return 0;
+}
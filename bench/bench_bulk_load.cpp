@@ -0,0 +1,50 @@
+#include "../map.h"
+#include "bench.h"
+#include <vector>
+
+/*
+ *  loading a map from an already sorted dump: insert one by one, insert
+ *  hinted at end(), the runtime-checked range constructor and the
+ *  sorted_unique constructor.
+ */
+
+typedef std::pair<int, int> entry;
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 2000000);
+    std::vector<entry> input;
+    input.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        input.push_back(entry((int)(3 * i), (int)i));
+
+    printf("%zu sorted entries\n", n);
+    {
+        bench_timer t;
+        map<int, int, std::less<int>, pool_alloc> m;
+        for (size_t i = 0; i < n; ++i)
+            m.insert(input[i]);
+        bench_report("insert one by one", n, t.seconds());
+        bench_keep(m.size());
+    }
+    {
+        bench_timer t;
+        map<int, int, std::less<int>, pool_alloc> m;
+        for (size_t i = 0; i < n; ++i)
+            m.insert(m.end(), input[i]);
+        bench_report("insert with end() hint", n, t.seconds());
+        bench_keep(m.size());
+    }
+    {
+        bench_timer t;
+        map<int, int, std::less<int>, pool_alloc> m(input.begin(), input.end());
+        bench_report("range constructor (checks order)", n, t.seconds());
+        bench_keep(m.size());
+    }
+    {
+        bench_timer t;
+        map<int, int, std::less<int>, pool_alloc> m(sorted_unique, input.begin(), input.end());
+        bench_report("sorted_unique constructor", n, t.seconds());
+        bench_keep(m.size());
+    }
+    return 0;
+}
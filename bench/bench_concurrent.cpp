@@ -0,0 +1,97 @@
+#include "../concurrent_map.h"
+#include "bench.h"
+#include <thread>
+#include <vector>
+
+/*
+ *  lookups from 1 to N reader threads while one writer keeps updating:
+ *  concurrent_map against a map behind a mutex. each configuration runs
+ *  for a fixed time and reports the lookups and writes done by all
+ *  threads together.
+ */
+
+struct locked_map {
+    typedef map<int, long> rep_type;
+    rep_type m;
+    mutable std::mutex mutex;
+
+    bool find(int k, long &out) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        rep_type::const_iterator it = m.find(k);
+        if (it == m.end())
+            return false;
+        out = it->second;
+        return true;
+    }
+    void insert_or_assign(int k, long v) {
+        std::lock_guard<std::mutex> lock(mutex);
+        m[k] = v;
+    }
+};
+
+template <class Map>
+static void run(const char *name, Map &m, size_t n, int readers, double seconds) {
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> lookups(0);
+    size_t writes = 0;
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; ++r)
+        threads.push_back(std::thread([&, r] {
+            unsigned seed = 77 + r;
+            size_t done = 0;
+            long sum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 64; ++i) {
+                    seed = seed * 1103515245 + 12345;
+                    long v;
+                    if (m.find((int)((seed >> 4) % n), v))
+                        sum += v;
+                }
+                done += 64;
+            }
+            lookups += done;
+            bench_keep(sum);
+        }));
+
+    bench_timer t;
+    unsigned seed = 5;
+    while (t.seconds() < seconds) {
+        for (int i = 0; i < 16; ++i) {
+            seed = seed * 1103515245 + 12345;
+            m.insert_or_assign((int)((seed >> 4) % n), (long)writes);
+            ++writes;
+        }
+    }
+    stop = true;
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    double elapsed = t.seconds();
+
+    char what[64];
+    snprintf(what, sizeof what, "%s, %d readers, lookups", name, readers);
+    bench_report(what, lookups.load(), elapsed);
+    snprintf(what, sizeof what, "%s, %d readers, writes", name, readers);
+    bench_report(what, writes, elapsed);
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 100000);
+    int most = (int)std::thread::hardware_concurrency();
+    if (most < 4)
+        most = 4;
+
+    concurrent_map<int, long> c;
+    c.update([n](concurrent_map<int, long>::snapshot_type &m) {
+        for (size_t i = 0; i < n; ++i)
+            m.insert(concurrent_map<int, long>::value_type((int)i, (long)i));
+    });
+    locked_map l;
+    for (size_t i = 0; i < n; ++i)
+        l.m[(int)i] = (long)i;
+
+    for (int readers = 1; readers <= most; readers *= 2) {
+        run("concurrent_map", c, n, readers, 0.5);
+        run("map + mutex", l, n, readers, 0.5);
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "../map.h"
+#include "bench.h"
+#include <vector>
+
+/*
+ *  a loop of find() against find_batch() over the same probes (all
+ *  hits, in random order), for trees from cache sized to well past the
+ *  last level cache.
+ */
+
+void run(size_t n, size_t probes) {
+    typedef map<int, int, std::less<int>, pool_alloc> tree;
+    std::vector<int> keys(n);
+    tree m;
+    unsigned seed = 42;
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245 + 12345;
+        keys[i] = (int)((seed >> 1) ^ (unsigned)(i << 7));
+        m.insert(tree::value_type(keys[i], (int)i));
+    }
+    std::vector<int> probe(probes);
+    for (size_t i = 0; i < probes; ++i)
+        probe[i] = keys[(i * 7919) % n];
+
+    char what[64];
+    long sum = 0;
+    bench_timer t;
+    for (size_t i = 0; i < probes; ++i)
+        sum += m.find(probe[i])->second;
+    snprintf(what, sizeof what, "%zu keys, find loop", n);
+    bench_report(what, probes, t.seconds());
+
+    std::vector<tree::iterator> out(probes);
+    bench_timer t2;
+    m.find_batch(probe.begin(), probe.end(), out.begin());
+    for (size_t i = 0; i < probes; ++i)
+        sum += out[i]->second;
+    snprintf(what, sizeof what, "%zu keys, find_batch", n);
+    bench_report(what, probes, t2.seconds());
+    bench_keep(sum);
+}
+
+int main(int argc, char **argv) {
+    size_t probes = bench_size(argc, argv, 1000000);
+    size_t sizes[] = { 1000, 64000, 1000000, 4000000 };
+    for (size_t i = 0; i < sizeof sizes / sizeof *sizes; ++i)
+        run(sizes[i], probes);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include "../eytzinger.h"
+#include "bench.h"
+#include <vector>
+
+/*
+ *  random lookups (half of them misses) in a map and in its frozen
+ *  snapshot, plus the cost of taking the snapshot.
+ */
+
+template <class Map>
+void lookups(const char *name, const Map &m, const std::vector<int> &probes) {
+    size_t n = probes.size();
+    char what[64];
+    long sum = 0;
+    bench_timer t;
+    for (size_t i = 0; i < n; ++i) {
+        typename Map::const_iterator it = m.find(probes[i]);
+        if (it != m.end())
+            sum += it->second;
+    }
+    snprintf(what, sizeof what, "%s find", name);
+    bench_report(what, n, t.seconds());
+    bench_keep(sum);
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+    std::vector<int> probes(n);
+    map<int, int> m;
+    unsigned seed = 42;
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245 + 12345;
+        probes[i] = (int)(seed >> 1);
+        if (i & 1)
+            m.insert(map<int, int>::value_type(probes[i], (int)i));
+    }
+
+    printf("%zu random int keys\n", m.size());
+    bench_timer t;
+    frozen_map<int, int> f(m);
+    bench_report("freeze", f.size(), t.seconds());
+    lookups("map", m, probes);
+    lookups("frozen_map", f, probes);
+    return 0;
+}
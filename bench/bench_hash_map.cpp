@@ -0,0 +1,59 @@
+#include "../hash_map.h"
+#include "../map.h"
+#include "bench.h"
+#include <unordered_map>
+#include <vector>
+
+/*
+ *  n random int keys: inserting them all, looking each up (hits), looking
+ *  up as many absent keys (misses), and erasing them all, for hash_map,
+ *  map and std::unordered_map.
+ */
+
+template <class Map>
+static void run(const char *name, const std::vector<int> &keys, const std::vector<int> &absent) {
+    char what[64];
+    size_t n = keys.size();
+    Map m;
+
+    bench_timer t;
+    for (size_t i = 0; i < n; ++i)
+        m.insert(std::pair<const int, int>(keys[i], (int)i));
+    snprintf(what, sizeof what, "%s, insert", name);
+    bench_report(what, n, t.seconds());
+
+    bench_timer t2;
+    long sum = 0;
+    for (size_t i = 0; i < n; ++i)
+        sum += m.find(keys[i])->second;
+    snprintf(what, sizeof what, "%s, find hit", name);
+    bench_report(what, n, t2.seconds());
+
+    bench_timer t3;
+    for (size_t i = 0; i < n; ++i)
+        sum += m.find(absent[i]) == m.end();
+    snprintf(what, sizeof what, "%s, find miss", name);
+    bench_report(what, n, t3.seconds());
+    bench_keep(sum);
+
+    bench_timer t4;
+    for (size_t i = 0; i < n; ++i)
+        m.erase(keys[i]);
+    snprintf(what, sizeof what, "%s, erase", name);
+    bench_report(what, n, t4.seconds());
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+    std::vector<int> keys(n), absent(n);
+    for (size_t i = 0; i < n; ++i) {
+        unsigned x = (unsigned)i * 2654435761u;     // distinct, in no order
+        keys[i] = (int)(x | 1);
+        absent[i] = (int)(x & ~1u);
+    }
+
+    run<hash_map<int, int> >("hash_map", keys, absent);
+    run<map<int, int> >("map", keys, absent);
+    run<std::unordered_map<int, int> >("std::unordered_map", keys, absent);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "../intrusive.h"
+#include "bench.h"
+#include <vector>
+
+/*
+ *  objects that already live in a slab, indexed by id and queued in
+ *  order: once with map<int, obj*> and list<obj*>, which allocate a
+ *  node per entry and reach the object through one more pointer, and
+ *  once with the intrusive containers, which link the objects as they
+ *  are. timed are building both, a lookup of every id, and taking
+ *  everything out again.
+ */
+
+struct obj : public list_hook<>, public set_hook<> {
+    int id;
+    long payload[4];
+};
+
+struct obj_id {
+    const int &operator()(const obj &o) const { return o.id;   }
+};
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+    std::vector<obj> slab(n);
+    for (size_t i = 0; i < n; ++i) {
+        slab[i].id = (int)((unsigned)i * 2654435761u);     // distinct, in no order
+        slab[i].payload[0] = (long)i;
+    }
+
+    {
+        map<int, obj*> index;
+        list<obj*> queue;
+        bench_timer t;
+        for (size_t i = 0; i < n; ++i) {
+            index.insert(std::pair<const int, obj*>(slab[i].id, &slab[i]));
+            queue.push_back(&slab[i]);
+        }
+        bench_report("map + list of pointers, build", n, t.seconds());
+
+        bench_timer t2;
+        long sum = 0;
+        for (size_t i = 0; i < n; ++i)
+            sum += index.find(slab[i].id)->second->payload[0];
+        bench_report("map + list of pointers, find", n, t2.seconds());
+        bench_keep(sum);
+
+        bench_timer t3;
+        for (size_t i = 0; i < n; ++i) {
+            index.erase(slab[i].id);
+            queue.erase(queue.begin());
+        }
+        bench_report("map + list of pointers, erase", n, t3.seconds());
+    }
+
+    {
+        intrusive_rb_tree<int, obj, obj_id> index;
+        intrusive_list<obj> queue;
+        bench_timer t;
+        for (size_t i = 0; i < n; ++i) {
+            index.insert_unique(slab[i]);
+            queue.push_back(slab[i]);
+        }
+        bench_report("intrusive tree + list, build", n, t.seconds());
+
+        bench_timer t2;
+        long sum = 0;
+        for (size_t i = 0; i < n; ++i)
+            sum += index.find(slab[i].id)->payload[0];
+        bench_report("intrusive tree + list, find", n, t2.seconds());
+        bench_keep(sum);
+
+        bench_timer t3;
+        for (size_t i = 0; i < n; ++i) {
+            index.erase(index.iterator_to(slab[i]));
+            queue.pop_front();
+        }
+        bench_report("intrusive tree + list, erase", n, t3.seconds());
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "../list_io.h"
+#include "bench.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ *  a checkpoint of a list and its reload, through a file in /tmp: the
+ *  old way, one fwrite() per element out and one fread() and push_back()
+ *  per element back, against save_list/load_list, for small elements
+ *  (copied through the buffer) and big ones (writev/readv in place).
+ *  the load with pool_alloc shows what the batch allocation adds.
+ */
+
+struct record {
+    unsigned id;
+    char payload[508];
+};
+
+template <class T, class Alloc>
+static void run(const char *what, list<T, Alloc> &l, int fd) {
+    size_t n = l.size();
+    std::string name(what);
+
+    lseek(fd, 0, SEEK_SET);
+    ftruncate(fd, 0);
+    FILE *f = fdopen(dup(fd), "w+");
+    bench_timer t;
+    for (typename list<T, Alloc>::iterator it = l.begin(); it != l.end(); ++it)
+        fwrite(&*it, sizeof(T), 1, f);
+    fflush(f);
+    bench_report((name + ": fwrite per element").c_str(), n, t.seconds());
+
+    rewind(f);
+    bench_timer t2;
+    list<T, Alloc> a;
+    T x;
+    while (fread(&x, sizeof(T), 1, f) == 1)
+        a.push_back(x);
+    bench_report((name + ": fread, push_back").c_str(), n, t2.seconds());
+    bench_keep(a.size());
+    fclose(f);
+
+    lseek(fd, 0, SEEK_SET);
+    ftruncate(fd, 0);
+    bench_timer t3;
+    {
+        list_writer out(fd);
+        save_list(out, l);
+        out.flush();
+    }
+    bench_report((name + ": save_list").c_str(), n, t3.seconds());
+
+    lseek(fd, 0, SEEK_SET);
+    bench_timer t4;
+    list<T, Alloc> b;
+    {
+        list_reader in(fd);
+        load_list(in, b);
+    }
+    bench_report((name + ": load_list").c_str(), n, t4.seconds());
+    bench_keep(b.size());
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+
+    char path[] = "/tmp/bench_list_io.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    unlink(path);
+
+    list<long> small;
+    for (size_t i = 0; i < n; ++i)
+        small.push_back((long)i * 7);
+    run("long", small, fd);
+
+    list<long, pool_alloc> pooled;
+    for (size_t i = 0; i < n; ++i)
+        pooled.push_back((long)i * 7);
+    run("long, pool_alloc", pooled, fd);
+
+    list<record> big;
+    record r = record();
+    for (size_t i = 0; i < n / 16; ++i) {
+        r.id = (unsigned)i;
+        big.push_back(r);
+    }
+    run("512-byte record", big, fd);
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "../library.h"
+#include "bench.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/*
+ *  sorting a list of strings too long for the small string buffer: the
+ *  old way, copied out into a vector, sorted and built back (two
+ *  allocations per element), against list::sort, which only relinks.
+ */
+
+static void fill(list<std::string> &l, size_t n) {
+    unsigned seed = 7;
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245 + 12345;
+        l.push_back("entry number " + std::to_string(seed >> 4) + " of the list");
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+
+    list<std::string> a;
+    fill(a, n);
+    bench_timer t;
+    std::vector<std::string> v;
+    for (list<std::string>::iterator it = a.begin(); it != a.end(); ++it)
+        v.push_back(*it);
+    std::stable_sort(v.begin(), v.end());
+    a.clear();
+    for (size_t i = 0; i < v.size(); ++i)
+        a.push_back(v[i]);
+    bench_report("copy to vector, sort, rebuild", n, t.seconds());
+    bench_keep(a.size());
+
+    list<std::string> b;
+    fill(b, n);
+    bench_timer t2;
+    b.sort();
+    bench_report("list::sort", n, t2.seconds());
+    bench_keep(b.size());
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "../mapped_map.h"
+#include "bench.h"
+#include <string>
+#include <vector>
+
+/*
+ *  getting a table of n int -> long back at start-up: parsing it from
+ *  text into a map, as a restart does now, against opening the binary
+ *  file mapped_map::write() left behind. then lookups of every key in
+ *  both. the file goes in the current directory.
+ */
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+    const char *path = "bench_mapped.tbl";
+    std::vector<int> probes(n);
+
+    map<int, long> source;
+    for (size_t i = 0; i < n; ++i) {
+        probes[i] = (int)((unsigned)i * 2654435761u >> 1);
+        source[probes[i]] = (long)i;
+    }
+    std::string text;
+    char line[64];
+    for (map<int, long>::iterator it = source.begin(); it != source.end(); ++it) {
+        snprintf(line, sizeof line, "%d %ld\n", it->first, it->second);
+        text += line;
+    }
+
+    bench_timer t;
+    map<int, long> parsed;
+    for (const char *p = text.c_str(); *p; ) {
+        char *end;
+        int k = (int)strtol(p, &end, 10);
+        long v = strtol(end, &end, 10);
+        parsed.insert(parsed.end(), std::pair<const int, long>(k, v));
+        p = end + 1;
+    }
+    bench_report("rebuild map from text", n, t.seconds());
+
+    bench_timer t2;
+    mapped_map<int, long>::write(path, source);
+    bench_report("mapped_map::write", n, t2.seconds());
+
+    bench_timer t3;
+    mapped_map<int, long> m(path);
+    bench_report("open mapped_map", n, t3.seconds());
+
+    bench_timer t4;
+    long sum = 0;
+    for (size_t i = 0; i < n; ++i)
+        sum += parsed.find(probes[i])->second;
+    bench_report("map find", n, t4.seconds());
+
+    bench_timer t5;
+    for (size_t i = 0; i < n; ++i)
+        sum += (*m.find(probes[i])).second;
+    bench_report("mapped_map find", n, t5.seconds());
+    bench_keep(sum);
+
+    remove(path);
+    return 0;
+}
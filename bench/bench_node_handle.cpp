@@ -0,0 +1,52 @@
+#include "../map.h"
+#include "bench.h"
+#include <string>
+
+/*
+ *  rebucketing: every other entry of one map moves to another, once as
+ *  erase + insert (a free and a malloc, the value moved) and once as
+ *  extract + insert of the node itself. the values are strings too long
+ *  for the small string buffer, so a copy would allocate as well.
+ */
+
+typedef map<int, std::string> table;
+
+static void fill(table &m, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        m[(int)i] = "entry number " + std::to_string(i) + " of the table";
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+    size_t moved = (n + 1) / 2;
+
+    table a, b;
+    fill(a, n);
+    bench_timer t;
+    for (table::iterator it = a.begin(); it != a.end(); ) {
+        table::iterator next = it;
+        ++next;
+        b.insert(b.end(), table::value_type(it->first, std::move(it->second)));
+        a.erase(it);
+        if (next == a.end()) break;
+        it = next;
+        ++it;
+    }
+    bench_report("erase + insert", moved, t.seconds());
+    bench_keep(b.size());
+
+    table c, d;
+    fill(c, n);
+    bench_timer t2;
+    for (table::iterator it = c.begin(); it != c.end(); ) {
+        table::iterator next = it;
+        ++next;
+        d.insert(d.end(), c.extract(it));
+        if (next == c.end()) break;
+        it = next;
+        ++it;
+    }
+    bench_report("extract + insert", moved, t2.seconds());
+    bench_keep(d.size());
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "../persistent_map.h"
+#include "bench.h"
+#include <vector>
+
+/*
+ *  keeping versions of a map of n ints: a snapshot after every k
+ *  updates (random keys, half insert_or_assign, half erase + insert),
+ *  as persistent_map snapshots and as full map copies. the memory of
+ *  the live version plus all snapshots is counted by the allocator.
+ */
+
+static size_t live_bytes = 0;
+
+struct counting_alloc {
+    static void *allocate(size_t n) {
+        live_bytes += n;
+        return malloc(n);
+    }
+    static void deallocate(void *p, size_t n) {
+        live_bytes -= n;
+        free(p);
+    }
+};
+
+typedef persistent_map<int, int, std::less<int>, counting_alloc> versioned;
+typedef map<int, int, std::less<int>, counting_alloc> copied;
+
+template <class Map>
+static void update(Map &m, size_t n, unsigned &seed, size_t i) {
+    seed = seed * 1103515245 + 12345;
+    int k = (int)((seed >> 4) % n);
+    if (i & 1)
+        m.insert_or_assign(k, (int)i);
+    else {
+        m.erase(k);
+        m.insert(typename Map::value_type(k, (int)i));
+    }
+}
+
+/*
+ *  map has no insert_or_assign.
+ */
+static void update(copied &m, size_t n, unsigned &seed, size_t i) {
+    seed = seed * 1103515245 + 12345;
+    int k = (int)((seed >> 4) % n);
+    if (i & 1)
+        m[k] = (int)i;
+    else {
+        m.erase(k);
+        m.insert(copied::value_type(k, (int)i));
+    }
+}
+
+template <class Map>
+static void run(const char *name, size_t n, size_t k, size_t snapshots) {
+    size_t base = live_bytes;
+    double seconds = 0;
+    {
+        Map m;
+        for (size_t i = 0; i < n; ++i)
+            m.insert(typename Map::value_type((int)i, (int)i));
+        size_t one = live_bytes - base;
+
+        std::vector<Map> kept;
+        kept.reserve(snapshots);
+        unsigned seed = 42;
+        bench_timer t;
+        for (size_t s = 0; s < snapshots; ++s) {
+            for (size_t i = 0; i < k; ++i)
+                update(m, n, seed, i);
+            kept.push_back(m);
+        }
+        seconds = t.seconds();
+
+        size_t all = live_bytes - base;
+        char what[64];
+        snprintf(what, sizeof what, "%s, k = %zu", name, k);
+        printf("%-40s %10.1f MB  %8.2f KB/snapshot  %8.3f s\n", what, all / 1e6,
+               (all - one) / 1e3 / snapshots, seconds);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 100000);
+    size_t snapshots = 20;
+    size_t ks[] = { 1, 10, 100, 1000 };
+    for (size_t i = 0; i < sizeof ks / sizeof *ks; ++i) {
+        run<versioned>("persistent_map", n, ks[i], snapshots);
+        run<copied>("map, full copies", n, ks[i], snapshots);
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "../lf_queue.h"
+#include "bench.h"
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+/*
+ *  producers push, consumers pop until every item has gone through:
+ *  mpmc_queue and, with one consumer, mpsc_queue against a list behind
+ *  a mutex used with push_back and erase(begin()). reported is the
+ *  number of items through per second.
+ */
+
+struct locked_list {
+    list<long> l;
+    std::mutex mutex;
+
+    void push(long x) {
+        std::lock_guard<std::mutex> lock(mutex);
+        l.push_back(x);
+    }
+    bool pop(long &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (l.empty())
+            return false;
+        out = l.front();
+        l.erase(l.begin());
+        return true;
+    }
+};
+
+template <class Queue>
+static void run(const char *name, int producers, int consumers, size_t items) {
+    Queue q;
+    std::atomic<size_t> left(items * producers);
+    std::vector<std::thread> workers;
+    bench_timer t;
+    for (int p = 0; p < producers; ++p)
+        workers.push_back(std::thread([&q, items] {
+            for (size_t i = 0; i < items; ++i)
+                q.push((long)i);
+        }));
+    for (int c = 0; c < consumers; ++c)
+        workers.push_back(std::thread([&q, &left] {
+            long x, sum = 0;
+            while (left.load(std::memory_order_relaxed) != 0) {
+                if (q.pop(x)) {
+                    sum += x;
+                    left.fetch_sub(1, std::memory_order_relaxed);
+                }
+                else
+                    std::this_thread::yield();
+            }
+            bench_keep(sum);
+        }));
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    char what[64];
+    snprintf(what, sizeof what, "%s, %dp/%dc", name, producers, consumers);
+    bench_report(what, items * producers, t.seconds());
+}
+
+int main(int argc, char **argv) {
+    size_t items = bench_size(argc, argv, 1000000);
+    int most = (int)std::thread::hardware_concurrency();
+    if (most < 4)
+        most = 4;
+
+    for (int producers = 1; producers <= most; producers *= 2) {
+        run<mpsc_queue<long> >("mpsc_queue", producers, 1, items);
+        run<mpmc_queue<long> >("mpmc_queue", producers, 1, items);
+        run<locked_list>("list + mutex", producers, 1, items);
+    }
+    for (int threads = 2; threads <= most; threads *= 2) {
+        run<mpmc_queue<long> >("mpmc_queue", threads, threads, items);
+        run<locked_list>("list + mutex", threads, threads, items);
+    }
+    return 0;
+}
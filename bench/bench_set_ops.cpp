@@ -0,0 +1,52 @@
+#include "../map.h"
+#include "bench.h"
+#include <vector>
+
+/*
+ *  merging a map of m keys into one of n: a loop of inserts against
+ *  set_union, on one thread and on four. both draw their keys from
+ *  the same range, so some are in both.
+ */
+
+typedef map<int, int, std::less<int>, pool_alloc> tree;
+
+void fill(tree &m, size_t n, unsigned seed, int stride) {
+    std::vector<std::pair<int, int> > v;
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245 + 12345;
+        v.push_back(std::pair<int, int>((int)((seed >> 4) % (n * stride)), (int)i));
+    }
+    m.insert(v.begin(), v.end());
+}
+
+void run(size_t n, size_t m) {
+    char what[64];
+    {
+        tree big, small;
+        fill(big, n, 1, 2);
+        fill(small, m, 2, 2 * (int)(n / m));
+        bench_timer t;
+        for (tree::iterator it = small.begin(); it != small.end(); ++it)
+            big.insert(*it);
+        snprintf(what, sizeof what, "%zu into %zu, insert loop", m, n);
+        bench_report(what, m, t.seconds());
+    }
+    unsigned threads[] = { 1, 4 };
+    for (int i = 0; i < 2; ++i) {
+        tree big, small;
+        fill(big, n, 1, 2);
+        fill(small, m, 2, 2 * (int)(n / m));
+        bench_timer t;
+        big.set_union(std::move(small), threads[i]);
+        snprintf(what, sizeof what, "%zu into %zu, set_union x%u", m, n, threads[i]);
+        bench_report(what, m, t.seconds());
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+    size_t sizes[] = { n / 1000, n / 100, n / 10, n };
+    for (size_t i = 0; i < sizeof sizes / sizeof *sizes; ++i)
+        run(n, sizes[i]);
+    return 0;
+}
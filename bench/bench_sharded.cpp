@@ -0,0 +1,90 @@
+#include "../sharded_map.h"
+#include "bench.h"
+#include <thread>
+#include <vector>
+
+/*
+ *  a write-heavy mix from 1 to N threads (half insert_or_assign, a
+ *  quarter erase, a quarter find, uniform keys): sharded_map with 64
+ *  range shards against one map behind a mutex. every thread does the
+ *  same number of operations; reported is the total rate.
+ */
+
+struct locked_map {
+    typedef map<int, long> rep_type;
+    rep_type m;
+    std::mutex mutex;
+
+    bool find(int k, long &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rep_type::iterator it = m.find(k);
+        if (it == m.end())
+            return false;
+        out = it->second;
+        return true;
+    }
+    void insert_or_assign(int k, long v) {
+        std::lock_guard<std::mutex> lock(mutex);
+        m[k] = v;
+    }
+    void erase(int k) {
+        std::lock_guard<std::mutex> lock(mutex);
+        m.erase(k);
+    }
+};
+
+template <class Map>
+static void run(const char *name, Map &m, size_t n, int threads, size_t ops) {
+    std::vector<std::thread> workers;
+    bench_timer t;
+    for (int w = 0; w < threads; ++w)
+        workers.push_back(std::thread([&m, n, ops, w] {
+            unsigned seed = 99 + w;
+            long sum = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                seed = seed * 1103515245 + 12345;
+                int k = (int)((seed >> 4) % n);
+                switch (seed >> 30) {
+                case 0:
+                case 1: m.insert_or_assign(k, (long)i); break;
+                case 2: m.erase(k); break;
+                default: {
+                    long v;
+                    if (m.find(k, v))
+                        sum += v;
+                }
+                }
+            }
+            bench_keep(sum);
+        }));
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    char what[64];
+    snprintf(what, sizeof what, "%s, %d threads", name, threads);
+    bench_report(what, ops * threads, t.seconds());
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+    size_t ops = 500000;
+    int most = (int)std::thread::hardware_concurrency();
+    if (most < 4)
+        most = 4;
+
+    std::vector<int> splits;
+    for (int i = 1; i < 64; ++i)
+        splits.push_back((int)(n * i / 64));
+
+    for (int threads = 1; threads <= most; threads *= 2) {
+        sharded_map<int, long> s(splits);
+        locked_map l;
+        for (size_t i = 0; i < n; i += 2) {
+            s.insert_or_assign((int)i, (long)i);
+            l.insert_or_assign((int)i, (long)i);
+        }
+        run("sharded_map, 64 shards", s, n, threads, ops);
+        run("map + mutex", l, n, threads, ops);
+    }
+    return 0;
+}
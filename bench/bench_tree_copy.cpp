@@ -0,0 +1,45 @@
+#include "../map.h"
+#include "bench.h"
+#include <vector>
+
+/*
+ *  copying and freeing a big map: the copy constructor and clear() on
+ *  one thread against the same with subtrees on four threads, and how
+ *  long clear_async() holds up its caller against how long the nodes
+ *  take to go.
+ */
+
+typedef map<int, long, std::less<int>, mt_pool_alloc> tree;
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+
+    std::vector<std::pair<int, long> > v;
+    for (size_t i = 0; i < n; ++i)
+        v.push_back(std::pair<int, long>((int)i, (long)i));
+    tree m(sorted_unique, v.begin(), v.end());
+
+    unsigned threads[] = { 1, 4 };
+    for (int i = 0; i < 2; ++i) {
+        char what[64];
+        bench_timer t;
+        tree c(m, threads[i]);
+        snprintf(what, sizeof what, "copy x%u", threads[i]);
+        bench_report(what, n, t.seconds());
+
+        bench_timer t2;
+        c.clear(threads[i]);
+        snprintf(what, sizeof what, "clear x%u", threads[i]);
+        bench_report(what, n, t2.seconds());
+        bench_keep(c.size());
+    }
+
+    tree c(m);
+    bench_timer t;
+    std::future<void> done = c.clear_async(4);
+    double returned = t.seconds();
+    done.wait();
+    bench_report("clear_async, until it returns", n, returned);
+    bench_report("clear_async, until the nodes are gone", n, t.seconds());
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "../unrolled_list.h"
+#include "bench.h"
+
+/*
+ *  list<int> against unrolled_list<int> (58 ints a chunk): scanning,
+ *  inserting at a spot in the middle, and erasing every other element.
+ *  a list that has lived a while has its nodes spread over the heap, so
+ *  it is scanned twice: in allocation order, and after sort() has
+ *  relinked the nodes into an order unrelated to their addresses.
+ */
+
+template <class List>
+static void fill(List &l, size_t n) {
+    unsigned seed = 31;
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245 + 12345;
+        l.push_back((int)(seed >> 8));
+    }
+}
+
+template <class List>
+static void scan(const char *name, const List &l, size_t rounds) {
+    bench_timer t;
+    long sum = 0;
+    for (size_t r = 0; r < rounds; ++r)
+        for (typename List::const_iterator it = l.begin(); it != l.end(); ++it)
+            sum += *it;
+    bench_report(name, l.size() * rounds, t.seconds());
+    bench_keep(sum);
+}
+
+template <class List>
+static void insert_middle(const char *name, size_t n, size_t inserts) {
+    List l;
+    fill(l, n);
+    typename List::iterator it = l.begin();
+    for (size_t i = 0; i < n / 2; ++i)
+        ++it;
+    bench_timer t;
+    for (size_t i = 0; i < inserts; ++i)
+        it = l.insert(it, (int)i);
+    bench_report(name, inserts, t.seconds());
+    bench_keep(l.size());
+}
+
+template <class List>
+static void erase_alternate(const char *name, size_t n) {
+    List l;
+    fill(l, n);
+    bench_timer t;
+    for (typename List::iterator it = l.begin(); it != l.end(); ) {
+        it = l.erase(it);
+        if (it != l.end())
+            ++it;
+    }
+    bench_report(name, n / 2, t.seconds());
+    bench_keep(l.size());
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_size(argc, argv, 1000000);
+    size_t rounds = 10;
+
+    {
+        list<int> l;
+        fill(l, n);
+        unrolled_list<int> u;
+        fill(u, n);
+        scan("scan list, allocation order", l, rounds);
+        l.sort();
+        scan("scan list, scattered", l, rounds);
+        scan("scan unrolled_list", u, rounds);
+    }
+
+    insert_middle<list<int> >("insert middle, list", n, n);
+    insert_middle<unrolled_list<int> >("insert middle, unrolled_list", n, n);
+
+    erase_alternate<list<int> >("erase alternate, list", n);
+    erase_alternate<unrolled_list<int> >("erase alternate, unrolled_list", n);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "../btree_map.h"
+#include "../flat_map.h"
+#include "../hash_map.h"
+#include <string>
+#include <cstdio>
+
+/*
+ *  inserts whose argument is a value already in the map, taken by
+ *  reference: m.try_emplace(k, m.find(j)->second). the insert may move
+ *  that value (a shift, a split, a regrow) before the new one is built
+ *  from it, so every new value is checked against a copy made
+ *  beforehand. the strings are long enough to live on the heap, so a
+ *  read of a moved from value shows up as a wrong answer, and as a use
+ *  after free under -fsanitize=address. exits 1 on a failure.
+ */
+
+static bool failed = false;
+
+static std::string value_of(int k) {
+    return std::string(40, (char)('a' + k % 26)) + std::to_string(k);
+}
+
+/*
+ *  fills m with the even keys below 2 * n, then puts each odd key in
+ *  with a copy of the value of the key above it, so that every insert
+ *  lands in front of its source and the map grows through every
+ *  kind of move.
+ */
+template <class Map>
+static void run(const char *name, int n) {
+    Map m;
+    for (int k = 0; k < 2 * n; k += 2)
+        m.try_emplace(k, value_of(k));
+    for (int k = 2 * n - 3; k > 0; k -= 2) {
+        std::string want = m.find(k + 1)->second;
+        m.try_emplace(k, m.find(k + 1)->second);
+        if (m.find(k)->second != want || m.find(k + 1)->second != want) {
+            printf("FAIL: %s, key %d\n", name, k);
+            failed = true;
+            break;
+        }
+    }
+    printf("%-40s %s\n", name, failed ? "FAILED" : "ok");
+}
+
+int main() {
+    run<btree_map<int, std::string> >("btree_map", 1000);
+    run<flat_map<int, std::string> >("flat_map", 1000);
+    run<hash_map<int, std::string> >("hash_map", 1000);
+    return failed ? 1 : 0;
+}
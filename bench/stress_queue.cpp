@@ -0,0 +1,83 @@
+#include "../lf_queue.h"
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ *  a checked run of the queues, for the tag and node reuse logic more
+ *  than for speed: producers push (producer, sequence number) pairs,
+ *  consumers pop them, and at the end every item has to have come out
+ *  exactly once, and each consumer has to have seen every producer's
+ *  items in the order they were pushed. the queue stays short, so
+ *  nodes go around the free list all the time. exits 1 on a failure.
+ *  meant to be run under -fsanitize=thread too.
+ */
+
+struct item {
+    unsigned producer;
+    unsigned seq;
+};
+
+static std::atomic<bool> failed(false);
+
+static void fail(const char *what, unsigned producer, unsigned seq) {
+    printf("FAIL: %s (producer %u, item %u)\n", what, producer, seq);
+    failed.store(true);
+}
+
+template <class Queue>
+static void run(const char *name, int producers, int consumers, unsigned items) {
+    Queue q;
+    std::vector<std::atomic<unsigned char> > seen(producers * (size_t)items);
+    std::atomic<size_t> left(producers * (size_t)items);
+    std::vector<std::thread> workers;
+
+    for (int p = 0; p < producers; ++p)
+        workers.push_back(std::thread([&q, p, items] {
+            for (unsigned i = 0; i < items; ++i) {
+                item x = { (unsigned)p, i };
+                q.push(x);
+            }
+        }));
+    std::vector<std::vector<long> > last(consumers, std::vector<long>(producers, -1));
+    for (int c = 0; c < consumers; ++c)
+        workers.push_back(std::thread([&, c] {
+            std::vector<long> &mine = last[c];
+            item x;
+            while (left.load(std::memory_order_relaxed) != 0) {
+                if (!q.pop(x))
+                    continue;
+                left.fetch_sub(1, std::memory_order_relaxed);
+                if (x.producer >= (unsigned)producers || x.seq >= items) {
+                    fail("item out of range", x.producer, x.seq);
+                    continue;
+                }
+                if ((long)x.seq <= mine[x.producer])
+                    fail("out of order", x.producer, x.seq);
+                mine[x.producer] = x.seq;
+                if (seen[x.producer * (size_t)items + x.seq].fetch_add(1) != 0)
+                    fail("popped twice", x.producer, x.seq);
+            }
+        }));
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    item x;
+    if (q.pop(x))
+        fail("left in the queue", x.producer, x.seq);
+    for (int p = 0; p < producers; ++p)
+        for (unsigned i = 0; i < items; ++i)
+            if (seen[p * (size_t)items + i].load() != 1)
+                fail("lost", p, i);
+    printf("%-40s %s\n", name, failed ? "FAILED" : "ok");
+}
+
+int main(int argc, char **argv) {
+    unsigned items = argc > 1 ? (unsigned)strtoul(argv[1], 0, 10) : 100000;
+    run<mpsc_queue<item> >("mpsc_queue, 4 producers", 4, 1, items);
+    run<mpmc_queue<item> >("mpmc_queue, 4 producers, 4 consumers", 4, 4, items);
+    run<mpmc_queue<item> >("mpmc_queue, 1 producer, 3 consumers", 1, 3, items);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,943 @@
+#ifndef LIST_BTREE_MAP_H
+#define LIST_BTREE_MAP_H
+
+/*
+ *  a b+ tree with the interface of map, for big maps where the
+ *  rb_tree's one-node-per-value layout makes every level of a lookup a
+ *  cache miss.
+ *
+ *  the values live in the leaves, many to a node, and the leaves are
+ *  chained for ordered scans. internal nodes only hold copies of keys,
+ *  the separators, and child pointers: child i holds the keys k with
+ *  keys[i - 1] <= k < keys[i]. nodes are sized to __btree_node_bytes,
+ *  a few cache lines, and searched with __node_search from search.h,
+ *  a vectorized count for arithmetic keys.
+ *
+ *  unlike rb_tree, insert and erase move values between slots, so they
+ *  invalidate every iterator into the tree.
+ */
+
+#include "map.h"
+#include "search.h"
+#include <type_traits>
+
+enum { __btree_node_bytes = 256 };
+
+struct __btree_node_base {
+    typedef __btree_node_base *base_ptr;
+
+    base_ptr parent;
+    unsigned short position;    // index among the parent's children
+    unsigned short count;       // values of a leaf, keys of an internal node
+    bool leaf;
+};
+
+template <class Value, int N>
+struct __btree_leaf_node : public __btree_node_base {
+    __btree_leaf_node *prev;
+    __btree_leaf_node *next;
+    typename std::aligned_storage<sizeof(Value), alignof(Value)>::type slot[N];
+
+    Value *values() { return reinterpret_cast<Value*>(slot);  }
+};
+
+template <class Key, int N>
+struct __btree_internal_node : public __btree_node_base {
+    typename std::aligned_storage<sizeof(Key), alignof(Key)>::type slot[N];
+    __btree_node_base *children[N + 1];
+
+    Key *keys() { return reinterpret_cast<Key*>(slot);    }
+};
+
+
+/*
+ *  a position in a leaf. end() is one past the last value of the last
+ *  leaf (or null for an empty tree), so every value has exactly one
+ *  iterator.
+ */
+template <class Value, class Ref, class Ptr, class Leaf>
+struct __btree_iterator {
+    typedef bidirectional_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef Ref reference;
+    typedef Ptr pointer;
+    typedef ptrdiff_t difference_type;
+    typedef __btree_iterator<Value, Value&, Value*, Leaf> iterator;
+    typedef __btree_iterator<Value, Ref, Ptr, Leaf> self;
+
+    Leaf *node;
+    int position;
+
+    __btree_iterator() : node(0), position(0) {  }
+    __btree_iterator(Leaf *x, int pos) : node(x), position(pos) {  }
+    __btree_iterator(const iterator &it) : node(it.node), position(it.position) {  }
+
+    reference operator*() const { return node->values()[position];    }
+    pointer operator->() const { return &(operator*());    }
+
+    bool operator==(const self &x) const { return node == x.node && position == x.position;  }
+    bool operator!=(const self &x) const { return !(*this == x);    }
+
+    self &operator++() {
+        if (++position == node->count && node->next != 0) {
+            node = node->next;
+            position = 0;
+        }
+        return *this;
+    }
+
+    self operator++(int) {
+        self tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    self &operator--() {
+        if (position == 0) {
+            node = node->prev;
+            position = node->count;
+        }
+        --position;
+        return *this;
+    }
+
+    self operator--(int) {
+        self tmp = *this;
+        --*this;
+        return tmp;
+    }
+};
+
+
+template <class Key, class Value, class KeyOfValue, class Compare = std::less<Key>, class Alloc = alloc>
+class btree {
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef value_type *pointer;
+    typedef const value_type *const_pointer;
+    typedef value_type &reference;
+    typedef const value_type &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+protected:
+    typedef __btree_node_base *base_ptr;
+
+    enum {
+        leaf_slots = (__btree_node_bytes - sizeof(__btree_node_base) - 2 * sizeof(void*)) / sizeof(Value) > 3 ?
+                     (__btree_node_bytes - sizeof(__btree_node_base) - 2 * sizeof(void*)) / sizeof(Value) : 3,
+        internal_slots = (__btree_node_bytes - sizeof(__btree_node_base) - sizeof(void*)) /
+                         (sizeof(Key) + sizeof(void*)) > 3 ?
+                         (__btree_node_bytes - sizeof(__btree_node_base) - sizeof(void*)) /
+                         (sizeof(Key) + sizeof(void*)) : 3,
+        min_leaf = leaf_slots / 2,
+        min_internal = internal_slots / 2
+    };
+
+    typedef __btree_leaf_node<Value, leaf_slots> leaf_node;
+    typedef __btree_internal_node<Key, internal_slots> internal_node;
+    typedef leaf_node *leaf_ptr;
+    typedef internal_node *internal_ptr;
+    typedef simple_alloc<leaf_node, Alloc> leaf_allocator;
+    typedef simple_alloc<internal_node, Alloc> internal_allocator;
+    typedef __node_search<Key, Value, KeyOfValue, Compare> value_search;
+    typedef __node_search<Key, Key, identity<Key>, Compare> key_search;
+
+public:
+    typedef __btree_iterator<value_type, reference, pointer, leaf_node> iterator;
+    typedef __btree_iterator<value_type, const_reference, const_pointer, leaf_node> const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+protected:
+    base_ptr root;
+    leaf_ptr leftmost;
+    leaf_ptr rightmost;
+    size_type node_count;       // number of values, named after rb_tree's
+    Compare key_compare;
+
+    leaf_ptr create_leaf() {
+        leaf_ptr x = leaf_allocator::allocate();
+        x->parent = 0;
+        x->position = 0;
+        x->count = 0;
+        x->leaf = true;
+        x->prev = 0;
+        x->next = 0;
+        return x;
+    }
+
+    internal_ptr create_internal() {
+        internal_ptr x = internal_allocator::allocate();
+        x->parent = 0;
+        x->position = 0;
+        x->count = 0;
+        x->leaf = false;
+        return x;
+    }
+
+    void destroy_leaf(leaf_ptr x) {
+        for (int i = 0; i < x->count; ++i)
+            destroy(x->values() + i);
+        leaf_allocator::deallocate(x);
+    }
+
+    void destroy_internal(internal_ptr x) {
+        for (int i = 0; i < x->count; ++i)
+            destroy(x->keys() + i);
+        internal_allocator::deallocate(x);
+    }
+
+    static const Key &key(const Value &v) { return KeyOfValue()(v);  }
+
+    /*
+     *  hangs child under p at index i, fixing its back links.
+     */
+    static void set_child(internal_ptr p, int i, base_ptr child) {
+        p->children[i] = child;
+        child->parent = p;
+        child->position = (unsigned short)i;
+    }
+
+    leaf_ptr find_leaf(const key_type &k) const {
+        base_ptr x = root;
+        while (!x->leaf) {
+            internal_ptr p = (internal_ptr)x;
+            x = p->children[key_search::upper(p->keys(), p->count, k, key_compare)];
+        }
+        return (leaf_ptr)x;
+    }
+
+    /*
+     *  (x, position) with position == x->count is the end of x: move on
+     *  to the next leaf unless x is the last one.
+     */
+    static iterator normalize(leaf_ptr x, int position) {
+        if (position == x->count && x->next != 0)
+            return iterator(x->next, 0);
+        return iterator(x, position);
+    }
+
+    template <class... Args>
+    iterator __insert_at(leaf_ptr x, int position, Args&&... args);
+    template <class... Args>
+    iterator __place_at(leaf_ptr x, int position, Args&&... args);
+    void __insert_into_parent(base_ptr left, const key_type &k, base_ptr right);
+    void __erase_at(leaf_ptr x, int position);
+    void __rebalance_leaf(leaf_ptr x);
+    void __rebalance_internal(internal_ptr x);
+    void __erase(base_ptr x);
+
+public:
+    explicit btree(const Compare &comp = Compare())
+            : root(0), leftmost(0), rightmost(0), node_count(0), key_compare(comp) {    }
+
+    btree(const btree<Key, Value, KeyOfValue, Compare, Alloc> &x)
+            : root(0), leftmost(0), rightmost(0), node_count(0), key_compare(x.key_compare) {
+        for (const_iterator it = x.begin(); it != x.end(); ++it)
+            __append(*it);
+    }
+
+    btree(btree<Key, Value, KeyOfValue, Compare, Alloc> &&x)
+            : root(0), leftmost(0), rightmost(0), node_count(0), key_compare(x.key_compare) {
+        swap(x);
+    }
+
+    ~btree() {  clear();    }
+
+    btree<Key, Value, KeyOfValue, Compare, Alloc> &
+    operator=(const btree<Key, Value, KeyOfValue, Compare, Alloc> &x) {
+        if (this != &x) {
+            clear();
+            key_compare = x.key_compare;
+            for (const_iterator it = x.begin(); it != x.end(); ++it)
+                __append(*it);
+        }
+        return *this;
+    }
+
+    btree<Key, Value, KeyOfValue, Compare, Alloc> &
+    operator=(btree<Key, Value, KeyOfValue, Compare, Alloc> &&x) {
+        if (this != &x) {
+            clear();
+            swap(x);
+        }
+        return *this;
+    }
+
+    void swap(btree<Key, Value, KeyOfValue, Compare, Alloc> &x) {
+        std::swap(root, x.root);
+        std::swap(leftmost, x.leftmost);
+        std::swap(rightmost, x.rightmost);
+        std::swap(node_count, x.node_count);
+        std::swap(key_compare, x.key_compare);
+    }
+
+public:
+    Compare key_comp() const { return key_compare;  }
+    iterator begin() { return iterator(leftmost, 0);    }
+    const_iterator begin() const { return const_iterator(leftmost, 0);    }
+    iterator end() { return iterator(rightmost, rightmost ? rightmost->count : 0);    }
+    const_iterator end() const { return const_iterator(rightmost, rightmost ? rightmost->count : 0);  }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+    bool empty() const { return node_count == 0;    }
+    size_type size() const { return node_count; }
+    size_type max_size() const { return size_type(-1);  }
+
+public:
+    template <class... Args>
+    std::pair<iterator, bool> emplace_unique_key(const key_type &k, Args&&... args);
+    template <class... Args>
+    iterator emplace_hint_unique_key(iterator position, const key_type &k, Args&&... args);
+
+    std::pair<iterator, bool> insert_unique(const value_type &v) {
+        return emplace_unique_key(key(v), v);
+    }
+    std::pair<iterator, bool> insert_unique(value_type &&v) {
+        return emplace_unique_key(key(v), std::move(v));
+    }
+    iterator insert_unique(iterator position, const value_type &v) {
+        return emplace_hint_unique_key(position, key(v), v);
+    }
+    iterator insert_unique(iterator position, value_type &&v) {
+        return emplace_hint_unique_key(position, key(v), std::move(v));
+    }
+
+    /*
+     *  the value is built before its key is known, on the stack, and
+     *  moved into its slot.
+     */
+    template <class... Args>
+    std::pair<iterator, bool> emplace_unique(Args&&... args) {
+        value_type v(std::forward<Args>(args)...);
+        return emplace_unique_key(key(v), std::move(v));
+    }
+    template <class... Args>
+    iterator emplace_hint_unique(iterator position, Args&&... args) {
+        value_type v(std::forward<Args>(args)...);
+        return emplace_hint_unique_key(position, key(v), std::move(v));
+    }
+
+    template <class InputIterator>
+    void insert_unique(InputIterator first, InputIterator last) {
+        for ( ; first != last; ++first)
+            insert_unique(end(), *first);
+    }
+
+    /*
+     *  replaces the contents with [first, last), which must be sorted by
+     *  key_comp() without duplicates. every value is appended to the
+     *  last leaf, which fills the leaves completely.
+     */
+    template <class InputIterator>
+    void assign_sorted(InputIterator first, InputIterator last) {
+        clear();
+        for ( ; first != last; ++first)
+            __append(*first);
+    }
+
+    iterator erase(iterator position);
+    size_type erase(const key_type &k);
+    void erase(iterator first, iterator last);
+    void clear();
+
+public:
+    iterator find(const key_type &k);
+    const_iterator find(const key_type &k) const {
+        return const_cast<btree*>(this)->find(k);
+    }
+    size_type count(const key_type &k) const {  return find(k) == end() ? 0 : 1;   }
+    iterator lower_bound(const key_type &k);
+    const_iterator lower_bound(const key_type &k) const {
+        return const_cast<btree*>(this)->lower_bound(k);
+    }
+    iterator upper_bound(const key_type &k);
+    const_iterator upper_bound(const key_type &k) const {
+        return const_cast<btree*>(this)->upper_bound(k);
+    }
+    std::pair<iterator, iterator> equal_range(const key_type &k) {
+        return std::pair<iterator, iterator>(lower_bound(k), upper_bound(k));
+    }
+    std::pair<const_iterator, const_iterator> equal_range(const key_type &k) const {
+        return std::pair<const_iterator, const_iterator>(lower_bound(k), upper_bound(k));
+    }
+
+private:
+    template <class Arg>
+    void __append(Arg &&v) {
+        if (root == 0)
+            root = leftmost = rightmost = create_leaf();
+        __insert_at(rightmost, rightmost->count, std::forward<Arg>(v));
+    }
+};
+
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+template <class... Args>
+std::pair<typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator, bool>
+btree<Key, Value, KeyOfValue, Compare, Alloc>::emplace_unique_key(const key_type &k, Args&&... args) {
+    if (root == 0) {
+        root = leftmost = rightmost = create_leaf();
+        return std::pair<iterator, bool>(__insert_at(rightmost, 0, std::forward<Args>(args)...), true);
+    }
+
+    leaf_ptr x = find_leaf(k);
+    int i = value_search::lower(x->values(), x->count, k, key_compare);
+    if (i < x->count && !key_compare(k, key(x->values()[i])))
+        return std::pair<iterator, bool>(iterator(x, i), false);
+    return std::pair<iterator, bool>(__insert_at(x, i, std::forward<Args>(args)...), true);
+}
+
+/*
+ *  if k belongs right before position inside the same leaf, or after
+ *  the last value when position is end(), no descent is needed.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+template <class... Args>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::
+emplace_hint_unique_key(iterator position, const key_type &k, Args&&... args) {
+    leaf_ptr x = position.node;
+    int i = position.position;
+    if (x != 0 && (i == 0 || key_compare(key(x->values()[i - 1]), k))) {
+        if (x == rightmost && i == x->count)
+            return __insert_at(x, i, std::forward<Args>(args)...);
+        if (i > 0 && i < x->count && key_compare(k, key(x->values()[i])))
+            return __insert_at(x, i, std::forward<Args>(args)...);
+    }
+    return emplace_unique_key(k, std::forward<Args>(args)...).first;
+}
+
+/*
+ *  puts a new value at slot position of leaf x. unless it goes after
+ *  the last value with nothing to split off, values move to make room,
+ *  and an argument may be one of them (m.try_emplace(k, m.find(j)->second)),
+ *  so the value is built first and moved into place.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+template <class... Args>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::__insert_at(leaf_ptr x, int position, Args&&... args) {
+    if (position == x->count && (x->count < leaf_slots || x == rightmost))
+        return __place_at(x, position, std::forward<Args>(args)...);
+    value_type tmp(std::forward<Args>(args)...);
+    return __place_at(x, position, std::move(tmp));
+}
+
+/*
+ *  the move and split of __insert_at, args no longer in the tree. x is
+ *  split if it is full. an append to the last leaf moves nothing to the
+ *  new leaf, so loading in key order leaves every leaf full; any other
+ *  split halves the leaf.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+template <class... Args>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::__place_at(leaf_ptr x, int position, Args&&... args) {
+    if (x->count < leaf_slots) {
+        value_type *v = x->values();
+        __relocate_backward(v + position + 1, v + position, x->count - position);
+        construct(v + position, std::forward<Args>(args)...);
+        ++x->count;
+        ++node_count;
+        return iterator(x, position);
+    }
+
+    int split = (x == rightmost && position == x->count) ? (int)leaf_slots : (int)(leaf_slots + 1) / 2;
+    leaf_ptr y = create_leaf();
+    __relocate_forward(y->values(), x->values() + split, x->count - split);
+    y->count = (unsigned short)(x->count - split);
+    x->count = (unsigned short)split;
+
+    y->next = x->next;
+    y->prev = x;
+    if (x->next) x->next->prev = y;
+    x->next = y;
+    if (rightmost == x) rightmost = y;
+
+    leaf_ptr target = x;
+    if (position > split || (position == split && split == leaf_slots)) {
+        target = y;
+        position -= split;
+    }
+
+    value_type *v = target->values();
+    __relocate_backward(v + position + 1, v + position, target->count - position);
+    construct(v + position, std::forward<Args>(args)...);
+    ++target->count;
+    ++node_count;
+
+    __insert_into_parent(x, key(y->values()[0]), y);
+    return iterator(target, position);
+}
+
+/*
+ *  right has just been split off left, with k the first key in right.
+ *  a full parent splits in turn, its middle key going one level up.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::
+__insert_into_parent(base_ptr left, const key_type &k, base_ptr right) {
+    if (left->parent == 0) {
+        internal_ptr r = create_internal();
+        construct(r->keys(), k);
+        r->count = 1;
+        set_child(r, 0, left);
+        set_child(r, 1, right);
+        root = r;
+        return;
+    }
+
+    internal_ptr p = (internal_ptr)left->parent;
+    int i = left->position;
+    if (p->count < internal_slots) {
+        key_type *keys = p->keys();
+        __relocate_backward(keys + i + 1, keys + i, p->count - i);
+        construct(keys + i, k);
+        for (int j = p->count; j > i; --j)
+            set_child(p, j + 1, p->children[j]);
+        set_child(p, i + 1, right);
+        ++p->count;
+        return;
+    }
+
+    // p keeps keys [0, mid), q takes (mid, count), keys[mid] goes up
+    int mid = internal_slots / 2;
+    internal_ptr q = create_internal();
+    key_type *keys = p->keys();
+    __relocate_forward(q->keys(), keys + mid + 1, p->count - mid - 1);
+    for (int j = mid + 1; j <= p->count; ++j)
+        set_child(q, j - mid - 1, p->children[j]);
+    q->count = (unsigned short)(p->count - mid - 1);
+    p->count = (unsigned short)mid;
+    key_type up(std::move(keys[mid]));
+    destroy(keys + mid);
+
+    internal_ptr target = p;
+    if (i > mid) {
+        target = q;
+        i -= mid + 1;
+    }
+    key_type *tk = target->keys();
+    __relocate_backward(tk + i + 1, tk + i, target->count - i);
+    construct(tk + i, k);
+    for (int j = target->count; j > i; --j)
+        set_child(target, j + 1, target->children[j]);
+    set_child(target, i + 1, right);
+    ++target->count;
+
+    __insert_into_parent(p, up, q);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::erase(iterator position) {
+    iterator next = position;
+    ++next;
+    if (next == end()) {
+        __erase_at(position.node, position.position);
+        return end();
+    }
+
+    // values may move between leaves, so find the next one again by key
+    key_type k(key(*next));
+    __erase_at(position.node, position.position);
+    return lower_bound(k);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::size_type
+btree<Key, Value, KeyOfValue, Compare, Alloc>::erase(const key_type &k) {
+    iterator it = find(k);
+    if (it == end())
+        return 0;
+    __erase_at(it.node, it.position);
+    return 1;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::erase(iterator first, iterator last) {
+    if (first == begin() && last == end()) {
+        clear();
+        return;
+    }
+    size_type n = 0;
+    distance(first, last, n);
+    while (n-- > 0)
+        first = erase(first);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__erase_at(leaf_ptr x, int position) {
+    value_type *v = x->values();
+    destroy(v + position);
+    __relocate_forward(v + position, v + position + 1, x->count - position - 1);
+    --x->count;
+    --node_count;
+
+    if (x == root) {
+        if (x->count == 0) {
+            destroy_leaf(x);
+            root = leftmost = rightmost = 0;
+        }
+        return;
+    }
+    if (x->count < min_leaf)
+        __rebalance_leaf(x);
+}
+
+/*
+ *  x has too few values: take one from a sibling that can spare it,
+ *  otherwise merge with a sibling, which takes a key out of the parent.
+ *  separators are only ever bounds, so erasing never has to fix them.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__rebalance_leaf(leaf_ptr x) {
+    internal_ptr p = (internal_ptr)x->parent;
+    int i = x->position;
+    leaf_ptr l = i > 0 ? (leaf_ptr)p->children[i - 1] : 0;
+    leaf_ptr r = i < p->count ? (leaf_ptr)p->children[i + 1] : 0;
+
+    if (l && l->count > min_leaf) {
+        value_type *v = x->values();
+        __relocate_backward(v + 1, v, x->count);
+        __relocate_forward(v, l->values() + l->count - 1, 1);
+        --l->count;
+        ++x->count;
+        p->keys()[i - 1] = key(v[0]);
+        return;
+    }
+    if (r && r->count > min_leaf) {
+        value_type *rv = r->values();
+        __relocate_forward(x->values() + x->count, rv, 1);
+        __relocate_forward(rv, rv + 1, r->count - 1);
+        --r->count;
+        ++x->count;
+        p->keys()[i] = key(rv[0]);
+        return;
+    }
+
+    // merge right into left, drop the separator between them
+    if (l == 0) {
+        l = x;
+        ++i;
+    }
+    else
+        r = x;
+    __relocate_forward(l->values() + l->count, r->values(), r->count);
+    l->count = (unsigned short)(l->count + r->count);
+    r->count = 0;
+    l->next = r->next;
+    if (r->next) r->next->prev = l;
+    if (rightmost == r) rightmost = l;
+    destroy_leaf(r);
+
+    key_type *keys = p->keys();
+    destroy(keys + i - 1);
+    __relocate_forward(keys + i - 1, keys + i, p->count - i);
+    for (int j = i + 1; j <= p->count; ++j)
+        set_child(p, j - 1, p->children[j]);
+    --p->count;
+    __rebalance_internal(p);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__rebalance_internal(internal_ptr x) {
+    if (x == root) {
+        if (x->count == 0) {
+            root = x->children[0];
+            root->parent = 0;
+            root->position = 0;
+            destroy_internal(x);
+        }
+        return;
+    }
+    if (x->count >= min_internal)
+        return;
+
+    internal_ptr p = (internal_ptr)x->parent;
+    int i = x->position;
+    internal_ptr l = i > 0 ? (internal_ptr)p->children[i - 1] : 0;
+    internal_ptr r = i < p->count ? (internal_ptr)p->children[i + 1] : 0;
+
+    if (l && l->count > min_internal) {
+        // rotate right through the parent
+        key_type *keys = x->keys();
+        __relocate_backward(keys + 1, keys, x->count);
+        construct(keys, std::move(p->keys()[i - 1]));
+        for (int j = x->count; j >= 0; --j)
+            set_child(x, j + 1, x->children[j]);
+        set_child(x, 0, l->children[l->count]);
+        p->keys()[i - 1] = std::move(l->keys()[l->count - 1]);
+        destroy(l->keys() + l->count - 1);
+        --l->count;
+        ++x->count;
+        return;
+    }
+    if (r && r->count > min_internal) {
+        // rotate left through the parent
+        construct(x->keys() + x->count, std::move(p->keys()[i]));
+        set_child(x, x->count + 1, r->children[0]);
+        p->keys()[i] = std::move(r->keys()[0]);
+        destroy(r->keys());
+        __relocate_forward(r->keys(), r->keys() + 1, r->count - 1);
+        for (int j = 1; j <= r->count; ++j)
+            set_child(r, j - 1, r->children[j]);
+        --r->count;
+        ++x->count;
+        return;
+    }
+
+    // merge: left, the separator, right
+    if (l == 0) {
+        l = x;
+        ++i;
+    }
+    else
+        r = x;
+    key_type *keys = p->keys();
+    construct(l->keys() + l->count, std::move(keys[i - 1]));
+    __relocate_forward(l->keys() + l->count + 1, r->keys(), r->count);
+    for (int j = 0; j <= r->count; ++j)
+        set_child(l, l->count + 1 + j, r->children[j]);
+    l->count = (unsigned short)(l->count + 1 + r->count);
+    r->count = 0;
+    destroy_internal(r);
+
+    destroy(keys + i - 1);
+    __relocate_forward(keys + i - 1, keys + i, p->count - i);
+    for (int j = i + 1; j <= p->count; ++j)
+        set_child(p, j - 1, p->children[j]);
+    --p->count;
+    __rebalance_internal(p);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__erase(base_ptr x) {
+    if (x->leaf) {
+        destroy_leaf((leaf_ptr)x);
+        return;
+    }
+    internal_ptr p = (internal_ptr)x;
+    for (int i = 0; i <= p->count; ++i)
+        __erase(p->children[i]);
+    destroy_internal(p);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::clear() {
+    if (root != 0) {
+        __erase(root);
+        root = leftmost = rightmost = 0;
+        node_count = 0;
+    }
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::find(const key_type &k) {
+    if (root == 0)
+        return end();
+    leaf_ptr x = find_leaf(k);
+    int i = value_search::lower(x->values(), x->count, k, key_compare);
+    if (i < x->count && !key_compare(k, key(x->values()[i])))
+        return iterator(x, i);
+    return end();
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::lower_bound(const key_type &k) {
+    if (root == 0)
+        return end();
+    leaf_ptr x = find_leaf(k);
+    return normalize(x, value_search::lower(x->values(), x->count, k, key_compare));
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::upper_bound(const key_type &k) {
+    if (root == 0)
+        return end();
+    leaf_ptr x = find_leaf(k);
+    return normalize(x, value_search::upper(x->values(), x->count, k, key_compare));
+}
+
+
+/*
+ *  map's interface over btree.
+ */
+template <class Key, class T, class Compare = std::less<Key>, class Alloc = alloc>
+class btree_map {
+public:
+    typedef Key key_type;
+    typedef T data_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef Compare key_compare;
+
+    class value_compare {
+        friend class btree_map<Key, T, Compare, Alloc>;
+
+    protected:
+        Compare comp;
+        value_compare(Compare c) : comp(c) {    }
+
+    public:
+        typedef value_type first_argument_type;
+        typedef value_type second_argument_type;
+        typedef bool result_type;
+
+        bool operator()(const value_type &x, const value_type &y) const {
+            return comp(x.first, y.first);
+        }
+    };
+
+private:
+    typedef btree<key_type, value_type, select1st<value_type>, key_compare, Alloc> rep_type;
+    rep_type t;
+
+public:
+    typedef typename rep_type::pointer pointer;
+    typedef typename rep_type::const_pointer const_pointer;
+    typedef typename rep_type::reference reference;
+    typedef typename rep_type::const_reference const_reference;
+    typedef typename rep_type::iterator iterator;
+    typedef typename rep_type::const_iterator const_iterator;
+    typedef typename rep_type::reverse_iterator reverse_iterator;
+    typedef typename rep_type::const_reverse_iterator const_reverse_iterator;
+    typedef typename rep_type::size_type size_type;
+    typedef typename rep_type::difference_type difference_type;
+
+    btree_map() : t(Compare()) {  }
+    explicit btree_map(const Compare &comp) : t(comp) {   }
+
+    template <class InputIterator>
+    btree_map(InputIterator first, InputIterator last)
+            : t(Compare()) { t.insert_unique(first, last);  }
+
+    template <class InputIterator>
+    btree_map(InputIterator first, InputIterator last, const Compare &comp)
+            : t(comp) { t.insert_unique(first, last);   }
+
+    template <class InputIterator>
+    btree_map(sorted_unique_t, InputIterator first, InputIterator last,
+              const Compare &comp = Compare())
+            : t(comp) { t.assign_sorted(first, last);   }
+
+    btree_map(const btree_map<Key, T, Compare, Alloc> &x) : t(x.t) {  }
+    btree_map(btree_map<Key, T, Compare, Alloc> &&x) : t(std::move(x.t)) {  }
+
+    btree_map<Key, T, Compare, Alloc> &operator=(const btree_map<Key, T, Compare, Alloc> &x) {
+        t = x.t;
+        return *this;
+    }
+
+    btree_map<Key, T, Compare, Alloc> &operator=(btree_map<Key, T, Compare, Alloc> &&x) {
+        t = std::move(x.t);
+        return *this;
+    }
+
+public:
+    key_compare key_comp() const { return t.key_comp();  }
+    value_compare value_comp() const { return value_compare(t.key_comp());  }
+    iterator begin() { return t.begin();    }
+    const_iterator begin() const { return t.begin();    }
+    iterator end() { return t.end();    }
+    const_iterator end() const { return t.end();    }
+    reverse_iterator rbegin() { return t.rbegin();  }
+    const_reverse_iterator rbegin() const { return t.rbegin();  }
+    reverse_iterator rend() { return t.rend();  }
+    const_reverse_iterator rend() const { return t.rend();  }
+    bool empty() const { return t.empty();  }
+    size_type size() const { return t.size();   }
+    size_type max_size() const { return t.max_size();   }
+
+    T &operator[](const key_type &k) {
+        return (*(try_emplace(k).first)).second;
+    }
+
+    T &operator[](key_type &&k) {
+        return (*(try_emplace(std::move(k)).first)).second;
+    }
+
+    void swap(btree_map<Key, T, Compare, Alloc> &x) { t.swap(x.t);   }
+
+public:
+    std::pair<iterator, bool> insert(const value_type &x) {
+        return t.insert_unique(x);
+    }
+
+    std::pair<iterator, bool> insert(value_type &&x) {
+        return t.insert_unique(std::move(x));
+    }
+
+    iterator insert(iterator position, const value_type &x) {
+        return t.insert_unique(position, x);
+    }
+
+    iterator insert(iterator position, value_type &&x) {
+        return t.insert_unique(position, std::move(x));
+    }
+
+    template <class InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        t.insert_unique(first, last);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        return t.emplace_unique(std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    iterator emplace_hint(iterator position, Args&&... args) {
+        return t.emplace_hint_unique(position, std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const key_type &k, Args&&... args) {
+        return t.emplace_unique_key(k, std::piecewise_construct,
+                                    std::forward_as_tuple(k),
+                                    std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(key_type &&k, Args&&... args) {
+        return t.emplace_unique_key(k, std::piecewise_construct,
+                                    std::forward_as_tuple(std::move(k)),
+                                    std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    /*
+     *  erase(position) returns the next iterator, since all the others
+     *  are invalidated.
+     */
+    iterator erase(iterator position) { return t.erase(position);   }
+    size_type erase(const key_type &x) { return t.erase(x);    }
+    void erase(iterator first, iterator last) { t.erase(first, last);   }
+    void clear() { t.clear();   }
+
+public:
+    iterator find(const key_type &x) { return t.find(x);   }
+    const_iterator find(const key_type &x) const { return t.find(x);   }
+    size_type count(const key_type &x) const { return t.count(x);  }
+    iterator lower_bound(const key_type &x) { return t.lower_bound(x); }
+    const_iterator lower_bound(const key_type &x) const { return t.lower_bound(x); }
+    iterator upper_bound(const key_type &x) { return t.upper_bound(x); }
+    const_iterator upper_bound(const key_type &x) const { return t.upper_bound(x); }
+    std::pair<iterator, iterator> equal_range(const key_type &x) {
+        return t.equal_range(x);
+    }
+    std::pair<const_iterator, const_iterator> equal_range(const key_type &x) const {
+        return t.equal_range(x);
+    }
+
+};
+
+
+#endif //LIST_BTREE_MAP_H
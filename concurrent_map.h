@@ -0,0 +1,350 @@
+#ifndef LIST_CONCURRENT_MAP_H
+#define LIST_CONCURRENT_MAP_H
+
+/*
+ *  a read-mostly ordered map for many reader threads and one writer at a
+ *  time.
+ *
+ *  the map is a persistent_map. every change builds a new version of it
+ *  by path copying, O(log n) new nodes, and publishes that version
+ *  through one atomic pointer. readers load the pointer and search the
+ *  version they got. nothing they can see is ever changed, so a reader
+ *  takes no lock, loops on no compare-and-swap, and writes nothing but
+ *  its own epoch slot: lookups are wait-free.
+ *
+ *  the versions a writer replaces are retired rather than freed. they
+ *  are dropped, and the nodes only they held handed back to the node
+ *  allocator, once every reader that could still be inside one has
+ *  left: epoch based reclamation, see __epoch_template below.
+ */
+
+#include "persistent_map.h"
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <stdexcept>
+
+
+/*
+ *  epochs. a global counter is bumped each time something is retired,
+ *  and every reading thread owns one slot on its own cache line. to
+ *  read, a thread writes the current epoch into its slot; leaving, it
+ *  writes 0 back. something retired while the counter stood at r can
+ *  be freed as soon as every slot is 0 or greater than r: a reader that
+ *  entered later saw the counter move past r, and so also the pointer
+ *  store that came before the move.
+ *
+ *  threads take a slot on their first read and give it back when they
+ *  exit. guards nest, only the outermost one touches the slot. like
+ *  the pool allocator, the state is static and inst keeps independent
+ *  users apart.
+ */
+enum { __epoch_max_threads = 256 };
+
+/*
+ *  writers look for versions to free once this many have been retired,
+ *  rather than scanning the epoch slots on every write.
+ */
+enum { __epoch_reclaim_batch = 32 };
+
+template <int inst>
+class __epoch_template {
+private:
+    struct slot {
+        std::atomic<uint64_t> epoch;    // 0 while the thread is not reading
+        std::atomic<bool> used;
+        char pad[64 - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<bool>)];
+    };
+
+    struct registration {
+        slot *s;
+        unsigned depth;
+
+        registration() : s(0), depth(0) {  }
+        ~registration() {
+            if (s != 0)
+                s->used.store(false, std::memory_order_release);
+        }
+    };
+
+    static std::atomic<uint64_t> global;
+    static slot slots[__epoch_max_threads];
+    static std::atomic<int> high;       // slots ever claimed, the scan stops there
+    static thread_local registration self;
+
+    static slot *claim() {
+        for (int i = 0; i < __epoch_max_threads; ++i) {
+            bool expected = false;
+            if (!slots[i].used.load(std::memory_order_relaxed) &&
+                slots[i].used.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                int h = high.load();
+                while (h < i + 1 && !high.compare_exchange_weak(h, i + 1))
+                    ;
+                return slots + i;
+            }
+        }
+        throw std::runtime_error("__epoch: too many reading threads");
+    }
+
+public:
+    /*
+     *  readers hold one while they look at anything published.
+     */
+    class guard {
+    public:
+        guard() {
+            registration &r = self;
+            if (r.depth == 0) {
+                if (r.s == 0)
+                    r.s = claim();      // may throw, depth is still 0
+                r.s->epoch.store(global.load(), std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+            ++r.depth;
+        }
+        ~guard() {
+            registration &r = self;
+            if (--r.depth == 0)
+                r.s->epoch.store(0, std::memory_order_release);
+        }
+        guard(const guard&) = delete;
+        guard &operator=(const guard&) = delete;
+    };
+
+    /*
+     *  called by the writer right after it has published the
+     *  replacement: the epoch to retire the old object in.
+     */
+    static uint64_t retire() {  return global.fetch_add(1);  }
+
+    /*
+     *  objects retired in epochs below this can be freed.
+     */
+    static uint64_t safe() {
+        uint64_t least = global.load();
+        int h = high.load();
+        for (int i = 0; i < h; ++i) {
+            uint64_t e = slots[i].epoch.load();
+            if (e != 0 && e < least)
+                least = e;
+        }
+        return least;
+    }
+};
+
+template <int inst>
+std::atomic<uint64_t> __epoch_template<inst>::global(1);
+
+template <int inst>
+typename __epoch_template<inst>::slot __epoch_template<inst>::slots[__epoch_max_threads];
+
+template <int inst>
+std::atomic<int> __epoch_template<inst>::high(0);
+
+template <int inst>
+thread_local typename __epoch_template<inst>::registration __epoch_template<inst>::self;
+
+typedef __epoch_template<0> epoch;
+
+
+template <class Key, class T, class Compare = std::less<Key>, class Alloc = alloc>
+class concurrent_map {
+public:
+    typedef Key key_type;
+    typedef T data_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef Compare key_compare;
+    typedef size_t size_type;
+    typedef persistent_map<Key, T, Compare, Alloc> snapshot_type;
+
+private:
+    /*
+     *  a published version. it is allocated like the nodes, so the
+     *  retired ones go back through Alloc as well.
+     */
+    struct version {
+        snapshot_type map;
+        explicit version(const snapshot_type &m) : map(m) {  }
+    };
+    typedef simple_alloc<version, Alloc> version_allocator;
+
+    struct retired {
+        uint64_t epoch;
+        version *v;
+    };
+
+    std::atomic<version*> current;
+    std::mutex write_mutex;             // writers only
+    std::deque<retired> retired_list;   // oldest first, under write_mutex
+
+    static version *create_version(const snapshot_type &m) {
+        version *v = version_allocator::allocate();
+        try {
+            construct(v, m);
+        }
+        catch (...) {
+            version_allocator::deallocate(v);
+            throw;
+        }
+        return v;
+    }
+
+    static void destroy_version(version *v) {
+        destroy(v);
+        version_allocator::deallocate(v);
+    }
+
+    void __publish(const snapshot_type &m);
+    void __reclaim();
+
+public:
+    explicit concurrent_map(const Compare &comp = Compare())
+            : current(create_version(snapshot_type(comp))) {  }
+
+    /*
+     *  no reader or writer may be left.
+     */
+    ~concurrent_map() {
+        for (size_t i = 0; i < retired_list.size(); ++i)
+            destroy_version(retired_list[i].v);
+        destroy_version(current.load());
+    }
+
+    concurrent_map(const concurrent_map&) = delete;
+    concurrent_map &operator=(const concurrent_map&) = delete;
+
+public:
+    /*
+     *  readers, wait-free. each call sees one published version whole.
+     */
+    bool find(const key_type &k, T &out) const {
+        epoch::guard g;
+        const snapshot_type &m = current.load(std::memory_order_acquire)->map;
+        typename snapshot_type::const_iterator it = m.find(k);
+        if (it == m.end())
+            return false;
+        out = it->second;
+        return true;
+    }
+
+    size_type count(const key_type &k) const {
+        epoch::guard g;
+        return current.load(std::memory_order_acquire)->map.count(k);
+    }
+
+    /*
+     *  f(const value_type&) on the value with key k, if there is one. f
+     *  runs inside the read, so it should be short.
+     */
+    template <class Function>
+    bool visit(const key_type &k, Function f) const {
+        epoch::guard g;
+        const snapshot_type &m = current.load(std::memory_order_acquire)->map;
+        typename snapshot_type::const_iterator it = m.find(k);
+        if (it == m.end())
+            return false;
+        f(*it);
+        return true;
+    }
+
+    size_type size() const {
+        epoch::guard g;
+        return current.load(std::memory_order_acquire)->map.size();
+    }
+
+    bool empty() const { return size() == 0;    }
+
+    /*
+     *  the current version, to iterate or read at leisure. O(1), but
+     *  not wait-free like the others: it takes a reference on the root.
+     */
+    snapshot_type snapshot() const {
+        epoch::guard g;
+        return current.load(std::memory_order_acquire)->map;
+    }
+
+public:
+    /*
+     *  writers. each one publishes a new version; update(f) runs f on a
+     *  private copy of the map and publishes once for all its changes.
+     */
+    bool insert(const value_type &x) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        snapshot_type m = current.load(std::memory_order_relaxed)->map;
+        if (!m.insert(x))
+            return false;
+        __publish(m);
+        return true;
+    }
+
+    template <class M>
+    bool insert_or_assign(const key_type &k, M &&obj) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        snapshot_type m = current.load(std::memory_order_relaxed)->map;
+        bool inserted = m.insert_or_assign(k, std::forward<M>(obj));
+        __publish(m);
+        return inserted;
+    }
+
+    size_type erase(const key_type &k) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        snapshot_type m = current.load(std::memory_order_relaxed)->map;
+        size_type n = m.erase(k);
+        if (n != 0)
+            __publish(m);
+        return n;
+    }
+
+    template <class Function>
+    void update(Function f) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        snapshot_type m = current.load(std::memory_order_relaxed)->map;
+        f(m);
+        __publish(m);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        __publish(snapshot_type(current.load(std::memory_order_relaxed)->map.key_comp()));
+    }
+
+    /*
+     *  frees what no reader can reach any more. writers do it on their
+     *  own, call it to release memory after the last write.
+     */
+    void reclaim() {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        __reclaim();
+    }
+};
+
+/*
+ *  m shares its untouched subtrees with the version it was copied from,
+ *  and that version's own path nodes go when it is dropped.
+ */
+template <class Key, class T, class Compare, class Alloc>
+void concurrent_map<Key, T, Compare, Alloc>::__publish(const snapshot_type &m) {
+    version *v = create_version(m);
+    version *old = current.exchange(v);
+    retired r;
+    r.epoch = epoch::retire();
+    r.v = old;
+    retired_list.push_back(r);
+    if (retired_list.size() >= __epoch_reclaim_batch)
+        __reclaim();
+}
+
+template <class Key, class T, class Compare, class Alloc>
+void concurrent_map<Key, T, Compare, Alloc>::__reclaim() {
+    if (retired_list.empty())
+        return;
+    uint64_t safe = epoch::safe();
+    while (!retired_list.empty() && retired_list.front().epoch < safe) {
+        destroy_version(retired_list.front().v);
+        retired_list.pop_front();
+    }
+}
+
+
+#endif //LIST_CONCURRENT_MAP_H
@@ -0,0 +1,329 @@
+#ifndef LIST_EYTZINGER_H
+#define LIST_EYTZINGER_H
+
+/*
+ *  a read-only snapshot of a finished rb_tree (or map), laid out in
+ *  eytzinger order: the tree is stored breadth first in an array, the
+ *  root at 1 and the children of i at 2i and 2i + 1, so no pointers are
+ *  kept at all.
+ *
+ *  a lookup is then a loop of i = 2i + (key[i] < k): the compare picks
+ *  the next index rather than a branch, and since the descendants of i
+ *  four levels down sit next to each other at 16i, they are prefetched
+ *  a whole cache line at a time, long before they are needed. keys are
+ *  kept in their own array so a probe touches nothing else.
+ *
+ *  the snapshot is built in O(n) from an in-order walk of the tree and
+ *  never changes afterwards; it does not follow later changes of the
+ *  tree it was taken from.
+ */
+
+#include "map.h"
+#include <algorithm>
+#include <stdexcept>
+
+/*
+ *  walking the implicit tree of n nodes in order. 0 stands for end(),
+ *  as no node lives there.
+ */
+inline size_t __eytzinger_first(size_t n) {
+    size_t i = n ? 1 : 0;
+    if (i)
+        while (2 * i <= n) i = 2 * i;
+    return i;
+}
+
+inline size_t __eytzinger_last(size_t n) {
+    size_t i = n ? 1 : 0;
+    if (i)
+        while (2 * i + 1 <= n) i = 2 * i + 1;
+    return i;
+}
+
+inline size_t __eytzinger_next(size_t i, size_t n) {
+    if (2 * i + 1 <= n) {
+        i = 2 * i + 1;
+        while (2 * i <= n) i = 2 * i;
+        return i;
+    }
+    while (i & 1) i >>= 1;      // climb while we are a right child
+    return i >> 1;
+}
+
+inline size_t __eytzinger_prev(size_t i, size_t n) {
+    if (i == 0)
+        return __eytzinger_last(n);
+    if (2 * i <= n) {
+        i = 2 * i;
+        while (2 * i + 1 <= n) i = 2 * i + 1;
+        return i;
+    }
+    while (i > 1 && !(i & 1)) i >>= 1;  // climb while we are a left child
+    return i >> 1;
+}
+
+/*
+ *  the search loop ends below a leaf, having recorded every turn in
+ *  the bits of i: 1 for right, 0 for left. the answer is the node
+ *  where we last went left, found by dropping the trailing right turns
+ *  and that left turn. all right turns means end(), 0.
+ */
+inline size_t __eytzinger_answer(size_t i) {
+    return i >> (__builtin_ctzl(~i) + 1);
+}
+
+
+template <class Value, class Ref, class Ptr>
+struct __eytzinger_iterator {
+    typedef bidirectional_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef Ref reference;
+    typedef Ptr pointer;
+    typedef ptrdiff_t difference_type;
+    typedef __eytzinger_iterator<Value, Ref, Ptr> self;
+
+    Ptr values;     // the snapshot's array, 1-based
+    size_t index;
+    size_t n;
+
+    __eytzinger_iterator() : values(0), index(0), n(0) {  }
+    __eytzinger_iterator(Ptr v, size_t i, size_t n) : values(v), index(i), n(n) {  }
+
+    reference operator*() const { return values[index];  }
+    pointer operator->() const { return &(operator*());  }
+
+    bool operator==(const self &x) const { return index == x.index;    }
+    bool operator!=(const self &x) const { return index != x.index;    }
+
+    self &operator++() {    index = __eytzinger_next(index, n); return *this;   }
+    self operator++(int) {  self tmp = *this; ++*this; return tmp;  }
+    self &operator--() {    index = __eytzinger_prev(index, n); return *this;   }
+    self operator--(int) {  self tmp = *this; --*this; return tmp;  }
+};
+
+
+template <class Key, class Value, class KeyOfValue, class Compare = std::less<Key>, class Alloc = alloc>
+class eytzinger_tree {
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef const value_type *pointer;
+    typedef const value_type *const_pointer;
+    typedef const value_type &reference;
+    typedef const value_type &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef __eytzinger_iterator<Value, const Value&, const Value*> const_iterator;
+    typedef const_iterator iterator;        // a snapshot is never written to
+
+protected:
+    typedef simple_alloc<Key, Alloc> key_allocator;
+    typedef simple_alloc<Value, Alloc> value_allocator;
+
+    /*
+     *  how far ahead the search prefetches: the 16 descendants of i four
+     *  levels down start at 16i, and for small keys all of them share a
+     *  cache line or two.
+     */
+    enum { prefetch_stride = 16 };
+
+    Key *keys;          // 1-based, keys[0] unused
+    Value *values;      // 1-based, in the same order as keys
+    size_type node_count;
+    Compare key_compare;
+
+public:
+    eytzinger_tree() : keys(0), values(0), node_count(0) {  }
+
+    /*
+     *  freeze x. its iterators are walked once, in order, through
+     *  __rb_tree_base_iterator::increment.
+     */
+    template <class A, class N>
+    explicit eytzinger_tree(const rb_tree<Key, Value, KeyOfValue, Compare, A, N> &x)
+            : keys(0), values(0), node_count(0), key_compare(x.key_comp()) {
+        __build(x.begin(), x.size());
+    }
+
+    /*
+     *  [first, first + n) must be sorted by comp.
+     */
+    template <class InputIterator>
+    eytzinger_tree(InputIterator first, size_type n, const Compare &comp = Compare())
+            : keys(0), values(0), node_count(0), key_compare(comp) {
+        __build(first, n);
+    }
+
+    eytzinger_tree(const eytzinger_tree &x)
+            : keys(0), values(0), node_count(0), key_compare(x.key_compare) {
+        __build(x.begin(), x.size());
+    }
+
+    eytzinger_tree(eytzinger_tree &&x)
+            : keys(0), values(0), node_count(0), key_compare(x.key_compare) {
+        swap(x);
+    }
+
+    ~eytzinger_tree() { __destroy();  }
+
+    eytzinger_tree &operator=(eytzinger_tree x) {
+        swap(x);
+        return *this;
+    }
+
+    void swap(eytzinger_tree &x) {
+        std::swap(keys, x.keys);
+        std::swap(values, x.values);
+        std::swap(node_count, x.node_count);
+        std::swap(key_compare, x.key_compare);
+    }
+
+public:
+    Compare key_comp() const { return key_compare;  }
+    const_iterator begin() const {
+        return const_iterator(values, __eytzinger_first(node_count), node_count);
+    }
+    const_iterator end() const { return const_iterator(values, 0, node_count);  }
+    bool empty() const { return node_count == 0;    }
+    size_type size() const { return node_count; }
+
+    const_iterator find(const key_type &k) const {
+        size_type i = __lower_bound(k);
+        return (i == 0 || key_compare(k, keys[i])) ? end() : __iterator(i);
+    }
+
+    size_type count(const key_type &k) const {
+        size_type n = 0;
+        for (const_iterator first = lower_bound(k), last = upper_bound(k);
+             first != last; ++first)
+            ++n;
+        return n;
+    }
+
+    const_iterator lower_bound(const key_type &k) const { return __iterator(__lower_bound(k));   }
+    const_iterator upper_bound(const key_type &k) const { return __iterator(__upper_bound(k));   }
+
+    std::pair<const_iterator, const_iterator> equal_range(const key_type &k) const {
+        return std::pair<const_iterator, const_iterator>(lower_bound(k), upper_bound(k));
+    }
+
+protected:
+    const_iterator __iterator(size_type i) const { return const_iterator(values, i, node_count);   }
+
+    /*
+     *  the prefetch address is clamped rather than tested, so the loop
+     *  keeps no branch but its own condition.
+     */
+    size_type __lower_bound(const key_type &k) const {
+        size_type i = 1;
+        while (i <= node_count) {
+            __builtin_prefetch(keys + std::min<size_type>(prefetch_stride * i, node_count));
+            i = 2 * i + key_compare(keys[i], k);
+        }
+        return __eytzinger_answer(i);
+    }
+
+    size_type __upper_bound(const key_type &k) const {
+        size_type i = 1;
+        while (i <= node_count) {
+            __builtin_prefetch(keys + std::min<size_type>(prefetch_stride * i, node_count));
+            i = 2 * i + !key_compare(k, keys[i]);
+        }
+        return __eytzinger_answer(i);
+    }
+
+    /*
+     *  visiting the slots of the implicit tree in order and handing each
+     *  the next value of the sorted input: O(n), as every edge is walked
+     *  twice at most.
+     */
+    template <class InputIterator>
+    void __build(InputIterator first, size_type n) {
+        if (n == 0) return;
+        keys = key_allocator::allocate(n + 1);
+        __STL_TRY {
+            values = value_allocator::allocate(n + 1);
+        }
+        __STL_UNWIND(key_allocator::deallocate(keys, n + 1));
+        for (size_type i = __eytzinger_first(n); i != 0; i = __eytzinger_next(i, n), ++first) {
+            construct(values + i, *first);
+            construct(keys + i, KeyOfValue()(values[i]));
+            ++node_count;
+        }
+    }
+
+    void __destroy() {
+        if (node_count == 0) return;
+        for (size_type i = 1; i <= node_count; ++i) {
+            destroy(keys + i);
+            destroy(values + i);
+        }
+        key_allocator::deallocate(keys, node_count + 1);
+        value_allocator::deallocate(values, node_count + 1);
+    }
+};
+
+
+/*
+ *  the frozen counterpart of map, with the read-only half of its
+ *  interface.
+ */
+template <class Key, class T, class Compare = std::less<Key>, class Alloc = alloc>
+class frozen_map {
+public:
+    typedef Key key_type;
+    typedef T data_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef Compare key_compare;
+
+private:
+    typedef eytzinger_tree<key_type, value_type, select1st<value_type>, key_compare, Alloc> rep_type;
+    rep_type t;
+
+public:
+    typedef typename rep_type::pointer pointer;
+    typedef typename rep_type::const_pointer const_pointer;
+    typedef typename rep_type::reference reference;
+    typedef typename rep_type::const_reference const_reference;
+    typedef typename rep_type::iterator iterator;
+    typedef typename rep_type::const_iterator const_iterator;
+    typedef typename rep_type::size_type size_type;
+    typedef typename rep_type::difference_type difference_type;
+
+    frozen_map() {  }
+
+    template <class A, class N>
+    explicit frozen_map(const map<Key, T, Compare, A, N> &x)
+            : t(x.begin(), x.size(), x.key_comp()) {  }
+
+    void swap(frozen_map<Key, T, Compare, Alloc> &x) { t.swap(x.t);   }
+
+public:
+    key_compare key_comp() const { return t.key_comp();  }
+    const_iterator begin() const { return t.begin();    }
+    const_iterator end() const { return t.end();    }
+    bool empty() const { return t.empty();  }
+    size_type size() const { return t.size();   }
+
+    /*
+     *  there is no operator[] to insert with, so a missing key throws.
+     */
+    const T &at(const key_type &k) const {
+        const_iterator it = t.find(k);
+        if (it == t.end())
+            throw std::out_of_range("frozen_map::at");
+        return it->second;
+    }
+
+    const_iterator find(const key_type &x) const { return t.find(x);   }
+    size_type count(const key_type &x) const { return t.count(x);  }
+    const_iterator lower_bound(const key_type &x) const { return t.lower_bound(x); }
+    const_iterator upper_bound(const key_type &x) const { return t.upper_bound(x); }
+    std::pair<const_iterator, const_iterator> equal_range(const key_type &x) const {
+        return t.equal_range(x);
+    }
+};
+
+
+#endif //LIST_EYTZINGER_H
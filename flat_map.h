@@ -0,0 +1,462 @@
+#ifndef LIST_FLAT_MAP_H
+#define LIST_FLAT_MAP_H
+
+/*
+ *  map's interface over two sorted arrays, one of keys and one of mapped
+ *  values, for tables that are built once and then only read.
+ *
+ *  lookups run __sorted_search over the key array alone, so a probe
+ *  touches nothing but keys, and for arithmetic keys it is branchless
+ *  and prefetching. inserting one value shifts everything after it,
+ *  O(n); insert(first, last) stages the whole range, sorts it and
+ *  merges it with the arrays in a single pass instead.
+ *
+ *  keys and values are not stored as pairs, so *it is a
+ *  std::pair<const Key&, T&> built on the fly, and it->second works
+ *  through a proxy. any insert or erase invalidates iterators.
+ */
+
+#include "map.h"
+#include "search.h"
+#include <algorithm>
+#include <vector>
+
+template <class Reference>
+struct __flat_map_arrow {
+    Reference ref;
+
+    const Reference *operator->() const { return &ref;  }
+};
+
+template <class Key, class T, class Ref, class Ptr>
+struct __flat_map_iterator {
+    typedef random_access_iterator_tag iterator_category;
+    typedef std::pair<const Key, T> value_type;
+    typedef std::pair<const Key&, Ref> reference;
+    typedef __flat_map_arrow<reference> pointer;
+    typedef ptrdiff_t difference_type;
+    typedef __flat_map_iterator<Key, T, T&, T*> iterator;
+    typedef __flat_map_iterator<Key, T, Ref, Ptr> self;
+
+    const Key *key;
+    Ptr value;
+
+    __flat_map_iterator() : key(0), value(0) {   }
+    __flat_map_iterator(const Key *k, Ptr v) : key(k), value(v) {  }
+    __flat_map_iterator(const iterator &it) : key(it.key), value(it.value) {  }
+
+    reference operator*() const { return reference(*key, *value);  }
+    pointer operator->() const { pointer p = { operator*() }; return p;  }
+    reference operator[](difference_type n) const { return *(*this + n);  }
+
+    bool operator==(const self &x) const { return key == x.key;    }
+    bool operator!=(const self &x) const { return key != x.key;    }
+    bool operator<(const self &x) const { return key < x.key;  }
+    bool operator>(const self &x) const { return key > x.key;  }
+    bool operator<=(const self &x) const { return key <= x.key;    }
+    bool operator>=(const self &x) const { return key >= x.key;    }
+
+    self &operator++() {    ++key; ++value; return *this;   }
+    self operator++(int) {  self tmp = *this; ++*this; return tmp;  }
+    self &operator--() {    --key; --value; return *this;   }
+    self operator--(int) {  self tmp = *this; --*this; return tmp;  }
+
+    self &operator+=(difference_type n) {   key += n; value += n; return *this; }
+    self &operator-=(difference_type n) {   key -= n; value -= n; return *this; }
+    self operator+(difference_type n) const {   self tmp = *this; return tmp += n;  }
+    self operator-(difference_type n) const {   self tmp = *this; return tmp -= n;  }
+    difference_type operator-(const self &x) const {    return key - x.key; }
+};
+
+
+template <class Key, class T, class Compare = std::less<Key>, class Alloc = alloc>
+class flat_map {
+public:
+    typedef Key key_type;
+    typedef T data_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef Compare key_compare;
+
+    class value_compare {
+        friend class flat_map<Key, T, Compare, Alloc>;
+
+    protected:
+        Compare comp;
+        value_compare(Compare c) : comp(c) {    }
+
+    public:
+        typedef value_type first_argument_type;
+        typedef value_type second_argument_type;
+        typedef bool result_type;
+
+        bool operator()(const value_type &x, const value_type &y) const {
+            return comp(x.first, y.first);
+        }
+    };
+
+    typedef __flat_map_iterator<Key, T, T&, T*> iterator;
+    typedef __flat_map_iterator<Key, T, const T&, const T*> const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef typename iterator::reference reference;
+    typedef typename const_iterator::reference const_reference;
+    typedef typename iterator::pointer pointer;
+    typedef typename const_iterator::pointer const_pointer;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+private:
+    typedef simple_alloc<Key, Alloc> key_allocator;
+    typedef simple_alloc<T, Alloc> data_allocator;
+    typedef __sorted_search<Key, Compare> search;
+
+    Key *keys;
+    T *mapped;
+    size_type length;
+    size_type storage;
+    Compare compare;
+
+    void reallocate(size_type n);
+    template <class K, class... Args>
+    iterator __insert_at(size_type i, K &&k, Args&&... args);
+    void __merge_sorted(std::vector<std::pair<Key, T> > &staged);
+
+    size_type lower_index(const key_type &k) const {
+        return search::lower(keys, length, k, compare);
+    }
+
+    bool found_at(size_type i, const key_type &k) const {
+        return i < length && !compare(k, keys[i]);
+    }
+
+public:
+    flat_map() : keys(0), mapped(0), length(0), storage(0), compare(Compare()) {   }
+    explicit flat_map(const Compare &comp)
+            : keys(0), mapped(0), length(0), storage(0), compare(comp) {   }
+
+    template <class InputIterator>
+    flat_map(InputIterator first, InputIterator last, const Compare &comp = Compare())
+            : keys(0), mapped(0), length(0), storage(0), compare(comp) {
+        insert(first, last);
+    }
+
+    /*
+     *  [first, last) sorted by comp without duplicates: just copied in.
+     */
+    template <class InputIterator>
+    flat_map(sorted_unique_t, InputIterator first, InputIterator last,
+             const Compare &comp = Compare())
+            : keys(0), mapped(0), length(0), storage(0), compare(comp) {
+        for ( ; first != last; ++first)
+            __insert_at(length, (*first).first, (*first).second);
+    }
+
+    flat_map(const flat_map<Key, T, Compare, Alloc> &x)
+            : keys(0), mapped(0), length(0), storage(0), compare(x.compare) {
+        reallocate(x.length);
+        for (size_type i = 0; i < x.length; ++i)
+            __insert_at(i, x.keys[i], x.mapped[i]);
+    }
+
+    flat_map(flat_map<Key, T, Compare, Alloc> &&x)
+            : keys(0), mapped(0), length(0), storage(0), compare(x.compare) {
+        swap(x);
+    }
+
+    ~flat_map() {
+        clear();
+        key_allocator::deallocate(keys, storage);
+        data_allocator::deallocate(mapped, storage);
+    }
+
+    flat_map<Key, T, Compare, Alloc> &operator=(const flat_map<Key, T, Compare, Alloc> &x) {
+        if (this != &x) {
+            flat_map<Key, T, Compare, Alloc> tmp(x);
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    flat_map<Key, T, Compare, Alloc> &operator=(flat_map<Key, T, Compare, Alloc> &&x) {
+        if (this != &x) {
+            clear();
+            swap(x);
+        }
+        return *this;
+    }
+
+    void swap(flat_map<Key, T, Compare, Alloc> &x) {
+        std::swap(keys, x.keys);
+        std::swap(mapped, x.mapped);
+        std::swap(length, x.length);
+        std::swap(storage, x.storage);
+        std::swap(compare, x.compare);
+    }
+
+public:
+    key_compare key_comp() const { return compare;  }
+    value_compare value_comp() const { return value_compare(compare);  }
+    iterator begin() { return iterator(keys, mapped);   }
+    const_iterator begin() const { return const_iterator(keys, mapped);   }
+    iterator end() { return iterator(keys + length, mapped + length); }
+    const_iterator end() const { return const_iterator(keys + length, mapped + length); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+    bool empty() const { return length == 0;    }
+    size_type size() const { return length; }
+    size_type max_size() const { return size_type(-1) / (sizeof(Key) + sizeof(T));    }
+    size_type capacity() const { return storage;    }
+    void reserve(size_type n) { if (n > storage) reallocate(n);  }
+
+    /*
+     *  the arrays themselves, sorted by key.
+     */
+    const key_type *key_data() const { return keys; }
+    mapped_type *mapped_data() { return mapped; }
+    const mapped_type *mapped_data() const { return mapped; }
+
+    T &operator[](const key_type &k) {
+        return *(try_emplace(k).first.value);
+    }
+
+    T &operator[](key_type &&k) {
+        return *(try_emplace(std::move(k)).first.value);
+    }
+
+public:
+    std::pair<iterator, bool> insert(const value_type &x) {
+        return try_emplace(x.first, x.second);
+    }
+
+    std::pair<iterator, bool> insert(value_type &&x) {
+        return try_emplace(x.first, std::move(x.second));
+    }
+
+    /*
+     *  a hint right after the value's place inserts without a search.
+     */
+    iterator insert(iterator position, const value_type &x) {
+        return emplace_hint(position, x);
+    }
+
+    iterator insert(iterator position, value_type &&x) {
+        return emplace_hint(position, std::move(x));
+    }
+
+    template <class InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        std::vector<std::pair<Key, T> > staged;
+        for ( ; first != last; ++first)
+            staged.push_back(*first);
+        __merge_sorted(staged);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        value_type v(std::forward<Args>(args)...);
+        return try_emplace(v.first, std::move(v.second));
+    }
+
+    template <class... Args>
+    iterator emplace_hint(iterator position, Args&&... args);
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const key_type &k, Args&&... args) {
+        size_type i = lower_index(k);
+        if (found_at(i, k))
+            return std::pair<iterator, bool>(begin() + i, false);
+        return std::pair<iterator, bool>(__insert_at(i, k, std::forward<Args>(args)...), true);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(key_type &&k, Args&&... args) {
+        size_type i = lower_index(k);
+        if (found_at(i, k))
+            return std::pair<iterator, bool>(begin() + i, false);
+        return std::pair<iterator, bool>(__insert_at(i, std::move(k), std::forward<Args>(args)...), true);
+    }
+
+    /*
+     *  erase(position) returns the iterator to what followed position.
+     */
+    iterator erase(iterator position) { return erase(position, position + 1);  }
+    iterator erase(iterator first, iterator last);
+    size_type erase(const key_type &k) {
+        iterator it = find(k);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+    void clear() {  erase(begin(), end());  }
+
+public:
+    iterator find(const key_type &k) {
+        size_type i = lower_index(k);
+        return found_at(i, k) ? begin() + i : end();
+    }
+    const_iterator find(const key_type &k) const {
+        return const_cast<flat_map*>(this)->find(k);
+    }
+    size_type count(const key_type &k) const { return found_at(lower_index(k), k) ? 1 : 0;  }
+    iterator lower_bound(const key_type &k) { return begin() + lower_index(k);  }
+    const_iterator lower_bound(const key_type &k) const { return begin() + lower_index(k);  }
+    iterator upper_bound(const key_type &k) {
+        return begin() + search::upper(keys, length, k, compare);
+    }
+    const_iterator upper_bound(const key_type &k) const {
+        return begin() + search::upper(keys, length, k, compare);
+    }
+    std::pair<iterator, iterator> equal_range(const key_type &k) {
+        return std::pair<iterator, iterator>(lower_bound(k), upper_bound(k));
+    }
+    std::pair<const_iterator, const_iterator> equal_range(const key_type &k) const {
+        return std::pair<const_iterator, const_iterator>(lower_bound(k), upper_bound(k));
+    }
+
+};
+
+
+/*
+ *  moves both arrays to storage for n entries, n >= length.
+ */
+template <class Key, class T, class Compare, class Alloc>
+void flat_map<Key, T, Compare, Alloc>::reallocate(size_type n) {
+    Key *new_keys = key_allocator::allocate(n);
+    T *new_mapped = 0;
+    __STL_TRY {
+        new_mapped = data_allocator::allocate(n);
+    }
+    __STL_UNWIND(key_allocator::deallocate(new_keys, n));
+
+    __relocate_forward(new_keys, keys, length);
+    __relocate_forward(new_mapped, mapped, length);
+    key_allocator::deallocate(keys, storage);
+    data_allocator::deallocate(mapped, storage);
+    keys = new_keys;
+    mapped = new_mapped;
+    storage = n;
+}
+
+/*
+ *  unless it is an append with room to spare, the insert regrows or
+ *  shifts the arrays, and k or args may be an entry of this map
+ *  (m.try_emplace(k, m.find(j)->second)), so the new entry is built
+ *  first and moved into slot i.
+ */
+template <class Key, class T, class Compare, class Alloc>
+template <class K, class... Args>
+typename flat_map<Key, T, Compare, Alloc>::iterator
+flat_map<Key, T, Compare, Alloc>::__insert_at(size_type i, K &&k, Args&&... args) {
+    if (i == length && length < storage) {
+        construct(keys + i, std::forward<K>(k));
+        try {
+            construct(mapped + i, std::forward<Args>(args)...);
+        }
+        catch (...) {
+            destroy(keys + i);
+            throw;
+        }
+        ++length;
+        return begin() + i;
+    }
+
+    Key key(std::forward<K>(k));
+    T value(std::forward<Args>(args)...);
+    if (length == storage)
+        reallocate(storage < 8 ? 8 : 2 * storage);
+
+    __relocate_backward(keys + i + 1, keys + i, length - i);
+    __relocate_backward(mapped + i + 1, mapped + i, length - i);
+    construct(keys + i, std::move(key));
+    construct(mapped + i, std::move(value));
+    ++length;
+    return begin() + i;
+}
+
+template <class Key, class T, class Compare, class Alloc>
+template <class... Args>
+typename flat_map<Key, T, Compare, Alloc>::iterator
+flat_map<Key, T, Compare, Alloc>::emplace_hint(iterator position, Args&&... args) {
+    value_type v(std::forward<Args>(args)...);
+    size_type i = position - begin();
+    if ((i == 0 || compare(keys[i - 1], v.first)) &&
+            (i == length || compare(v.first, keys[i])))
+        return __insert_at(i, v.first, std::move(v.second));
+    return try_emplace(v.first, std::move(v.second)).first;
+}
+
+template <class Key, class T, class Compare, class Alloc>
+typename flat_map<Key, T, Compare, Alloc>::iterator
+flat_map<Key, T, Compare, Alloc>::erase(iterator first, iterator last) {
+    size_type i = first - begin();
+    size_type n = last - first;
+    for (size_type j = i; j < i + n; ++j) {
+        destroy(keys + j);
+        destroy(mapped + j);
+    }
+    __relocate_forward(keys + i, keys + i + n, length - i - n);
+    __relocate_forward(mapped + i, mapped + i + n, length - i - n);
+    length -= n;
+    return begin() + i;
+}
+
+/*
+ *  the batch insert: sort the staged entries (stable, so the first of
+ *  equal keys wins, as with one insert after another), then merge them
+ *  with the arrays into fresh storage in one pass. keys already in the
+ *  map keep their value.
+ */
+template <class Key, class T, class Compare, class Alloc>
+void flat_map<Key, T, Compare, Alloc>::__merge_sorted(std::vector<std::pair<Key, T> > &staged) {
+    Compare comp = compare;
+    if (staged.empty())
+        return;
+    std::stable_sort(staged.begin(), staged.end(),
+                     [comp](const std::pair<Key, T> &x, const std::pair<Key, T> &y) {
+                         return comp(x.first, y.first);
+                     });
+    staged.erase(std::unique(staged.begin(), staged.end(),
+                             [comp](const std::pair<Key, T> &x, const std::pair<Key, T> &y) {
+                                 return !comp(x.first, y.first);
+                             }),
+                 staged.end());
+
+    size_type m = staged.size();
+    size_type n = length + m;
+    Key *new_keys = key_allocator::allocate(n);
+    T *new_mapped = data_allocator::allocate(n);
+
+    size_type i = 0, j = 0, out = 0;
+    while (j < m) {
+        if (i < length && comp(keys[i], staged[j].first)) {
+            __relocate_forward(new_keys + out, keys + i, 1);
+            __relocate_forward(new_mapped + out, mapped + i, 1);
+            ++i, ++out;
+        }
+        else {
+            if (i == length || comp(staged[j].first, keys[i])) {
+                construct(new_keys + out, std::move(staged[j].first));
+                construct(new_mapped + out, std::move(staged[j].second));
+                ++out;
+            }
+            ++j;
+        }
+    }
+    __relocate_forward(new_keys + out, keys + i, length - i);
+    __relocate_forward(new_mapped + out, mapped + i, length - i);
+    out += length - i;
+
+    key_allocator::deallocate(keys, storage);
+    data_allocator::deallocate(mapped, storage);
+    keys = new_keys;
+    mapped = new_mapped;
+    length = out;
+    storage = n;
+}
+
+
+#endif //LIST_FLAT_MAP_H
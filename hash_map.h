@@ -0,0 +1,482 @@
+#ifndef LIST_HASH_MAP_H
+#define LIST_HASH_MAP_H
+
+/*
+ *  an unordered map for lookups that never need the order of map: one
+ *  flat array of slots, open addressing, and a byte of metadata per
+ *  slot kept in an array of its own.
+ *
+ *  the hash is mixed and split in two. its top bits pick the home slot,
+ *  and 7 other bits are stored in the slot's control byte, which is
+ *  empty (0x80) or those 7 bits. a lookup loads the 16 control bytes
+ *  from the home slot on, compares them all with the 7 bits at once
+ *  (SSE2 where there is, a plain loop elsewhere), and only compares keys
+ *  at the slots that match: with 7 bits, one in 128 by chance. a group
+ *  with an empty byte ends the search.
+ *
+ *  probing is linear over slots, so a key always sits in the unbroken
+ *  run of full slots starting at its home. erase keeps that true by
+ *  shifting later members of the run back into the hole (Knuth's
+ *  algorithm R): no tombstones, and a table that has seen many erases
+ *  probes as short as a fresh one. the table doubles at 7/8 full.
+ *
+ *  the first 15 control bytes are repeated after the last one, so a
+ *  group can be loaded from any slot without wrapping. insert may
+ *  rehash and erase moves elements: both invalidate iterators, and
+ *  erase(iterator) returns nothing, as in the sgi hash_map.
+ */
+
+#include "library.h"
+#include <utility>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <tuple>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+typedef signed char __hash_ctrl;
+const __hash_ctrl __hash_empty = -128;
+enum { __hash_group_width = 16 };
+
+/*
+ *  the 16 control bytes from p on, as bitmasks: bit i for p[i].
+ */
+#ifdef __SSE2__
+struct __hash_group {
+    __m128i ctrl;
+
+    explicit __hash_group(const __hash_ctrl *p) : ctrl(_mm_loadu_si128((const __m128i*)p)) {  }
+
+    unsigned match(__hash_ctrl h) const {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h), ctrl));
+    }
+    unsigned match_empty() const { return _mm_movemask_epi8(ctrl);  }    // the high bit is empty's alone
+};
+#else
+struct __hash_group {
+    const __hash_ctrl *ctrl;
+
+    explicit __hash_group(const __hash_ctrl *p) : ctrl(p) {  }
+
+    unsigned match(__hash_ctrl h) const {
+        unsigned bits = 0;
+        for (int i = 0; i < __hash_group_width; ++i)
+            bits |= (unsigned)(ctrl[i] == h) << i;
+        return bits;
+    }
+    unsigned match_empty() const {  return match(__hash_empty);    }
+};
+#endif
+
+/*
+ *  multiplying spreads every input bit into the top bits, which pick
+ *  the slot. std::hash of an integer is the integer itself, so it is
+ *  not good enough on its own.
+ */
+inline uint64_t __hash_mix(size_t h) {  return (uint64_t)h * 0x9E3779B97F4A7C15ull;   }
+inline __hash_ctrl __hash_h2(uint64_t m) {  return (__hash_ctrl)((m >> 25) & 0x7f);   }
+
+
+template <class Value, class Ref, class Ptr, class Table>
+struct __hash_map_iterator {
+    typedef forward_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef Ref reference;
+    typedef Ptr pointer;
+    typedef ptrdiff_t difference_type;
+    typedef __hash_map_iterator<Value, Value&, Value*, Table> iterator;
+    typedef __hash_map_iterator<Value, Ref, Ptr, Table> self;
+
+    const Table *table;
+    size_t index;
+
+    __hash_map_iterator() : table(0), index(0) {  }
+    __hash_map_iterator(const Table *t, size_t i) : table(t), index(i) {  }
+    __hash_map_iterator(const iterator &it) : table(it.table), index(it.index) {  }
+
+    reference operator*() const { return table->slots[index];  }
+    pointer operator->() const { return &(operator*());  }
+
+    bool operator==(const self &x) const { return index == x.index;    }
+    bool operator!=(const self &x) const { return index != x.index;    }
+
+    self &operator++() {
+        size_t n = table->bucket_count();
+        while (++index < n && table->ctrl[index] == __hash_empty)
+            ;
+        return *this;
+    }
+    self operator++(int) {  self tmp = *this; ++*this; return tmp;  }
+};
+
+
+template <class Key, class T, class HashFcn = std::hash<Key>, class EqualKey = std::equal_to<Key>,
+          class Alloc = alloc>
+class hash_map {
+public:
+    typedef Key key_type;
+    typedef T data_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef HashFcn hasher;
+    typedef EqualKey key_equal;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef value_type &reference;
+    typedef const value_type &const_reference;
+    typedef value_type *pointer;
+    typedef const value_type *const_pointer;
+    typedef __hash_map_iterator<value_type, value_type&, value_type*, hash_map> iterator;
+    typedef __hash_map_iterator<value_type, const value_type&, const value_type*, hash_map> const_iterator;
+
+    friend iterator;
+    friend const_iterator;
+
+private:
+    typedef simple_alloc<value_type, Alloc> slot_allocator;
+    typedef simple_alloc<__hash_ctrl, Alloc> ctrl_allocator;
+
+    __hash_ctrl *ctrl;      // bucket_count() + 15 bytes, the copies at the end
+    value_type *slots;
+    size_type mask;         // bucket_count() - 1, or 0 with no table yet
+    size_type length;
+    unsigned shift;         // 64 - log2(bucket_count())
+    hasher hash;
+    key_equal equals;
+
+    static const size_type npos = (size_type)-1;
+
+    size_type home(uint64_t m) const { return (size_type)(m >> shift);  }
+
+    void set_ctrl(size_type i, __hash_ctrl h) {
+        ctrl[i] = h;
+        if (i < __hash_group_width - 1)
+            ctrl[mask + 1 + i] = h;
+    }
+
+    size_type find_index(const key_type &k) const;
+    size_type find_empty(size_type pos) const;
+    void rehash(size_type n);
+    void deallocate_table();
+    void erase_at(size_type i);
+
+    template <class K, class... Args>
+    std::pair<iterator, bool> __try_emplace(K &&k, Args&&... args);
+
+public:
+    explicit hash_map(size_type n = 0, const hasher &hf = hasher(), const key_equal &eql = key_equal())
+            : ctrl(0), slots(0), mask(0), length(0), shift(64), hash(hf), equals(eql) {
+        reserve(n);
+    }
+
+    template <class InputIterator>
+    hash_map(InputIterator first, InputIterator last, size_type n = 0,
+             const hasher &hf = hasher(), const key_equal &eql = key_equal())
+            : ctrl(0), slots(0), mask(0), length(0), shift(64), hash(hf), equals(eql) {
+        reserve(n);
+        insert(first, last);
+    }
+
+    hash_map(const hash_map &x)
+            : ctrl(0), slots(0), mask(0), length(0), shift(64), hash(x.hash), equals(x.equals) {
+        reserve(x.size());
+        insert(x.begin(), x.end());
+    }
+
+    hash_map(hash_map &&x)
+            : ctrl(0), slots(0), mask(0), length(0), shift(64), hash(x.hash), equals(x.equals) {
+        swap(x);
+    }
+
+    ~hash_map() {
+        clear();
+        deallocate_table();
+    }
+
+    hash_map &operator=(const hash_map &x) {
+        if (this != &x) {
+            hash_map tmp(x);
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    hash_map &operator=(hash_map &&x) {
+        if (this != &x) {
+            clear();
+            swap(x);
+        }
+        return *this;
+    }
+
+    void swap(hash_map &x) {
+        std::swap(ctrl, x.ctrl);
+        std::swap(slots, x.slots);
+        std::swap(mask, x.mask);
+        std::swap(length, x.length);
+        std::swap(shift, x.shift);
+        std::swap(hash, x.hash);
+        std::swap(equals, x.equals);
+    }
+
+    hasher hash_funct() const { return hash;    }
+    key_equal key_eq() const { return equals;   }
+
+    iterator begin() {
+        iterator it(this, npos);
+        return ++it;
+    }
+    const_iterator begin() const {
+        const_iterator it(this, npos);
+        return ++it;
+    }
+    iterator end() { return iterator(this, bucket_count());  }
+    const_iterator end() const { return const_iterator(this, bucket_count());  }
+
+    bool empty() const { return length == 0;    }
+    size_type size() const { return length;  }
+    size_type bucket_count() const { return slots ? mask + 1 : 0;  }
+    size_type max_size() const { return ((size_type)-1 >> 1) / sizeof(value_type);   }
+    float load_factor() const { return slots ? (float)length / (mask + 1) : 0.0f;    }
+
+    /*
+     *  room for n elements without a rehash.
+     */
+    void reserve(size_type n) {
+        size_type buckets = __hash_group_width;
+        while (buckets / 8 * 7 < n)
+            buckets *= 2;
+        if (n != 0 && buckets > bucket_count())
+            rehash(buckets);
+    }
+
+    void clear();
+
+public:
+    std::pair<iterator, bool> insert(const value_type &x) { return __try_emplace(x.first, x.second);  }
+    std::pair<iterator, bool> insert(value_type &&x) {
+        return __try_emplace(x.first, std::move(x.second));
+    }
+
+    template <class InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        for ( ; first != last; ++first)
+            insert(*first);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        value_type v(std::forward<Args>(args)...);
+        return __try_emplace(std::move(const_cast<key_type&>(v.first)), std::move(v.second));
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const key_type &k, Args&&... args) {
+        return __try_emplace(k, std::forward<Args>(args)...);
+    }
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(key_type &&k, Args&&... args) {
+        return __try_emplace(std::move(k), std::forward<Args>(args)...);
+    }
+
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const key_type &k, M &&obj) {
+        std::pair<iterator, bool> r = __try_emplace(k, std::forward<M>(obj));
+        if (!r.second)
+            (*r.first).second = std::forward<M>(obj);
+        return r;
+    }
+
+    T &operator[](const key_type &k) {  return (*(try_emplace(k).first)).second;   }
+    T &operator[](key_type &&k) {   return (*(try_emplace(std::move(k)).first)).second;    }
+
+    T &at(const key_type &k) {
+        size_type i = find_index(k);
+        if (i == npos)
+            throw std::out_of_range("hash_map::at");
+        return slots[i].second;
+    }
+    const T &at(const key_type &k) const {
+        size_type i = find_index(k);
+        if (i == npos)
+            throw std::out_of_range("hash_map::at");
+        return slots[i].second;
+    }
+
+    iterator find(const key_type &k) {
+        size_type i = find_index(k);
+        return i == npos ? end() : iterator(this, i);
+    }
+    const_iterator find(const key_type &k) const {
+        size_type i = find_index(k);
+        return i == npos ? end() : const_iterator(this, i);
+    }
+
+    size_type count(const key_type &k) const { return find_index(k) != npos;    }
+
+    size_type erase(const key_type &k) {
+        size_type i = find_index(k);
+        if (i == npos)
+            return 0;
+        erase_at(i);
+        return 1;
+    }
+
+    void erase(iterator position) { erase_at(position.index);   }
+};
+
+/*
+ *  the slots whose control byte matches, group after group from the
+ *  home slot, until a group holds an empty one.
+ */
+template <class Key, class T, class HashFcn, class EqualKey, class Alloc>
+typename hash_map<Key, T, HashFcn, EqualKey, Alloc>::size_type
+hash_map<Key, T, HashFcn, EqualKey, Alloc>::find_index(const key_type &k) const {
+    if (slots == 0)
+        return npos;
+    uint64_t m = __hash_mix(hash(k));
+    __hash_ctrl h2 = __hash_h2(m);
+    for (size_type pos = home(m); ; pos = (pos + __hash_group_width) & mask) {
+        __hash_group g(ctrl + pos);
+        for (unsigned bits = g.match(h2); bits != 0; bits &= bits - 1) {
+            size_type i = (pos + __builtin_ctz(bits)) & mask;
+            if (equals(slots[i].first, k))
+                return i;
+        }
+        if (g.match_empty() != 0)
+            return npos;
+    }
+}
+
+template <class Key, class T, class HashFcn, class EqualKey, class Alloc>
+typename hash_map<Key, T, HashFcn, EqualKey, Alloc>::size_type
+hash_map<Key, T, HashFcn, EqualKey, Alloc>::find_empty(size_type pos) const {
+    for ( ; ; pos = (pos + __hash_group_width) & mask) {
+        unsigned bits = __hash_group(ctrl + pos).match_empty();
+        if (bits != 0)
+            return (pos + __builtin_ctz(bits)) & mask;
+    }
+}
+
+/*
+ *  a rehash moves every entry, and k or args may be one of them
+ *  (m.try_emplace(k, m.find(j)->second)), so when the table has to
+ *  grow the new entry is built first and moved in afterwards.
+ */
+template <class Key, class T, class HashFcn, class EqualKey, class Alloc>
+template <class K, class... Args>
+std::pair<typename hash_map<Key, T, HashFcn, EqualKey, Alloc>::iterator, bool>
+hash_map<Key, T, HashFcn, EqualKey, Alloc>::__try_emplace(K &&k, Args&&... args) {
+    size_type i = find_index(k);
+    if (i != npos)
+        return std::pair<iterator, bool>(iterator(this, i), false);
+
+    uint64_t m;
+    if (length + 1 <= bucket_count() / 8 * 7) {
+        m = __hash_mix(hash(k));
+        i = find_empty(home(m));
+        construct(slots + i, std::piecewise_construct,
+                  std::forward_as_tuple(std::forward<K>(k)),
+                  std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+    else {
+        value_type tmp(std::piecewise_construct,
+                       std::forward_as_tuple(std::forward<K>(k)),
+                       std::forward_as_tuple(std::forward<Args>(args)...));
+        rehash(slots ? 2 * (mask + 1) : (size_type)__hash_group_width);
+        m = __hash_mix(hash(tmp.first));
+        i = find_empty(home(m));
+        construct(slots + i, std::move(tmp));
+    }
+    set_ctrl(i, __hash_h2(m));
+    ++length;
+    return std::pair<iterator, bool>(iterator(this, i), true);
+}
+
+/*
+ *  algorithm R: the hole takes the next member of the run that may move
+ *  back to it, one whose home is not between the hole and itself, and
+ *  that member's slot becomes the hole. an empty slot ends the run.
+ */
+template <class Key, class T, class HashFcn, class EqualKey, class Alloc>
+void hash_map<Key, T, HashFcn, EqualKey, Alloc>::erase_at(size_type hole) {
+    destroy(slots + hole);
+    for (size_type j = (hole + 1) & mask; ctrl[j] != __hash_empty; j = (j + 1) & mask) {
+        size_type k = home(__hash_mix(hash(slots[j].first)));
+        bool movable = hole <= j ? (k <= hole || k > j) : (k <= hole && k > j);
+        if (movable) {
+            construct(slots + hole, std::move(slots[j]));
+            destroy(slots + j);
+            set_ctrl(hole, ctrl[j]);
+            hole = j;
+        }
+    }
+    set_ctrl(hole, __hash_empty);
+    --length;
+}
+
+template <class Key, class T, class HashFcn, class EqualKey, class Alloc>
+void hash_map<Key, T, HashFcn, EqualKey, Alloc>::rehash(size_type n) {
+    if (n > max_size())
+        throw std::length_error("hash_map");
+    __hash_ctrl *old_ctrl = ctrl;
+    value_type *old_slots = slots;
+    size_type old_count = bucket_count();
+
+    ctrl = ctrl_allocator::allocate(n + __hash_group_width - 1);
+    slots = slot_allocator::allocate(n);
+    for (size_type i = 0; i < n + __hash_group_width - 1; ++i)
+        ctrl[i] = __hash_empty;
+    mask = n - 1;
+    shift = 64;
+    for (size_type b = n; b > 1; b >>= 1)
+        --shift;
+
+    for (size_type i = 0; i < old_count; ++i)
+        if (old_ctrl[i] != __hash_empty) {
+            uint64_t m = __hash_mix(hash(old_slots[i].first));
+            size_type j = find_empty(home(m));
+            construct(slots + j, std::move(old_slots[i]));
+            destroy(old_slots + i);
+            set_ctrl(j, __hash_h2(m));
+        }
+    if (old_slots != 0) {
+        slot_allocator::deallocate(old_slots, old_count);
+        ctrl_allocator::deallocate(old_ctrl, old_count + __hash_group_width - 1);
+    }
+}
+
+template <class Key, class T, class HashFcn, class EqualKey, class Alloc>
+void hash_map<Key, T, HashFcn, EqualKey, Alloc>::deallocate_table() {
+    if (slots != 0) {
+        slot_allocator::deallocate(slots, mask + 1);
+        ctrl_allocator::deallocate(ctrl, mask + __hash_group_width);
+        ctrl = 0;
+        slots = 0;
+        mask = 0;
+        shift = 64;
+    }
+}
+
+/*
+ *  keeps the table, like clear() on a vector keeps its storage.
+ */
+template <class Key, class T, class HashFcn, class EqualKey, class Alloc>
+void hash_map<Key, T, HashFcn, EqualKey, Alloc>::clear() {
+    if (length == 0)
+        return;
+    for (size_type i = 0; i <= mask; ++i)
+        if (ctrl[i] != __hash_empty) {
+            destroy(slots + i);
+            ctrl[i] = __hash_empty;
+        }
+    for (size_type i = 0; i < __hash_group_width - 1; ++i)
+        ctrl[mask + 1 + i] = __hash_empty;
+    length = 0;
+}
+
+
+#endif //LIST_HASH_MAP_H
@@ -0,0 +1,582 @@
+#ifndef LIST_INTRUSIVE_H
+#define LIST_INTRUSIVE_H
+
+/*
+ *  intrusive containers: the objects carry their own links, and the
+ *  containers only link and unlink them. nothing is allocated,
+ *  constructed or copied, and an object can be unlinked through its
+ *  hook without knowing what it is in.
+ *
+ *      struct job : public list_hook<>, public set_hook<> {
+ *          int id;
+ *      };
+ *      intrusive_list<job> queue;
+ *      intrusive_rb_tree<int, job, job_id, std::less<int> > by_id;
+ *
+ *  an object sits in one container per hook. to be in two lists at once
+ *  it derives from list_hook<A> and list_hook<B>, and the containers
+ *  name the tag. the containers never own the objects: an object must
+ *  outlive its links, and a hook unlinks itself when it is destroyed.
+ *  copying an object does not copy its links.
+ *
+ *  the list runs on __list_transfer, list's relinking. the tree runs on
+ *  rb_tree's rebalance, rebalance_for_erase and rotations, and its
+ *  iterators on __rb_tree_iterator_base, all over the plain
+ *  __rb_tree_node_base.
+ */
+
+#include "map.h"
+#include <utility>
+
+
+/*
+ *  prev and next as in _list_node. 0 while not in a list.
+ */
+template <class Tag = void>
+struct list_hook {
+    typedef void*   void_pointer;
+    void_pointer prev;
+    void_pointer next;
+
+    list_hook() : prev(0), next(0) {  }
+    list_hook(const list_hook&) : prev(0), next(0) {  }
+    list_hook &operator=(const list_hook&) { return *this;   }
+    ~list_hook() {  unlink();   }
+
+    bool is_linked() const { return next != 0;  }
+
+    /*
+     *  O(1), from whatever list this is in.
+     */
+    void unlink() {
+        if (next != 0) {
+            ((list_hook*)prev)->next = next;
+            ((list_hook*)next)->prev = prev;
+            prev = next = 0;
+        }
+    }
+};
+
+template <class T, class Ref, class Ptr, class Hook>
+struct __intrusive_list_iterator {
+    typedef __intrusive_list_iterator<T, T&, T*, Hook> iterator;
+    typedef __intrusive_list_iterator<T, Ref, Ptr, Hook> self;
+
+    typedef bidirectional_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef Ptr pointer;
+    typedef Ref reference;
+    typedef Hook *link_type;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    link_type node;
+
+    __intrusive_list_iterator(link_type x) : node(x) {  }
+    __intrusive_list_iterator(const iterator &x) : node(x.node) {  }
+    __intrusive_list_iterator() {  }
+
+    bool operator==(const self &x) const { return node == x.node;   }
+    bool operator!=(const self &x) const { return node != x.node;   }
+
+    reference operator*() const { return static_cast<reference>(*node);  }
+    pointer operator->() const { return &(operator*());  }
+
+    self &operator++() {
+        node = (link_type)node->next;
+        return *this;
+    }
+    self operator++(int) {  self tmp = *this; ++*this; return tmp;  }
+
+    self &operator--() {
+        node = (link_type)node->prev;
+        return *this;
+    }
+    self operator--(int) {  self tmp = *this; --*this; return tmp;  }
+};
+
+
+/*
+ *  the header is a hook inside the list itself. the list keeps no
+ *  length, since an object can leave it through its hook, so size() is
+ *  a walk.
+ */
+template <class T, class Tag = void>
+class intrusive_list {
+public:
+    typedef list_hook<Tag> hook_type;
+    typedef T value_type;
+    typedef __intrusive_list_iterator<T, T&, T*, hook_type> iterator;
+    typedef __intrusive_list_iterator<T, const T&, const T*, hook_type> const_iterator;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+protected:
+    typedef hook_type *link_type;
+
+    hook_type header;
+
+    void empty_initialize() {
+        header.next = &header;
+        header.prev = &header;
+    }
+
+    static link_type hook(T &x) { return static_cast<link_type>(&x);    }
+
+    void transfer(iterator position, iterator first, iterator last) {
+        __list_transfer(position.node, first.node, last.node);
+    }
+
+public:
+    intrusive_list() {  empty_initialize(); }
+
+    intrusive_list(intrusive_list &&x) {
+        empty_initialize();
+        splice(end(), x);
+    }
+
+    ~intrusive_list() { clear();    }
+
+    intrusive_list(const intrusive_list&) = delete;
+    intrusive_list &operator=(const intrusive_list&) = delete;
+
+    intrusive_list &operator=(intrusive_list &&x) {
+        if (this != &x) {
+            clear();
+            splice(end(), x);
+        }
+        return *this;
+    }
+
+    void swap(intrusive_list &x) {
+        intrusive_list tmp;
+        tmp.splice(tmp.end(), *this);
+        splice(end(), x);
+        x.splice(x.end(), tmp);
+    }
+
+    iterator begin() { return (link_type)header.next;   }
+    const_iterator begin() const { return (link_type)header.next;   }
+    iterator end() { return &header;    }
+    const_iterator end() const { return (link_type)&header;   }
+
+    bool empty() const { return header.next == &header;  }
+
+    size_type size() const {
+        size_type result = 0;
+        distance(begin(), end(), result);
+        return result;
+    }
+
+    reference front() { return *begin();    }
+    reference back() { return *(--end());  }
+
+    /*
+     *  x must not be in a list through this hook already.
+     */
+    iterator insert(iterator position, T &x) {
+        link_type tmp = hook(x);
+        tmp->next = position.node;
+        tmp->prev = position.node->prev;
+        ((link_type)position.node->prev)->next = tmp;
+        position.node->prev = tmp;
+        return tmp;
+    }
+
+    /*
+     *  unlinks, the object itself is left alone.
+     */
+    iterator erase(iterator position) {
+        iterator next = (link_type)position.node->next;
+        position.node->unlink();
+        return next;
+    }
+
+    iterator erase(iterator first, iterator last) {
+        while (first != last)
+            first = erase(first);
+        return last;
+    }
+
+    void push_front(T &x) { insert(begin(), x); }
+    void push_back(T &x) {  insert(end(), x);   }
+    void pop_front() {  erase(begin()); }
+    void pop_back() {   erase(--end()); }
+
+    void clear() {  erase(begin(), end());  }
+
+    /*
+     *  the iterator at x, which must be in this list.
+     */
+    static iterator iterator_to(T &x) { return hook(x); }
+    static const_iterator iterator_to(const T &x) {
+        return hook(const_cast<T&>(x));
+    }
+
+    void splice(iterator position, intrusive_list &x) {
+        if (!x.empty())
+            transfer(position, x.begin(), x.end());
+    }
+
+    void splice(iterator position, intrusive_list&, iterator i) {
+        iterator j = i;
+        ++j;
+        if (position == i || position == j) return;
+        transfer(position, i, j);
+    }
+
+    void splice(iterator position, intrusive_list&, iterator first, iterator last) {
+        if (first != last)
+            transfer(position, first, last);
+    }
+
+    template <class Predicate>
+    void remove_if(Predicate pred) {
+        for (iterator it = begin(); it != end(); )
+            if (pred(*it))
+                it = erase(it);
+            else
+                ++it;
+    }
+};
+
+
+/*
+ *  the tree links. parent is 0 while not in a tree.
+ */
+template <class Tag = void>
+struct set_hook : public __rb_tree_node_base {
+    set_hook() {    parent = 0; }
+    set_hook(const set_hook&) : __rb_tree_node_base() { parent = 0; }
+    set_hook &operator=(const set_hook&) { return *this;    }
+    ~set_hook() {   unlink();   }
+
+    bool is_linked() const { return parent != 0;    }
+
+    /*
+     *  from whatever tree this is in. the header is found by walking up,
+     *  O(log n) like the rebalance that follows.
+     */
+    void unlink();
+};
+
+/*
+ *  the tree's header, with the count, so that unlinking through a hook
+ *  keeps it right. it is told apart from the nodes as in
+ *  __rb_tree_iterator_base::decrement: it is red and its parent, the
+ *  root, has it for parent.
+ */
+struct __intrusive_rb_header : public __rb_tree_node_base {
+    size_t node_count;
+
+    static bool is_header(base_ptr x) {
+        return x->color == __rb_tree_red && x->parent != 0 && x->parent->parent == x;
+    }
+};
+
+template <class Tag>
+void set_hook<Tag>::unlink() {
+    if (parent == 0)
+        return;
+    base_ptr h = parent;
+    while (!__intrusive_rb_header::is_header(h))
+        h = h->parent;
+    __rb_tree_rebalance_for_erase<__rb_tree_node_base>(this, h->parent, h->left, h->right);
+    --static_cast<__intrusive_rb_header*>(h)->node_count;
+    parent = left = right = 0;
+}
+
+template <class T, class Ref, class Ptr, class Hook>
+struct __intrusive_rb_iterator : public __rb_tree_iterator_base<__rb_tree_node_base> {
+    typedef T value_type;
+    typedef Ref reference;
+    typedef Ptr pointer;
+    typedef __intrusive_rb_iterator<T, T&, T*, Hook> iterator;
+    typedef __intrusive_rb_iterator<T, Ref, Ptr, Hook> self;
+
+    __intrusive_rb_iterator() {  }
+    __intrusive_rb_iterator(base_ptr x) {   node = x;   }
+    __intrusive_rb_iterator(const iterator &it) {   node = it.node; }
+
+    reference operator*() const { return static_cast<reference>(*static_cast<Hook*>(node));    }
+    pointer operator->() const { return &(operator*());  }
+
+    bool operator==(const self &v) const { return node == v.node; }
+    bool operator!=(const self &v) const { return node != v.node; }
+
+    self &operator++() {    increment(); return *this;  }
+    self operator++(int) {  self tmp = *this; increment(); return tmp;  }
+    self &operator--() {    decrement(); return *this;  }
+    self operator--(int) {  self tmp = *this; decrement(); return tmp;  }
+};
+
+
+/*
+ *  rb_tree over objects that derive from set_hook<Tag>, ordered by
+ *  Compare on KeyOfValue()(object). insert_unique and insert_equal as
+ *  in rb_tree; erase unlinks. the header lives in the tree, so the
+ *  root's parent points into it and swap has to set that right.
+ */
+template <class Key, class T, class KeyOfValue, class Compare = std::less<Key>, class Tag = void>
+class intrusive_rb_tree {
+public:
+    typedef set_hook<Tag> hook_type;
+    typedef Key key_type;
+    typedef T value_type;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef Compare key_compare;
+    typedef __intrusive_rb_iterator<T, T&, T*, hook_type> iterator;
+    typedef __intrusive_rb_iterator<T, const T&, const T*, hook_type> const_iterator;
+
+protected:
+    typedef __rb_tree_node_base *base_ptr;
+
+    __intrusive_rb_header header;
+    Compare comp;
+
+    base_ptr &root() const { return ((__intrusive_rb_header&)header).parent;    }
+    base_ptr &leftmost() const { return ((__intrusive_rb_header&)header).left;  }
+    base_ptr &rightmost() const { return ((__intrusive_rb_header&)header).right;    }
+    base_ptr end_node() const { return (base_ptr)&header; }
+
+    static const Key &key(base_ptr x) {
+        return KeyOfValue()(static_cast<const T&>(*static_cast<hook_type*>(x)));
+    }
+    static base_ptr hook(T &x) { return static_cast<hook_type*>(&x);    }
+
+    void empty_initialize() {
+        header.color = __rb_tree_red;
+        header.parent = 0;
+        header.left = &header;
+        header.right = &header;
+        header.node_count = 0;
+    }
+
+    iterator __insert(base_ptr x, base_ptr y, base_ptr z);
+    void __clear(base_ptr x);
+
+public:
+    explicit intrusive_rb_tree(const Compare &c = Compare()) : comp(c) {  empty_initialize(); }
+
+    intrusive_rb_tree(intrusive_rb_tree &&x) : comp(x.comp) {
+        empty_initialize();
+        swap(x);
+    }
+
+    ~intrusive_rb_tree() {  clear();    }
+
+    intrusive_rb_tree(const intrusive_rb_tree&) = delete;
+    intrusive_rb_tree &operator=(const intrusive_rb_tree&) = delete;
+
+    intrusive_rb_tree &operator=(intrusive_rb_tree &&x) {
+        if (this != &x) {
+            clear();
+            swap(x);
+        }
+        return *this;
+    }
+
+    void swap(intrusive_rb_tree &x);
+
+    key_compare key_comp() const { return comp;  }
+
+    iterator begin() { return leftmost();   }
+    const_iterator begin() const { return leftmost();   }
+    iterator end() { return end_node(); }
+    const_iterator end() const { return end_node(); }
+
+    bool empty() const { return header.node_count == 0; }
+    size_type size() const { return header.node_count;  }
+
+    /*
+     *  x must not be in a tree through this hook already.
+     */
+    std::pair<iterator, bool> insert_unique(T &x);
+    iterator insert_equal(T &x);
+
+    /*
+     *  unlinks, the object itself is left alone.
+     */
+    iterator erase(iterator position) {
+        iterator next = position;
+        ++next;
+        base_ptr z = position.node;
+        __rb_tree_rebalance_for_erase<__rb_tree_node_base>(z, root(), leftmost(), rightmost());
+        --header.node_count;
+        z->parent = z->left = z->right = 0;
+        return next;
+    }
+
+    void erase(iterator first, iterator last) {
+        if (first == begin() && last == end())
+            clear();
+        else
+            while (first != last)
+                first = erase(first);
+    }
+
+    size_type erase(const key_type &k) {
+        std::pair<iterator, iterator> p = equal_range(k);
+        size_type n = 0;
+        distance(p.first, p.second, n);
+        erase(p.first, p.second);
+        return n;
+    }
+
+    /*
+     *  resets every hook, O(n), without rebalancing.
+     */
+    void clear() {
+        __clear(root());
+        empty_initialize();
+    }
+
+    static iterator iterator_to(T &x) { return hook(x); }
+    static const_iterator iterator_to(const T &x) {
+        return hook(const_cast<T&>(x));
+    }
+
+    iterator lower_bound(const key_type &k) const;
+    iterator upper_bound(const key_type &k) const;
+
+    iterator find(const key_type &k) const {
+        iterator j = lower_bound(k);
+        return (j == end_node() || comp(k, key(j.node))) ? iterator(end_node()) : j;
+    }
+
+    std::pair<iterator, iterator> equal_range(const key_type &k) const {
+        return std::pair<iterator, iterator>(lower_bound(k), upper_bound(k));
+    }
+
+    size_type count(const key_type &k) const {
+        std::pair<iterator, iterator> p = equal_range(k);
+        size_type n = 0;
+        distance(p.first, p.second, n);
+        return n;
+    }
+};
+
+/*
+ *  rb_tree's __insert_node with the node given: z goes below y, on the
+ *  left when x is set or z's key is less.
+ */
+template <class Key, class T, class KeyOfValue, class Compare, class Tag>
+typename intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::iterator
+intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::__insert(base_ptr x, base_ptr y, base_ptr z) {
+    if (y == end_node() || x != 0 || comp(key(z), key(y))) {
+        y->left = z;
+        if (y == end_node()) {
+            root() = z;
+            rightmost() = z;
+        }
+        else if (y == leftmost())
+            leftmost() = z;
+    }
+    else {
+        y->right = z;
+        if (y == rightmost())
+            rightmost() = z;
+    }
+    z->parent = y;
+    z->left = 0;
+    z->right = 0;
+    __rb_tree_rebalance<__rb_tree_node_base>(z, root());
+    ++header.node_count;
+    return z;
+}
+
+template <class Key, class T, class KeyOfValue, class Compare, class Tag>
+std::pair<typename intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::iterator, bool>
+intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::insert_unique(T &v) {
+    base_ptr z = hook(v);
+    base_ptr y = end_node();
+    base_ptr x = root();
+    bool less = true;
+    while (x != 0) {
+        y = x;
+        less = comp(key(z), key(x));
+        x = less ? x->left : x->right;
+    }
+    iterator j = y;
+    if (less) {
+        if (j == begin())
+            return std::pair<iterator, bool>(__insert(x, y, z), true);
+        --j;
+    }
+    if (comp(key(j.node), key(z)))
+        return std::pair<iterator, bool>(__insert(x, y, z), true);
+    return std::pair<iterator, bool>(j, false);
+}
+
+template <class Key, class T, class KeyOfValue, class Compare, class Tag>
+typename intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::iterator
+intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::insert_equal(T &v) {
+    base_ptr z = hook(v);
+    base_ptr y = end_node();
+    base_ptr x = root();
+    while (x != 0) {
+        y = x;
+        x = comp(key(z), key(x)) ? x->left : x->right;
+    }
+    return __insert(x, y, z);
+}
+
+template <class Key, class T, class KeyOfValue, class Compare, class Tag>
+void intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::__clear(base_ptr x) {
+    while (x != 0) {
+        __clear(x->right);
+        base_ptr y = x->left;
+        x->parent = x->left = x->right = 0;
+        x = y;
+    }
+}
+
+template <class Key, class T, class KeyOfValue, class Compare, class Tag>
+void intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::swap(intrusive_rb_tree &x) {
+    std::swap(header.parent, x.header.parent);
+    std::swap(header.left, x.header.left);
+    std::swap(header.right, x.header.right);
+    std::swap(header.node_count, x.header.node_count);
+    std::swap(comp, x.comp);
+    intrusive_rb_tree *t[2] = { this, &x };
+    for (int i = 0; i < 2; ++i) {
+        if (t[i]->root() != 0)
+            t[i]->root()->parent = t[i]->end_node();
+        else
+            t[i]->leftmost() = t[i]->rightmost() = t[i]->end_node();
+    }
+}
+
+template <class Key, class T, class KeyOfValue, class Compare, class Tag>
+typename intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::iterator
+intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::lower_bound(const key_type &k) const {
+    base_ptr y = end_node();
+    base_ptr x = root();
+    while (x != 0)
+        if (!comp(key(x), k))
+            y = x, x = x->left;
+        else
+            x = x->right;
+    return y;
+}
+
+template <class Key, class T, class KeyOfValue, class Compare, class Tag>
+typename intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::iterator
+intrusive_rb_tree<Key, T, KeyOfValue, Compare, Tag>::upper_bound(const key_type &k) const {
+    base_ptr y = end_node();
+    base_ptr x = root();
+    while (x != 0)
+        if (comp(k, key(x)))
+            y = x, x = x->left;
+        else
+            x = x->right;
+    return y;
+}
+
+
+#endif //LIST_INTRUSIVE_H
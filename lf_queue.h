@@ -0,0 +1,379 @@
+#ifndef LIST_LF_QUEUE_H
+#define LIST_LF_QUEUE_H
+
+/*
+ *  lock-free fifo queues for passing work between threads, the job a
+ *  list behind a mutex does with push_back and erase(begin()).
+ *
+ *      mpsc_queue      any number of producers, one consumer, after
+ *                      Vyukov's intrusive mpsc queue. push is lock-free
+ *                      apart from growth: a node off the pool's free
+ *                      list (a compare-and-swap loop, and a mutex when
+ *                      the pool has to add a chunk), then an exchange
+ *                      on the tail and a store.
+ *      mpmc_queue      any number of producers and consumers, lock-free,
+ *                      after Michael and Scott.
+ *
+ *  nodes are laid out like _list_node, link first and value last, but
+ *  the link holds an index rather than a pointer. a node that is popped
+ *  goes back on a free list and is soon reused, so a thread that read a
+ *  link just before could see the same node again as if nothing had
+ *  happened (ABA). so nodes live in chunks of a __lf_node_pool and are
+ *  named by 32-bit indices. every shared word holds an index together
+ *  with a 32-bit tag that each successful update bumps, and a
+ *  compare-and-swap on a stale word always fails. chunks are taken from
+ *  Alloc as the queue grows and only go back when the queue is
+ *  destroyed, so reading a node someone else has just freed is always
+ *  safe: at worst the value is stale and the CAS fails.
+ */
+
+#include "library.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdint>
+#include <type_traits>
+
+
+inline uint64_t __lf_pack(uint32_t index, uint32_t tag) {
+    return ((uint64_t)tag << 32) | index;
+}
+inline uint32_t __lf_index(uint64_t word) { return (uint32_t)word;   }
+inline uint32_t __lf_tag(uint64_t word) { return (uint32_t)(word >> 32);    }
+
+/*
+ *  next is the queue link, or the free list link while the node is
+ *  free. holds counts the parties that still need the node, see
+ *  mpmc_queue::pop.
+ */
+template <class T>
+struct __lf_queue_node {
+    std::atomic<uint64_t> next;         // tag | index, 0 for none
+    std::atomic<unsigned> holds;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+    T *value() { return (T*)&storage;  }
+};
+
+
+/*
+ *  nodes by index: chunk index << __lf_chunk_bits | offset. index 0 is
+ *  never handed out and stands for null. free nodes form a Treiber
+ *  stack with a tagged head. growing takes a mutex, so it is the one
+ *  step that may block. it happens only when every node is in use.
+ */
+enum { __lf_chunk_bits = 10 };
+enum { __lf_max_chunks = 1 << 16 };     // 64M nodes
+
+template <class Node, class Alloc>
+class __lf_node_pool {
+private:
+    enum { chunk_size = 1 << __lf_chunk_bits };
+    typedef simple_alloc<Node, Alloc> chunk_allocator;
+    typedef simple_alloc<Node*, Alloc> table_allocator;
+
+    Node **chunks;
+    uint32_t chunk_count;               // under grow_mutex
+    std::mutex grow_mutex;
+    std::atomic<uint64_t> free_head;
+
+    void grow();
+
+public:
+    __lf_node_pool() : chunks(table_allocator::allocate(__lf_max_chunks)), chunk_count(0),
+                       free_head(0) {  }
+
+    ~__lf_node_pool() {
+        for (uint32_t c = 0; c < chunk_count; ++c)
+            chunk_allocator::deallocate(chunks[c], chunk_size);
+        table_allocator::deallocate(chunks, __lf_max_chunks);
+    }
+
+    __lf_node_pool(const __lf_node_pool&) = delete;
+    __lf_node_pool &operator=(const __lf_node_pool&) = delete;
+
+    Node *node(uint32_t i) const {
+        return chunks[i >> __lf_chunk_bits] + (i & (chunk_size - 1));
+    }
+
+    uint32_t get() {
+        for (;;) {
+            uint64_t h = free_head.load(std::memory_order_acquire);
+            uint32_t i = __lf_index(h);
+            if (i == 0) {
+                grow();
+                continue;
+            }
+            uint64_t next = node(i)->next.load(std::memory_order_relaxed);
+            if (free_head.compare_exchange_weak(h, __lf_pack(__lf_index(next), __lf_tag(h) + 1),
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed))
+                return i;
+        }
+    }
+
+    /*
+     *  the node's own tag goes on counting, so a queue link that still
+     *  names it cannot be mistaken for a later one.
+     */
+    void put(uint32_t i) {
+        Node *n = node(i);
+        uint64_t h = free_head.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t tag = __lf_tag(n->next.load(std::memory_order_relaxed));
+            n->next.store(__lf_pack(__lf_index(h), tag + 1), std::memory_order_relaxed);
+            if (free_head.compare_exchange_weak(h, __lf_pack(i, __lf_tag(h) + 1),
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed))
+                return;
+        }
+    }
+};
+
+/*
+ *  a new chunk is threaded into a chain and pushed onto the free list
+ *  whole. the chunk table entry is written before any of its indices
+ *  can be seen.
+ */
+template <class Node, class Alloc>
+void __lf_node_pool<Node, Alloc>::grow() {
+    std::lock_guard<std::mutex> lock(grow_mutex);
+    if (__lf_index(free_head.load(std::memory_order_acquire)) != 0)
+        return;     // another thread grew it meanwhile
+    if (chunk_count == __lf_max_chunks)
+        throw std::bad_alloc();
+
+    uint32_t c = chunk_count;
+    Node *chunk = chunk_allocator::allocate(chunk_size);
+    for (uint32_t k = 0; k < chunk_size; ++k) {
+        construct(&chunk[k].next, (uint64_t)0);
+        construct(&chunk[k].holds, 0u);
+    }
+    chunks[c] = chunk;
+    ++chunk_count;
+
+    uint32_t first = c == 0 ? 1 : c << __lf_chunk_bits;     // 0 is null
+    uint32_t last = ((c + 1) << __lf_chunk_bits) - 1;
+    for (uint32_t i = first; i < last; ++i)
+        node(i)->next.store(__lf_pack(i + 1, 0), std::memory_order_relaxed);
+
+    uint64_t h = free_head.load(std::memory_order_relaxed);
+    do {
+        node(last)->next.store(__lf_pack(__lf_index(h), 0), std::memory_order_relaxed);
+    } while (!free_head.compare_exchange_weak(h, __lf_pack(first, __lf_tag(h) + 1),
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+}
+
+
+/*
+ *  head and tail are kept a cache line apart, so producers and
+ *  consumers do not fight over one line.
+ */
+template <class T, class Alloc = alloc>
+class mpsc_queue {
+public:
+    typedef T value_type;
+    typedef size_t size_type;
+
+private:
+    typedef __lf_queue_node<T> node_type;
+
+    __lf_node_pool<node_type, Alloc> pool;
+    uint32_t head;                      // the consumer's, a dummy node
+    char pad[64];
+    std::atomic<uint32_t> tail;         // the producers'
+
+    node_type *node(uint32_t i) const { return pool.node(i);    }
+
+public:
+    mpsc_queue() {
+        uint32_t d = pool.get();
+        node(d)->next.store(0, std::memory_order_relaxed);
+        head = d;
+        tail.store(d, std::memory_order_relaxed);
+    }
+
+    /*
+     *  no producer may be left.
+     */
+    ~mpsc_queue() {
+        for (uint32_t i = __lf_index(node(head)->next.load()); i != 0;
+             i = __lf_index(node(i)->next.load()))
+            destroy(node(i)->value());
+    }
+
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue &operator=(const mpsc_queue&) = delete;
+
+    /*
+     *  any thread. between its exchange and its store the queue looks
+     *  empty to the consumer from that node on.
+     */
+    template <class... Args>
+    void emplace(Args&&... args) {
+        uint32_t i = pool.get();
+        node_type *n = node(i);
+        construct(n->value(), std::forward<Args>(args)...);
+        n->next.store(__lf_pack(0, __lf_tag(n->next.load(std::memory_order_relaxed))),
+                      std::memory_order_relaxed);
+        uint32_t prev = tail.exchange(i, std::memory_order_acq_rel);
+        node(prev)->next.store(__lf_pack(i, 0), std::memory_order_release);
+    }
+
+    void push(const T &x) { emplace(x);    }
+    void push(T &&x) {  emplace(std::move(x));  }
+
+    /*
+     *  the consumer only.
+     */
+    bool pop(T &out) {
+        uint32_t next = __lf_index(node(head)->next.load(std::memory_order_acquire));
+        if (next == 0)
+            return false;
+        T *v = node(next)->value();
+        out = std::move(*v);
+        destroy(v);
+        pool.put(head);
+        head = next;
+        return true;
+    }
+
+    bool empty() const {
+        return __lf_index(node(head)->next.load(std::memory_order_acquire)) == 0;
+    }
+};
+
+
+template <class T, class Alloc = alloc>
+class mpmc_queue {
+public:
+    typedef T value_type;
+    typedef size_t size_type;
+
+private:
+    typedef __lf_queue_node<T> node_type;
+
+    __lf_node_pool<node_type, Alloc> pool;
+    std::atomic<uint64_t> head;         // tag | index of the dummy node
+    char pad[64];
+    std::atomic<uint64_t> tail;
+
+    node_type *node(uint32_t i) const { return pool.node(i);    }
+
+    void release(uint32_t i) {
+        if (node(i)->holds.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            pool.put(i);
+    }
+
+public:
+    mpmc_queue() {
+        uint32_t d = pool.get();
+        node(d)->next.store(0, std::memory_order_relaxed);
+        node(d)->holds.store(1, std::memory_order_relaxed);     // no value to take
+        head.store(__lf_pack(d, 0), std::memory_order_relaxed);
+        tail.store(__lf_pack(d, 0), std::memory_order_relaxed);
+    }
+
+    /*
+     *  no producer or consumer may be left.
+     */
+    ~mpmc_queue() {
+        for (uint32_t i = __lf_index(node(__lf_index(head.load()))->next.load()); i != 0;
+             i = __lf_index(node(i)->next.load()))
+            destroy(node(i)->value());
+    }
+
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue &operator=(const mpmc_queue&) = delete;
+
+    template <class... Args>
+    void emplace(Args&&... args);
+
+    void push(const T &x) { emplace(x);    }
+    void push(T &&x) {  emplace(std::move(x));  }
+
+    bool pop(T &out);
+
+    bool empty() const {
+        uint32_t h = __lf_index(head.load(std::memory_order_acquire));
+        return __lf_index(node(h)->next.load(std::memory_order_acquire)) == 0;
+    }
+};
+
+/*
+ *  link the node after the last one, then swing tail to it. a tail left
+ *  behind by a slow producer is swung forward by whoever sees it.
+ */
+template <class T, class Alloc>
+template <class... Args>
+void mpmc_queue<T, Alloc>::emplace(Args&&... args) {
+    uint32_t i = pool.get();
+    node_type *n = node(i);
+    construct(n->value(), std::forward<Args>(args)...);
+    n->holds.store(2, std::memory_order_relaxed);
+    n->next.store(__lf_pack(0, __lf_tag(n->next.load(std::memory_order_relaxed)) + 1),
+                  std::memory_order_relaxed);
+
+    for (;;) {
+        uint64_t t = tail.load(std::memory_order_acquire);
+        node_type *last = node(__lf_index(t));
+        uint64_t next = last->next.load(std::memory_order_acquire);
+        if (t != tail.load(std::memory_order_acquire))
+            continue;
+        if (__lf_index(next) == 0) {
+            if (last->next.compare_exchange_weak(next, __lf_pack(i, __lf_tag(next) + 1),
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed)) {
+                tail.compare_exchange_strong(t, __lf_pack(i, __lf_tag(t) + 1),
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed);
+                return;
+            }
+        }
+        else
+            tail.compare_exchange_strong(t, __lf_pack(__lf_index(next), __lf_tag(t) + 1),
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed);
+    }
+}
+
+/*
+ *  the winner of the head CAS takes the value out of the node after the
+ *  dummy, and that node becomes the dummy. a consumer right behind may
+ *  already unlink it before the value is out, so a node with a value
+ *  carries two holds: one for whoever takes its value, one for whoever
+ *  unlinks it as the dummy. the last of the two frees it.
+ */
+template <class T, class Alloc>
+bool mpmc_queue<T, Alloc>::pop(T &out) {
+    for (;;) {
+        uint64_t h = head.load(std::memory_order_acquire);
+        uint64_t t = tail.load(std::memory_order_acquire);
+        uint32_t first = __lf_index(h);
+        uint64_t next = node(first)->next.load(std::memory_order_acquire);
+        if (h != head.load(std::memory_order_acquire))
+            continue;
+        if (__lf_index(next) == 0)
+            return false;
+        if (first == __lf_index(t)) {       // tail is behind, help it on
+            tail.compare_exchange_strong(t, __lf_pack(__lf_index(next), __lf_tag(t) + 1),
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed);
+            continue;
+        }
+        if (head.compare_exchange_weak(h, __lf_pack(__lf_index(next), __lf_tag(h) + 1),
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_relaxed)) {
+            T *v = node(__lf_index(next))->value();
+            out = std::move(*v);
+            destroy(v);
+            release(__lf_index(next));
+            release(first);
+            return true;
+        }
+    }
+}
+
+
+#endif //LIST_LF_QUEUE_H
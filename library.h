@@ -3,6 +3,10 @@
 
 #include <cstddef>
 #include <memory>
+#include <iterator>
+#include <type_traits>
+#include <functional>
+#include "alloc.h"
 
 /*
  * this is a stl list implementation review, sgi stl version implementation.
@@ -21,9 +25,54 @@ struct _list_node {
     T	data;
 };
 
+template <class T>
+inline T &__node_value(_list_node<T> *p) {  return p->data;   }
+
+/*
+ *  list's transfer(): moves [first, last) before position by relinking.
+ *  Node is anything with void pointers prev and next, so the
+ *  intrusive list runs on it as well.
+ */
+template <class Node>
+inline void __list_transfer(Node *position, Node *first, Node *last) {
+    if(position != last) {
+        (*(Node*)((*last).prev)).next = position;
+        (*(Node*)((*first).prev)).next = last;
+        (*(Node*)((*position).prev)).next = first;
+        Node *tmp = (Node*)((*position).prev);
+        (*position).prev = (*last).prev;
+        (*last).prev = (*first).prev;
+        (*first).prev = tmp;
+    }
+}
+
 struct input_iterator_tag   {   };
 struct forward_iterator_tag :   public input_iterator_tag   {   };
 struct bidirectional_iterator_tag : public  forward_iterator_tag {  };
+struct random_access_iterator_tag : public  bidirectional_iterator_tag {  };
+
+/*
+ *  __is_forward_iterator<I>::type is __true_type when I can be walked
+ *  more than once, whether it is tagged with the tags above or the std
+ *  ones (pointers, std containers).
+ */
+template <class Iterator>
+struct __is_forward_iterator {
+    typedef typename std::iterator_traits<Iterator>::iterator_category category;
+    typedef typename __bool_type<std::is_base_of<forward_iterator_tag, category>::value ||
+                                 std::is_base_of<std::forward_iterator_tag, category>::value>::type type;
+};
+
+/*
+ *  the sgi three-argument distance(), n is increased by the distance.
+ */
+template <class InputIterator, class Distance>
+inline void distance(InputIterator first, InputIterator last, Distance &n) {
+    while (first != last) {
+        ++first;
+        ++n;
+    }
+}
 
 // iterators
 template<typename T, typename Ref, typename Ptr>
@@ -107,30 +156,134 @@ public:
     static void deallocate(T *p) {
         Alloc::deallocate(p, sizeof(T));
     }
+
+    /*
+     *  n objects, each in a block of its own, for nodes that are built
+     *  in a batch and freed one at a time.
+     */
+    static void allocate_batch(T **out, size_t n) {
+        __batch_alloc<Alloc>::allocate(sizeof(T), out, n);
+    }
+};
+
+
+/*
+ *  a node taken out of its container by extract(), value and all. it
+ *  owns the node until insert() links it into another container of the
+ *  same node type and Alloc, so an element moves with no allocation and
+ *  without its value being copied or moved. a handle still holding its
+ *  node when it dies destroys it.
+ *
+ *  the value can be changed meanwhile: value(), or key() and mapped()
+ *  for the nodes of a map, where key() is writable too as the node is
+ *  out of any tree. Node's value is reached through __node_value(),
+ *  which each node type provides.
+ */
+template <class Node, class Value, class Alloc>
+class __node_handle {
+public:
+    typedef Value value_type;
+
+protected:
+    typedef simple_alloc<Node, Alloc> node_allocator;
+    Node *ptr;
+
+public:
+    __node_handle() : ptr(0) {  }
+    explicit __node_handle(Node *p) : ptr(p) {  }   // for the containers
+    __node_handle(__node_handle &&x) : ptr(x.ptr) { x.ptr = 0;  }
+    __node_handle(const __node_handle&) = delete;
+    ~__node_handle() {  reset();    }
+
+    __node_handle &operator=(__node_handle &&x) {
+        if (this != &x) {
+            reset();
+            ptr = x.ptr;
+            x.ptr = 0;
+        }
+        return *this;
+    }
+    __node_handle &operator=(const __node_handle&) = delete;
+
+    bool empty() const { return ptr == 0;   }
+    explicit operator bool() const { return ptr != 0;   }
+
+    value_type &value() const { return __node_value(ptr);  }
+
+    template <class V = Value>
+    typename std::remove_const<typename V::first_type>::type &key() const {
+        return const_cast<typename std::remove_const<typename V::first_type>::type&>(
+                __node_value(ptr).first);
+    }
+    template <class V = Value>
+    typename V::second_type &mapped() const {  return __node_value(ptr).second;   }
+
+    void swap(__node_handle &x) {   std::swap(ptr, x.ptr);  }
+
+    /*
+     *  gives the node up to a container, the handle is left empty.
+     */
+    Node *__release() {
+        Node *p = ptr;
+        ptr = 0;
+        return p;
+    }
+
+protected:
+    void reset() {
+        if (ptr != 0) {
+            destroy(&__node_value(ptr));
+            node_allocator::deallocate(ptr);
+            ptr = 0;
+        }
+    }
 };
 
+/*
+ *  what inserting a node handle into a unique container returns. when
+ *  the key was already there, position is that element and node still
+ *  holds the handle's node.
+ */
+template <class Iterator, class NodeType>
+struct __insert_return_type {
+    Iterator position;
+    bool inserted;
+    NodeType node;
+};
+
+
+template <class T, class Alloc>
+struct __list_io;      // list_io.h
 
-template<typename T, typename Alloc = std::alloc>
+template<typename T, typename Alloc = alloc>
 class list {
 protected:
     typedef _list_node<T> list_node;
+    template <class, class> friend struct __list_io;
+public:
+    typedef T value_type;
     typedef _list_iterator<T, T &, T *> iterator;
+    typedef _list_iterator<T, const T &, const T *> const_iterator;
     typedef T &reference;
-public:
+    typedef const T &const_reference;
+    typedef size_t size_type;
     typedef list_node *link_type;
     typedef simple_alloc<list_node, Alloc> list_node_allocator;
+    typedef __node_handle<list_node, T, Alloc> node_type;
 
 protected:
     link_type node;
     // whole circle list
+    size_type length;
 
     link_type get_node() { return list_node_allocator::allocate(); }
 
     void put_node(link_type p) { list_node_allocator::deallocate(p); }
 
-    link_type create_node(const T &x) {
+    template <class... Args>
+    link_type create_node(Args&&... args) {
         link_type p = get_node();
-        construct(&p->data, x);        // whole scale function
+        construct(&p->data, std::forward<Args>(args)...);        // whole scale function
         return p;
     }
 
@@ -143,64 +296,228 @@ protected:
         node = get_node();
         node->next = node;
         node->prev = node;
+        length = 0;
+    }
+
+    /*
+     *  ends the life of every element. a monotonic Alloc gets its memory
+     *  back from its owner, so the nodes are not deallocated and, when T
+     *  has a trivial destructor, not even visited. the links of the header
+     *  are left as they are.
+     */
+    void destroy_all(__false_type /* is_monotonic */) { clear(); }
+
+    void destroy_all(__true_type /* is_monotonic */) {
+        destroy_values(typename __type_traits<T>::has_trivial_destructor());
+    }
+
+    void destroy_values(__true_type /* has_trivial_destructor */) {    }
+
+    void destroy_values(__false_type /* has_trivial_destructor */) {
+        for (link_type cur = (link_type)node->next; cur != node; cur = (link_type)cur->next)
+            destroy(&cur->data);
     }
 
 public:
     //constructor
     list() { empty_initialize(); }
 
+    list(const list<T, Alloc> &x) {
+        empty_initialize();
+        for (const_iterator it = x.begin(); it != x.end(); ++it)
+            push_back(*it);
+    }
+
+    /*
+     *  moving hands the nodes over with the header swap, the moved-from
+     *  list is left empty.
+     */
+    list(list<T, Alloc> &&x) {
+        empty_initialize();
+        swap(x);
+    }
+
+    ~list() {
+        destroy_all(typename __alloc_traits<Alloc>::is_monotonic());
+        put_node(node);
+    }
+
+    list<T, Alloc> &operator=(const list<T, Alloc> &x) {
+        if (this != &x) {
+            clear();
+            for (const_iterator it = x.begin(); it != x.end(); ++it)
+                push_back(*it);
+        }
+        return *this;
+    }
+
+    list<T, Alloc> &operator=(list<T, Alloc> &&x) {
+        if (this != &x) {
+            clear();
+            swap(x);
+        }
+        return *this;
+    }
+
+    void swap(list<T, Alloc> &x) {
+        std::swap(node, x.node);
+        std::swap(length, x.length);
+    }
+
     iterator begin() { return (link_type) ((*node).next); }
+    const_iterator begin() const { return (link_type) ((*node).next); }
 
     iterator end() { return node; }
+    const_iterator end() const { return node; }
 
     bool empty() const { return node->next == node; }
 
-    size_t size() const {
-        size_t result = 0;
-        distance(begin(), end(), result);    // whole scale function
-        return result;
-    }
+    size_type size() const { return length;  }
 
     reference front() { return *begin(); }
 
     reference back() { return *(--end()); }    // does reference here not defined?
 
-    iterator insert(iterator position, const T &x) {
-        link_type tmp = create_node(x);
+    template <class... Args>
+    iterator emplace(iterator position, Args&&... args) {
+        link_type tmp = create_node(std::forward<Args>(args)...);
         tmp->next = position.node;
         tmp->prev = position.node->prev;
         (link_type(position.node->prev))->next = tmp;
         position.node->prev = tmp;
+        ++length;
         return tmp;
     }
 
+    iterator insert(iterator position, const T &x) {    return emplace(position, x);    }
+    iterator insert(iterator position, T &&x) { return emplace(position, std::move(x)); }
+
     iterator erase(iterator position) {
         link_type prev_node = (link_type)position.node->prev;
         link_type next_node = (link_type)position.node->next;
         prev_node->next = next_node;
         next_node->prev = prev_node;
         destroy_node(position.node);
+        --length;
         return iterator(next_node);
     }
 
+protected:
+    /*
+     *  moves [first, last) before position by relinking, O(1). the
+     *  lengths are left to the caller.
+     */
     void transfer(iterator position, iterator first, iterator last) {
-        if(position != last) {
-            (*(link_type((*last.node).prev))).next = position.node;
-            (*(link_type((*first.node).prev))).next = last.node;
-            (*(link_type((*position.node).prev))).next = first.node;
-            link_type tmp = (link_type)((*position.node).prev);
-            (*position.node).prev = (*last.node).prev;
-            (*last.node).prev = (*first.node).prev;
-            (*first.node).prev = tmp;
+        __list_transfer(position.node, first.node, last.node);
+    }
+
+public:
+    /*
+     *  the splices move nodes over with transfer(), nothing is copied or
+     *  allocated. they are O(1), except a range from another list, which
+     *  is counted for the lengths.
+     */
+    void splice(iterator position, list<T, Alloc> &x) {
+        if (!x.empty()) {
+            transfer(position, x.begin(), x.end());
+            length += x.length;
+            x.length = 0;
         }
     }
 
+    void splice(iterator position, list<T, Alloc> &x, iterator i) {
+        iterator j = i;
+        ++j;
+        if (position == i || position == j) return;
+        transfer(position, i, j);
+        ++length;
+        --x.length;
+    }
+
+    void splice(iterator position, list<T, Alloc> &x, iterator first, iterator last) {
+        if (first == last) return;
+        if (&x != this) {
+            size_type n = 0;
+            distance(first, last, n);
+            length += n;
+            x.length -= n;
+        }
+        transfer(position, first, last);
+    }
+
+    /*
+     *  unlinks the node at position and hands it out, O(1). inserting it
+     *  back, here or into another list with the same Alloc, links the
+     *  same node in again before position.
+     */
+    node_type extract(iterator position) {
+        link_type p = position.node;
+        (link_type(p->prev))->next = p->next;
+        (link_type(p->next))->prev = p->prev;
+        --length;
+        return node_type(p);
+    }
+
+    iterator insert(iterator position, node_type &&nh) {
+        if (nh.empty())
+            return position;
+        link_type tmp = nh.__release();
+        tmp->next = position.node;
+        tmp->prev = position.node->prev;
+        (link_type(position.node->prev))->next = tmp;
+        position.node->prev = tmp;
+        ++length;
+        return tmp;
+    }
+
     void push_front(const T &x) {   insert(begin(), x); }
+    void push_front(T &&x) {    insert(begin(), std::move(x));  }
     void push_back(const T &x) {    insert(end(), x);   }
+    void push_back(T &&x) { insert(end(), std::move(x));    }
+
+    template <class... Args>
+    void emplace_front(Args&&... args) {    emplace(begin(), std::forward<Args>(args)...);  }
+    template <class... Args>
+    void emplace_back(Args&&... args) { emplace(end(), std::forward<Args>(args)...);    }
 
     void clear();
+
+    /*
+     *  empties the list like clear(), but in O(1) when Alloc is monotonic
+     *  and T is trivially destructible: the nodes stay in the arena until
+     *  the arena itself is released.
+     */
+    void release() {
+        destroy_all(typename __alloc_traits<Alloc>::is_monotonic());
+        node->next = node;
+        node->prev = node;
+        length = 0;
+    }
+
     void remove(const T &value);
     void unique();
+
+    /*
+     *  both lists sorted, by operator< or comp: the nodes of x are
+     *  relinked into place through transfer(), x is left empty. stable,
+     *  an element of x goes after its equals here.
+     */
+    void merge(list<T, Alloc> &x) { merge(x, std::less<T>());  }
+    template <class StrictWeakOrdering>
+    void merge(list<T, Alloc> &x, StrictWeakOrdering comp);
+
+    /*
+     *  stable, O(n log n) compares, by operator< or comp. only the links
+     *  are rewritten: no element is copied or moved and nothing is
+     *  allocated.
+     */
+    void sort() {   sort(std::less<T>());  }
+    template <class StrictWeakOrdering>
+    void sort(StrictWeakOrdering comp);
+
+protected:
+    template <class StrictWeakOrdering>
+    static link_type __merge_runs(link_type a, link_type b, StrictWeakOrdering &comp);
 };
 
 template <class T, class Alloc>
@@ -214,6 +531,7 @@ void list<T, Alloc>::clear() {
 
     node->next = node;
     node->prev = node;
+    length = 0;
 };
 
 template <class T, class Alloc>
@@ -225,7 +543,7 @@ void list<T, Alloc>::remove(const T &value) {
         ++next;
         if(*first == value)
             erase(first);
-        first = last;
+        first = next;
     }
 }
 
@@ -244,4 +562,101 @@ void list<T, Alloc>::unique() {
     }
 }
 
+template <class T, class Alloc>
+template <class StrictWeakOrdering>
+void list<T, Alloc>::merge(list<T, Alloc> &x, StrictWeakOrdering comp) {
+    if (this == &x) return;
+    iterator first1 = begin();
+    iterator last1 = end();
+    iterator first2 = x.begin();
+    iterator last2 = x.end();
+    while (first1 != last1 && first2 != last2)
+        if (comp(*first2, *first1)) {
+            iterator next = first2;
+            transfer(first1, first2, ++next);
+            first2 = next;
+        }
+        else
+            ++first1;
+    if (first2 != last2)
+        transfer(last1, first2, last2);
+    length += x.length;
+    x.length = 0;
+}
+
+/*
+ *  a and b are runs chained through next alone and ended by 0, the
+ *  nodes of a came first. an equal from b goes after those of a.
+ */
+template <class T, class Alloc>
+template <class StrictWeakOrdering>
+typename list<T, Alloc>::link_type
+list<T, Alloc>::__merge_runs(link_type a, link_type b, StrictWeakOrdering &comp) {
+    void *head;
+    void **tail = &head;        // the links are void*, written as such
+    for (;;) {
+        if (comp(b->data, a->data)) {
+            *tail = b;
+            tail = &b->next;
+            if ((b = (link_type)b->next) == 0) {
+                *tail = a;
+                return (link_type)head;
+            }
+        }
+        else {
+            *tail = a;
+            tail = &a->next;
+            if ((a = (link_type)a->next) == 0) {
+                *tail = b;
+                return (link_type)head;
+            }
+        }
+    }
+}
+
+/*
+ *  bottom-up, like the sgi sort with its counter[64] lists, but the
+ *  counters are bare runs rather than lists, each of which would cost a
+ *  header node. bin[i] is empty or a sorted run of 2^i nodes, earlier
+ *  ones in higher bins. each node is carried in and merged up like a
+ *  binary increment, the bins are merged at the end, and the prev links
+ *  are rebuilt in one last pass.
+ */
+template <class T, class Alloc>
+template <class StrictWeakOrdering>
+void list<T, Alloc>::sort(StrictWeakOrdering comp) {
+    if (length < 2) return;
+
+    link_type bin[64];
+    int fill = 0;
+    link_type cur = (link_type)node->next;
+    ((link_type)node->prev)->next = 0;
+    while (cur != 0) {
+        link_type carry = cur;
+        cur = (link_type)cur->next;
+        carry->next = 0;
+        int i = 0;
+        for (; i < fill && bin[i] != 0; ++i) {
+            carry = __merge_runs(bin[i], carry, comp);
+            bin[i] = 0;
+        }
+        bin[i] = carry;
+        if (i == fill) ++fill;
+    }
+
+    link_type run = 0;
+    for (int i = 0; i < fill; ++i)
+        if (bin[i] != 0)
+            run = run == 0 ? bin[i] : __merge_runs(bin[i], run, comp);
+
+    link_type prev = node;
+    for (link_type p = run; p != 0; p = (link_type)p->next) {
+        p->prev = prev;
+        prev = p;
+    }
+    node->next = run;
+    prev->next = node;
+    node->prev = prev;
+}
+
 #endif
\ No newline at end of file
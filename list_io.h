@@ -0,0 +1,440 @@
+#ifndef LIST_LIST_IO_H
+#define LIST_LIST_IO_H
+
+/*
+ *  saving a list to a file descriptor or a buffer and loading it back,
+ *  for checkpoints of list-based queues.
+ *
+ *      list_writer out(fd);            // or list_writer out(&string)
+ *      save_list(out, l);
+ *      out.flush();
+ *      ...
+ *      list_reader in(fd);             // or list_reader in(data, size)
+ *      load_list(in, l);               // appended at the end of l
+ *
+ *  a saved list is a header (magic, byte order, version, the element
+ *  size, count) and then the elements. a trivially copyable T is stored
+ *  as its bytes, fixed width: small elements are copied into the
+ *  writer's buffer, elements of __list_io_direct bytes or more are
+ *  handed to writev() where they lie in their nodes and read back with
+ *  readv() straight into new nodes. any other T is written by a put the
+ *  caller gives, put(out, x), and read back by get(in), which returns
+ *  the element; the header then has element size 0.
+ *
+ *  the writer gathers its output into up to __list_io_iov iovecs and
+ *  writes them with one writev() per chunk; the reader reads in chunks
+ *  of its buffer. several lists, or anything else, can follow each other
+ *  through one writer and one reader.
+ *
+ *  a load takes its nodes from Alloc __list_io_batch at a time, through
+ *  __batch_alloc, and links them as they are filled, onto a list of its
+ *  own that is spliced onto l at the end, so a short or malformed stream
+ *  throws runtime_error and leaves l as it was.
+ */
+
+#include "library.h"
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+enum { __list_io_version = 1 };
+enum { __list_io_iov = 64 };            // iovecs per writev()
+enum { __list_io_buffer = 1 << 16 };
+enum { __list_io_direct = 256 };        // elements this big are not copied
+enum { __list_io_batch = 256 };         // nodes allocated at a time
+
+struct __list_io_header {
+    char magic[8];              // "listio\0\0"
+    uint32_t byte_order;        // 0x01020304 as the writer stored it
+    uint32_t version;
+    uint64_t element_size;      // 0 when written by the caller's put
+    uint64_t count;
+};
+
+static const char __list_io_magic[8] = { 'l', 'i', 's', 't', 'i', 'o', 0, 0 };
+
+
+/*
+ *  buffered output to a file descriptor or appended to a string. put()
+ *  copies, so the caller's bytes can go as soon as it returns. what is
+ *  not yet written goes out with flush(), or when the writer is
+ *  destroyed, where an error is lost.
+ */
+class list_writer {
+public:
+    explicit list_writer(int f) : fd(f), str(0), used(0), iovcnt(0) {  }
+    explicit list_writer(std::string *s) : fd(-1), str(s), used(0), iovcnt(0) {  }
+
+    ~list_writer() {
+        try {
+            flush();
+        }
+        catch (...) {   }
+    }
+
+    void put(const void *p, size_t n) {
+        const char *from = (const char*)p;
+        while (n != 0) {
+            if (used == sizeof buffer || iovcnt == __list_io_iov)
+                flush();
+            size_t k = n < sizeof buffer - used ? n : sizeof buffer - used;
+            memcpy(buffer + used, from, k);
+            if (iovcnt != 0 && (char*)iov[iovcnt - 1].iov_base + iov[iovcnt - 1].iov_len == buffer + used)
+                iov[iovcnt - 1].iov_len += k;
+            else
+                add(buffer + used, k);
+            used += k;
+            from += k;
+            n -= k;
+        }
+    }
+
+    template <class U>
+    void put(const U &x) {
+        static_assert(std::is_trivially_copyable<U>::value, "put(x) writes the bytes of x");
+        put(&x, sizeof x);
+    }
+
+    void flush();
+
+private:
+    template <class, class> friend struct __list_io;
+
+    list_writer(const list_writer &);
+    list_writer &operator=(const list_writer &);
+
+    int fd;
+    std::string *str;
+    size_t used;
+    int iovcnt;
+    struct iovec iov[__list_io_iov];
+    char buffer[__list_io_buffer];
+
+    void add(const void *p, size_t n) {
+        iov[iovcnt].iov_base = (void*)p;
+        iov[iovcnt].iov_len = n;
+        ++iovcnt;
+    }
+
+    /*
+     *  n bytes at p by reference: they have to stay as they are until
+     *  the next flush().
+     */
+    void put_ref(const void *p, size_t n) {
+        if (iovcnt == __list_io_iov)
+            flush();
+        add(p, n);
+    }
+};
+
+inline void list_writer::flush() {
+    struct iovec *v = iov;
+    int cnt = iovcnt;
+    used = 0;
+    iovcnt = 0;
+    if (str != 0) {
+        for (int i = 0; i < cnt; ++i)
+            str->append((const char*)v[i].iov_base, v[i].iov_len);
+        return;
+    }
+    while (cnt != 0) {
+        ssize_t done = writev(fd, v, cnt);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            throw std::runtime_error("list_io: write failed");
+        while (cnt != 0 && (size_t)done >= v->iov_len) {
+            done -= (ssize_t)v->iov_len;
+            ++v;
+            --cnt;
+        }
+        if (cnt != 0) {
+            v->iov_base = (char*)v->iov_base + done;
+            v->iov_len -= (size_t)done;
+        }
+    }
+}
+
+
+/*
+ *  buffered input from a file descriptor, or from bytes in memory that
+ *  have to stay there while the reader is used. a read past the end
+ *  throws runtime_error. from a descriptor the reader may read ahead of
+ *  what it has been asked for, so whatever follows is read through the
+ *  same reader.
+ */
+class list_reader {
+public:
+    explicit list_reader(int f) : fd(f), next(buffer), last(buffer) {  }
+    list_reader(const void *data, size_t size)
+            : fd(-1), next((const char*)data), last((const char*)data + size) {  }
+
+    void get(void *p, size_t n) {
+        char *to = (char*)p;
+        while (n != 0) {
+            if (next == last) {
+                if (n >= sizeof buffer && fd >= 0) {
+                    struct iovec v;
+                    v.iov_base = to;
+                    v.iov_len = n;
+                    read_in(&v, 1);
+                    return;
+                }
+                fill();
+            }
+            size_t k = n < (size_t)(last - next) ? n : (size_t)(last - next);
+            memcpy(to, next, k);
+            next += k;
+            to += k;
+            n -= k;
+        }
+    }
+
+    template <class U>
+    void get(U &x) {
+        static_assert(std::is_trivially_copyable<U>::value, "get(x) reads the bytes of x");
+        get(&x, sizeof x);
+    }
+
+private:
+    template <class, class> friend struct __list_io;
+
+    list_reader(const list_reader &);
+    list_reader &operator=(const list_reader &);
+
+    int fd;
+    const char *next;
+    const char *last;
+    char buffer[__list_io_buffer];
+
+    static void short_read() {  throw std::runtime_error("list_io: unexpected end of input");  }
+
+    void fill() {
+        if (fd < 0)
+            short_read();
+        for (;;) {
+            ssize_t done = read(fd, buffer, sizeof buffer);
+            if (done < 0 && errno == EINTR)
+                continue;
+            if (done <= 0)
+                short_read();
+            next = buffer;
+            last = buffer + done;
+            return;
+        }
+    }
+
+    /*
+     *  fills cnt iovecs, from what is buffered first and then with
+     *  readv() straight from the descriptor. v is used up on the way.
+     */
+    void getv(struct iovec *v, int cnt) {
+        while (cnt != 0 && next != last) {
+            size_t k = v->iov_len < (size_t)(last - next) ? v->iov_len : (size_t)(last - next);
+            memcpy(v->iov_base, next, k);
+            next += k;
+            v->iov_base = (char*)v->iov_base + k;
+            v->iov_len -= k;
+            if (v->iov_len == 0) {
+                ++v;
+                --cnt;
+            }
+        }
+        if (cnt != 0) {
+            if (fd < 0)
+                short_read();
+            read_in(v, cnt);
+        }
+    }
+
+    void read_in(struct iovec *v, int cnt) {
+        while (cnt != 0) {
+            ssize_t done = readv(fd, v, cnt);
+            if (done < 0 && errno == EINTR)
+                continue;
+            if (done <= 0)
+                short_read();
+            while (cnt != 0 && (size_t)done >= v->iov_len) {
+                done -= (ssize_t)v->iov_len;
+                ++v;
+                --cnt;
+            }
+            if (cnt != 0) {
+                v->iov_base = (char*)v->iov_base + done;
+                v->iov_len -= (size_t)done;
+            }
+        }
+    }
+};
+
+
+/*
+ *  the part that needs the inside of list: loading builds the nodes
+ *  itself.
+ */
+template <class T, class Alloc>
+struct __list_io {
+    typedef list<T, Alloc> list_type;
+    typedef typename list_type::link_type link_type;
+    typedef typename list_type::list_node list_node;
+    typedef typename list_type::list_node_allocator list_node_allocator;
+
+    static void put_header(list_writer &out, uint64_t element_size, uint64_t count) {
+        __list_io_header h;
+        memset(&h, 0, sizeof h);
+        memcpy(h.magic, __list_io_magic, sizeof h.magic);
+        h.byte_order = 0x01020304;
+        h.version = __list_io_version;
+        h.element_size = element_size;
+        h.count = count;
+        out.put(h);
+    }
+
+    static uint64_t get_header(list_reader &in, uint64_t element_size) {
+        __list_io_header h;
+        in.get(h);
+        if (memcmp(h.magic, __list_io_magic, sizeof h.magic) != 0)
+            throw std::runtime_error("list_io: not a saved list");
+        if (h.byte_order != 0x01020304 || h.version != __list_io_version)
+            throw std::runtime_error("list_io: byte order or version does not match");
+        if (h.element_size != element_size)
+            throw std::runtime_error("list_io: element size does not match");
+        return h.count;
+    }
+
+    /*
+     *  links nodes[0, n) at the end of l, in one pass.
+     */
+    static void link_back(list_type &l, link_type *nodes, size_t n) {
+        link_type prev = (link_type)l.node->prev;
+        for (size_t i = 0; i < n; ++i) {
+            prev->next = nodes[i];
+            nodes[i]->prev = prev;
+            prev = nodes[i];
+        }
+        prev->next = l.node;
+        l.node->prev = prev;
+        l.length += n;
+    }
+
+    static void save(list_writer &out, const list_type &l) {
+        put_header(out, sizeof(T), l.size());
+        typename list_type::const_iterator it = l.begin();
+        if (sizeof(T) < (size_t)__list_io_direct) {
+            for (; it != l.end(); ++it)
+                out.put(&*it, sizeof(T));
+        }
+        else {
+            for (; it != l.end(); ++it)
+                out.put_ref(&*it, sizeof(T));
+            out.flush();
+        }
+    }
+
+    /*
+     *  a trivially copyable T has a trivial destructor, so the nodes are
+     *  linked before they are read into and a short read leaves nothing
+     *  to undo but the nodes themselves.
+     */
+    static void load(list_reader &in, list_type &l) {
+        uint64_t n = get_header(in, sizeof(T));
+        list_type tmp;
+        link_type nodes[__list_io_batch];
+        struct iovec iov[__list_io_batch];
+        while (n != 0) {
+            size_t k = n < (uint64_t)__list_io_batch ? (size_t)n : (size_t)__list_io_batch;
+            list_node_allocator::allocate_batch(nodes, k);
+            link_back(tmp, nodes, k);
+            if (sizeof(T) < (size_t)__list_io_direct) {
+                for (size_t i = 0; i < k; ++i)
+                    in.get(&nodes[i]->data, sizeof(T));
+            }
+            else {
+                for (size_t i = 0; i < k; ++i) {
+                    iov[i].iov_base = &nodes[i]->data;
+                    iov[i].iov_len = sizeof(T);
+                }
+                in.getv(iov, (int)k);
+            }
+            n -= k;
+        }
+        l.splice(l.end(), tmp);
+    }
+
+    template <class Put>
+    static void save(list_writer &out, const list_type &l, Put &put) {
+        put_header(out, 0, l.size());
+        for (typename list_type::const_iterator it = l.begin(); it != l.end(); ++it)
+            put(out, *it);
+    }
+
+    /*
+     *  the nodes of a batch not built yet, given back if get() throws.
+     *  each one is linked as soon as its element is built.
+     */
+    struct spare {
+        link_type *first;
+        link_type *last;
+        ~spare() {
+            for (; first != last; ++first)
+                list_node_allocator::deallocate(*first);
+        }
+    };
+
+    template <class Get>
+    static void load(list_reader &in, list_type &l, Get &get) {
+        uint64_t n = get_header(in, 0);
+        list_type tmp;
+        link_type nodes[__list_io_batch];
+        while (n != 0) {
+            size_t k = n < (uint64_t)__list_io_batch ? (size_t)n : (size_t)__list_io_batch;
+            list_node_allocator::allocate_batch(nodes, k);
+            spare s = { nodes, nodes + k };
+            for (; s.first != s.last; ++s.first) {
+                construct(&(*s.first)->data, get(in));
+                link_back(tmp, s.first, 1);
+            }
+            n -= k;
+        }
+        l.splice(l.end(), tmp);
+    }
+};
+
+
+/*
+ *  a trivially copyable T, as its bytes.
+ */
+template <class T, class Alloc>
+inline void save_list(list_writer &out, const list<T, Alloc> &l) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "a T that is not trivially copyable needs a put and a get");
+    __list_io<T, Alloc>::save(out, l);
+}
+
+template <class T, class Alloc>
+inline void load_list(list_reader &in, list<T, Alloc> &l) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "a T that is not trivially copyable needs a put and a get");
+    __list_io<T, Alloc>::load(in, l);
+}
+
+/*
+ *  any T: put(out, x) writes x, get(in) reads one back and returns it.
+ */
+template <class T, class Alloc, class Put>
+inline void save_list(list_writer &out, const list<T, Alloc> &l, Put put) {
+    __list_io<T, Alloc>::save(out, l, put);
+}
+
+template <class T, class Alloc, class Get>
+inline void load_list(list_reader &in, list<T, Alloc> &l, Get get) {
+    __list_io<T, Alloc>::load(in, l, get);
+}
+
+#endif //LIST_LIST_IO_H
@@ -25,15 +25,43 @@
 #include "library.h"    // for iterator_tag
 #include <utility>
 #include <functional>
+#include <iterator>
+#include <tuple>
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <vector>
+#include <algorithm>
 
 /*
- *  select1st implementation is under sgi, and defined only in GNU CPP,
- *      there is an equivalent solution from stackoverflow.comG
+ *  select1st implementation is under sgi, and defined only in GNU CPP.
+ *      rb_tree takes KeyOfValue as a type and calls KeyOfValue()(v),
+ *      so it has to be a function object rather than a function.
  */
-#define AUTO_RETURN(...) ->decltype(__VA_ARGS__) {  return (__VA_ARGS__);   }
+template <class Pair>
+struct select1st {
+    const typename Pair::first_type &operator()(const Pair &x) const {
+        return x.first;
+    }
+};
+
+/*
+ *  the KeyOfValue of trees whose values are their own keys (sets).
+ */
+template <class T>
+struct identity {
+    const T &operator()(const T &x) const {
+        return x;
+    }
+};
 
-template <typename Pair>
-auto select1st() AUTO_RETURN(std::bind( &Pair::first, std::placeholders::_1 ))
+
+/*
+ *  tag for the constructors that take a range already sorted by the
+ *  comparator and free of duplicate keys, so it is not checked.
+ */
+struct sorted_unique_t {    };
+const sorted_unique_t sorted_unique = sorted_unique_t();
 
 
 /*
@@ -59,15 +87,81 @@ typedef bool  __rb_tree_color_type;
 const __rb_tree_color_type __rb_tree_red = false;
 const __rb_tree_color_type __rb_tree_black = true;
 
+/*
+ *  the node base is rb_tree's node policy. the algorithms below are
+ *  templates over it and only reach parent and color through
+ *  get_/set_ members, so a base is free to store them as it likes.
+ *  left and right stay plain members. root_link() is the header's
+ *  parent field as a reference, which is where the tree keeps its root.
+ *
+ *  a base may also keep data about its whole subtree. update()
+ *  recomputes that from the children and is called bottom-up wherever
+ *  the shape changes. when augmented is __true_type, insert and erase
+ *  also run it along the path to the root. for the plain bases it does
+ *  nothing and the path walk is compiled out.
+ */
 struct __rb_tree_node_base {
     typedef __rb_tree_color_type color_type;
     typedef __rb_tree_node_base *base_ptr;
+    typedef __false_type augmented;
 
     color_type color; // the node's color
     base_ptr parent;
     base_ptr left;
     base_ptr right;
 
+    base_ptr get_parent() const { return parent;    }
+    void set_parent(base_ptr p) { parent = p;   }
+    color_type get_color() const { return color;    }
+    void set_color(color_type c) { color = c;   }
+    void set_parent_and_color(base_ptr p, color_type c) {   parent = p; color = c;  }
+    base_ptr &root_link() { return parent;  }
+    void update() {  }
+
+    static base_ptr minimum(base_ptr x) {
+        while(x->left != 0) x = x->left;
+        return x;
+    }
+
+    static base_ptr maximum(base_ptr x) {
+        while(x->right != 0) x = x->right;
+        return x;
+    }
+};
+
+/*
+ *  the compact links: nodes are at least pointer aligned, so the low
+ *  bit of parent is always 0 and can carry the color instead of a bool
+ *  padded out to 8 bytes. that is 24 bytes of links per node instead
+ *  of 32. Base is the node base built on them.
+ *
+ *  red is 0, and the header is always red, so the header's field holds
+ *  the root untagged and root_link() can hand it out as it is.
+ */
+template <class Base>
+struct __rb_tree_compact_links {
+    typedef __rb_tree_color_type color_type;
+    typedef Base *base_ptr;
+
+    base_ptr tagged_parent;     // parent | color
+    base_ptr left;
+    base_ptr right;
+
+    base_ptr get_parent() const {
+        return (base_ptr)((uintptr_t)tagged_parent & ~(uintptr_t)1);
+    }
+    void set_parent(base_ptr p) {
+        tagged_parent = (base_ptr)((uintptr_t)p | ((uintptr_t)tagged_parent & 1));
+    }
+    color_type get_color() const { return (uintptr_t)tagged_parent & 1;    }
+    void set_color(color_type c) {
+        tagged_parent = (base_ptr)(((uintptr_t)tagged_parent & ~(uintptr_t)1) | (uintptr_t)c);
+    }
+    void set_parent_and_color(base_ptr p, color_type c) {
+        tagged_parent = (base_ptr)((uintptr_t)p | (uintptr_t)c);
+    }
+    base_ptr &root_link() { return tagged_parent;   }
+
     static base_ptr minimum(base_ptr x) {
         while(x->left != 0) x = x->left;
         return x;
@@ -79,100 +173,343 @@ struct __rb_tree_node_base {
     }
 };
 
+struct __rb_tree_compact_node_base
+        : public __rb_tree_compact_links<__rb_tree_compact_node_base> {
+    typedef __false_type augmented;
+
+    void update() {  }
+};
+
+/*
+ *  the order statistic policy: compact links plus the number of nodes
+ *  in the subtree, which gives rb_tree rank(), nth() and distance() in
+ *  O(log n).
+ */
+struct __rb_tree_order_node_base
+        : public __rb_tree_compact_links<__rb_tree_order_node_base> {
+    typedef __true_type augmented;
+
+    size_t size;    // nodes in the subtree rooted here
+
+    static size_t size_of(const __rb_tree_order_node_base *x) { return x ? x->size : 0;  }
+    void update() { size = size_of(left) + size_of(right) + 1;  }
+};
+
+typedef __rb_tree_compact_node_base rb_compact_node;
+typedef __rb_tree_order_node_base rb_order_node;
+
+/*
+ *  after a change below x, brings the augmented data of x and of every
+ *  ancestor up to the root back up to date.
+ */
+template <class NodeBase>
+inline void __rb_tree_update_path(NodeBase*, NodeBase*, __false_type) {    }
+
+template <class NodeBase>
+inline void __rb_tree_update_path(NodeBase* x, NodeBase* root, __true_type) {
+    for (;;) {
+        x->update();
+        if (x == root) break;
+        x = x->get_parent();
+    }
+}
+
+template <class NodeBase>
 inline void
-__rb_tree_rotate_left(__rb_tree_node_base* x, __rb_tree_node_base* &root) {
-    __rb_tree_node_base* y = x->right;
+__rb_tree_rotate_left(NodeBase* x, NodeBase* &root) {
+    NodeBase* y = x->right;
     x->right = y->left;
     if (y->left != 0)
-        y->left->parent = x;
-    y->parent = x->parent;
+        y->left->set_parent(x);
+    y->set_parent(x->get_parent());
 
     if (x == root)
         root = y;
-    else if (x == x->parent->parent)
-        x->parent->left = y;
+    else if (x == x->get_parent()->left)
+        x->get_parent()->left = y;
     else
-        x->parent->right = y;
+        x->get_parent()->right = y;
     y->left = x;
-    x->parent = y;
+    x->set_parent(y);
+    x->update();
+    y->update();
 }
 
+template <class NodeBase>
 inline void
-__rb_tree_rotate_right(__rb_tree_node_base* x, __rb_tree_node_base* &root) {
-    __rb_tree_node_base* y = x->left;
+__rb_tree_rotate_right(NodeBase* x, NodeBase* &root) {
+    NodeBase* y = x->left;
     x->left = y->right;
     if (y->right != 0)
-        y->right->parent = x;
-    y->parent = x->parent;
+        y->right->set_parent(x);
+    y->set_parent(x->get_parent());
 
     if (x == root)
         root = y;
-    else if (x == x->parent->right)
-        x->parent->right = y;
+    else if (x == x->get_parent()->right)
+        x->get_parent()->right = y;
     else
-        x->parent->left = y;
+        x->get_parent()->left = y;
     y->right = x;
-    x->parent = y;
+    x->set_parent(y);
+    x->update();
+    y->update();
 }
 
 
+template <class NodeBase>
 inline void
-__rb_tree_rebalance(__rb_tree_node_base *x, __rb_tree_node_base* &root) {
-    x->color = __rb_tree_red;
-    while (x != root && x->parent->color == __rb_tree_red) {
-        if (x->parent == x->parent->parent->right) {
-            __rb_tree_node_base* y = x->parent->parent->right;
-            if (y && y->color == __rb_tree_red) {
-                x->parent->color = __rb_tree_black;
-                y->color = __rb_tree_black;
-                x->parent->parent->color = __rb_tree_red;
-                x = x->parent->parent;
+__rb_tree_rebalance(NodeBase *x, NodeBase* &root) {
+    x->set_color(__rb_tree_red);
+    while (x != root && x->get_parent()->get_color() == __rb_tree_red) {
+        if (x->get_parent() == x->get_parent()->get_parent()->left) {
+            NodeBase* y = x->get_parent()->get_parent()->right;
+            if (y && y->get_color() == __rb_tree_red) {
+                x->get_parent()->set_color(__rb_tree_black);
+                y->set_color(__rb_tree_black);
+                x->get_parent()->get_parent()->set_color(__rb_tree_red);
+                x = x->get_parent()->get_parent();
             }
             else {
-                if (x == x->parent->right) {
-                    x = x->parent;
+                if (x == x->get_parent()->right) {
+                    x = x->get_parent();
                     __rb_tree_rotate_left(x, root);
                 }
-                x->parent->color = __rb_tree_black;
-                x->parent->parent->color = __rb_tree_red;
-                __rb_tree_rotate_right(x->parent->parent, root);
+                x->get_parent()->set_color(__rb_tree_black);
+                x->get_parent()->get_parent()->set_color(__rb_tree_red);
+                __rb_tree_rotate_right(x->get_parent()->get_parent(), root);
             }
         }
         else {
-            __rb_tree_node_base* y = x->parent->parent->left;
-            if (y && y->color == __rb_tree_red) {
-                x->parent->color == __rb_tree_black;
-                y->color = __rb_tree_black;
-                x->parent->parent->color = __rb_tree_red;
-                x = x->parent->parent;
+            NodeBase* y = x->get_parent()->get_parent()->left;
+            if (y && y->get_color() == __rb_tree_red) {
+                x->get_parent()->set_color(__rb_tree_black);
+                y->set_color(__rb_tree_black);
+                x->get_parent()->get_parent()->set_color(__rb_tree_red);
+                x = x->get_parent()->get_parent();
             }
             else {
-                if (x == x->parent->left) {
-                    x = x->parent;
+                if (x == x->get_parent()->left) {
+                    x = x->get_parent();
                     __rb_tree_rotate_right(x, root);
                 }
-                x->parent->color = __rb_tree_black;
-                x->parent->parent->color = __rb_tree_red;
-                __rb_tree_rotate_left(x->parent->parent, root);
+                x->get_parent()->set_color(__rb_tree_black);
+                x->get_parent()->get_parent()->set_color(__rb_tree_red);
+                __rb_tree_rotate_left(x->get_parent()->get_parent(), root);
+            }
+        }
+    }
+    root->set_color(__rb_tree_black);
+}
+
+/*
+ *  unlinks z from the tree and restores the red-black rules, from sgi.
+ *  if z has two children its successor y takes z's place (and color),
+ *  so the node really taken out of the shape is always one with at most
+ *  one child. returns z, ready to be destroyed.
+ */
+template <class NodeBase>
+inline NodeBase*
+__rb_tree_rebalance_for_erase(NodeBase *z,
+                              NodeBase* &root,
+                              NodeBase* &leftmost,
+                              NodeBase* &rightmost) {
+    NodeBase* y = z;
+    NodeBase* x = 0;
+    NodeBase* x_parent = 0;
+
+    if (y->left == 0)
+        x = y->right;
+    else if (y->right == 0)
+        x = y->left;
+    else {
+        y = y->right;
+        while (y->left != 0)
+            y = y->left;
+        x = y->right;
+    }
+
+    if (y != z) {       // relink y in place of z, y is z's successor
+        z->left->set_parent(y);
+        y->left = z->left;
+        if (y != z->right) {
+            x_parent = y->get_parent();
+            if (x) x->set_parent(y->get_parent());
+            y->get_parent()->left = x;
+            y->right = z->right;
+            z->right->set_parent(y);
+        }
+        else
+            x_parent = y;
+
+        if (root == z)
+            root = y;
+        else if (z->get_parent()->left == z)
+            z->get_parent()->left = y;
+        else
+            z->get_parent()->right = y;
+        y->set_parent(z->get_parent());
+        __rb_tree_color_type c = y->get_color();
+        y->set_color(z->get_color());
+        z->set_color(c);
+        y = z;          // y now points to node to be actually deleted
+    }
+    else {
+        x_parent = y->get_parent();
+        if (x) x->set_parent(y->get_parent());
+        if (root == z)
+            root = x;
+        else if (z->get_parent()->left == z)
+            z->get_parent()->left = x;
+        else
+            z->get_parent()->right = x;
+
+        if (leftmost == z) {
+            if (z->right == 0)      // makes leftmost == header if z == root
+                leftmost = z->get_parent();
+            else
+                leftmost = NodeBase::minimum(x);
+        }
+        if (rightmost == z) {
+            if (z->left == 0)       // makes rightmost == header if z == root
+                rightmost = z->get_parent();
+            else
+                rightmost = NodeBase::maximum(x);
+        }
+    }
+
+    /*
+     *  everything from x_parent up has lost a node below it (y, when it
+     *  was moved up, is on that path too). with x_parent the header the
+     *  tree was z alone or z over a single child, and nothing is left
+     *  to update.
+     */
+    if (root != 0 && x_parent != root->get_parent())
+        __rb_tree_update_path(x_parent, root, typename NodeBase::augmented());
+
+    if (y->get_color() != __rb_tree_red) {
+        while (x != root && (x == 0 || x->get_color() == __rb_tree_black)) {
+            if (x == x_parent->left) {
+                NodeBase* w = x_parent->right;
+                if (w->get_color() == __rb_tree_red) {
+                    w->set_color(__rb_tree_black);
+                    x_parent->set_color(__rb_tree_red);
+                    __rb_tree_rotate_left(x_parent, root);
+                    w = x_parent->right;
+                }
+                if ((w->left == 0 || w->left->get_color() == __rb_tree_black) &&
+                        (w->right == 0 || w->right->get_color() == __rb_tree_black)) {
+                    w->set_color(__rb_tree_red);
+                    x = x_parent;
+                    x_parent = x_parent->get_parent();
+                }
+                else {
+                    if (w->right == 0 || w->right->get_color() == __rb_tree_black) {
+                        if (w->left) w->left->set_color(__rb_tree_black);
+                        w->set_color(__rb_tree_red);
+                        __rb_tree_rotate_right(w, root);
+                        w = x_parent->right;
+                    }
+                    w->set_color(x_parent->get_color());
+                    x_parent->set_color(__rb_tree_black);
+                    if (w->right) w->right->set_color(__rb_tree_black);
+                    __rb_tree_rotate_left(x_parent, root);
+                    break;
+                }
+            }
+            else {          // same as above, with right <-> left
+                NodeBase* w = x_parent->left;
+                if (w->get_color() == __rb_tree_red) {
+                    w->set_color(__rb_tree_black);
+                    x_parent->set_color(__rb_tree_red);
+                    __rb_tree_rotate_right(x_parent, root);
+                    w = x_parent->left;
+                }
+                if ((w->right == 0 || w->right->get_color() == __rb_tree_black) &&
+                        (w->left == 0 || w->left->get_color() == __rb_tree_black)) {
+                    w->set_color(__rb_tree_red);
+                    x = x_parent;
+                    x_parent = x_parent->get_parent();
+                }
+                else {
+                    if (w->left == 0 || w->left->get_color() == __rb_tree_black) {
+                        if (w->right) w->right->set_color(__rb_tree_black);
+                        w->set_color(__rb_tree_red);
+                        __rb_tree_rotate_left(w, root);
+                        w = x_parent->left;
+                    }
+                    w->set_color(x_parent->get_color());
+                    x_parent->set_color(__rb_tree_black);
+                    if (w->left) w->left->set_color(__rb_tree_black);
+                    __rb_tree_rotate_right(x_parent, root);
+                    break;
+                }
             }
         }
+        if (x) x->set_color(__rb_tree_black);
     }
-    root->color = __rb_tree_black;
+    return y;
 }
 
-template <class Value>
-struct __rb_tree_node : public __rb_tree_node_base {
-    typedef __rb_tree_node<Value> *link_type;
+template <class Value, class NodeBase = __rb_tree_node_base>
+struct __rb_tree_node : public NodeBase {
+    typedef __rb_tree_node<Value, NodeBase> *link_type;
     Value value_field;
 };
 
+template <class Value, class NodeBase>
+inline Value &__node_value(__rb_tree_node<Value, NodeBase> *p) {  return p->value_field;    }
+
+/*
+ *  the aggregate policy: compact links plus a user defined summary of
+ *  the subtree's values, which gives rb_tree range_aggregate(lo, hi) in
+ *  O(log n). Aggregate is a function object class like KeyOfValue:
+ *
+ *      typedef R result_type;
+ *      R identity() const;                      the empty range
+ *      R measure(const Value &v) const;         a single value
+ *      R combine(const R &a, const R &b) const; a then b, associative
+ *
+ *  e.g. sums, min and max, or counts of values matching a predicate.
+ *  combine need not commute, values are always combined in order. the
+ *  node bases are never constructed, only assigned, so R has to be
+ *  trivially copyable.
+ */
+template <class Value, class Aggregate>
+struct __rb_tree_aggregate_node_base
+        : public __rb_tree_compact_links<__rb_tree_aggregate_node_base<Value, Aggregate> > {
+    typedef __true_type augmented;
+    typedef Aggregate aggregate_functor;
+    typedef typename Aggregate::result_type aggregate_type;
+    typedef __rb_tree_node<Value, __rb_tree_aggregate_node_base<Value, Aggregate> > node_type;
+
+    static_assert(std::is_trivially_copyable<aggregate_type>::value,
+                  "the aggregate of a node is assigned, never constructed");
+
+    aggregate_type aggregate;   // of the subtree rooted here, in order
+
+    void update() {
+        Aggregate a;
+        aggregate_type r = a.measure(static_cast<node_type*>(this)->value_field);
+        if (this->left)
+            r = a.combine(this->left->aggregate, r);
+        if (this->right)
+            r = a.combine(r, this->right->aggregate);
+        aggregate = r;
+    }
+};
+
+template <class Value, class Aggregate>
+using rb_aggregate_node = __rb_tree_aggregate_node_base<Value, Aggregate>;
+
 /*
  *  rb-tree iterators are bidirectional but not random
  *  accessible.
  */
 
-struct __rb_tree_base_iterator {
-    typedef __rb_tree_node_base::base_ptr base_ptr;
+template <class NodeBase>
+struct __rb_tree_iterator_base {
+    typedef NodeBase *base_ptr;
     typedef bidirectional_iterator_tag iterator_category;
     typedef ptrdiff_t difference_type;
 
@@ -185,10 +522,10 @@ struct __rb_tree_base_iterator {
                 node = node->left;
         }
         else {
-            base_ptr y = node->parent;
+            base_ptr y = node->get_parent();
             while (node == y->right) {
                 node = y;
-                y = y->parent;
+                y = y->get_parent();
             }
             if(node->right != y) // TODO why here is an if-sentence judge
                 node = y;
@@ -196,8 +533,8 @@ struct __rb_tree_base_iterator {
     }
 
     void decrement() {
-        if(node->color == __rb_tree_red &&
-                node->parent->parent == node)
+        if(node->get_color() == __rb_tree_red &&
+                node->get_parent()->get_parent() == node)
             node = node->right;
         // case takes place in when node is header
         else if (node->left != 0) {
@@ -206,10 +543,10 @@ struct __rb_tree_base_iterator {
             node = y;
         }
         else{
-            base_ptr y = node->parent;
+            base_ptr y = node->get_parent();
             while(node == y->left) {
                 node = y;
-                y = y->parent;
+                y = y->get_parent();
             }
             node = y;
         }
@@ -217,15 +554,22 @@ struct __rb_tree_base_iterator {
 };
 
 
-template <class Value, class Ref, class Ptr>
-struct __rb_tree_iterator : public __rb_tree_base_iterator {
+typedef __rb_tree_iterator_base<__rb_tree_node_base> __rb_tree_base_iterator;
+
+
+template <class Value, class Ref, class Ptr, class NodeBase = __rb_tree_node_base>
+struct __rb_tree_iterator : public __rb_tree_iterator_base<NodeBase> {
     typedef Value value_type;
     typedef Ref reference;
     typedef Ptr pointer;
-    typedef __rb_tree_iterator<Value, Value&, Value*> iterator;
-    typedef __rb_tree_iterator<Value, const Value&, const Value*> const_iterator;
-    typedef __rb_tree_iterator<Value, Ref, Ptr> self;
-    typedef __rb_tree_node<Value> *link_type;
+    typedef __rb_tree_iterator<Value, Value&, Value*, NodeBase> iterator;
+    typedef __rb_tree_iterator<Value, const Value&, const Value*, NodeBase> const_iterator;
+    typedef __rb_tree_iterator<Value, Ref, Ptr, NodeBase> self;
+    typedef __rb_tree_node<Value, NodeBase> *link_type;
+
+    using __rb_tree_iterator_base<NodeBase>::node;
+    using __rb_tree_iterator_base<NodeBase>::increment;
+    using __rb_tree_iterator_base<NodeBase>::decrement;
 
 
     __rb_tree_iterator() {  }
@@ -234,7 +578,8 @@ struct __rb_tree_iterator : public __rb_tree_base_iterator {
 
     reference operator*() const { return link_type(node)->value_field;  }
 
-    bool operator==(const self &v) { return node == v.node; }
+    bool operator==(const self &v) const { return node == v.node; }
+    bool operator!=(const self &v) const { return node != v.node; }
 
 #ifndef __SGI_STL_NO_ARROW_OPERATOR
     pointer operator->() const { return &(operator*()); }
@@ -256,12 +601,62 @@ struct __rb_tree_iterator : public __rb_tree_base_iterator {
 
 };
 
-template <class Key, class Value, class KeyOfValue, class Compare, class Alloc = alloc>
+/*
+ *  nodes dropped by the set operations, chained through left. they are
+ *  only collected there, and destroyed (or handed back) once the
+ *  recursion is over and back on the calling thread.
+ */
+template <class NodeBase>
+struct __rb_tree_node_list {
+    NodeBase *first;
+    NodeBase *last;
+    size_t n;
+
+    __rb_tree_node_list() : first(0), last(0), n(0) {  }
+
+    void push(NodeBase *x) {
+        x->left = 0;
+        if (last) last->left = x;
+        else first = x;
+        last = x;
+        ++n;
+    }
+
+    void push_subtree(NodeBase *x) {
+        while (x != 0) {
+            push_subtree(x->right);
+            NodeBase *y = x->left;
+            push(x);
+            x = y;
+        }
+    }
+
+    void splice(__rb_tree_node_list &x) {
+        if (x.first == 0) return;
+        if (last) last->left = x.first;
+        else first = x.first;
+        last = x.last;
+        n += x.n;
+        x.first = x.last = 0;
+        x.n = 0;
+    }
+};
+
+/*
+ *  the set operations hand a subproblem to another thread only when
+ *  the subtree of *this has at least this black height: 2^8 - 1 nodes
+ *  at the very least, several thousand in a tree grown by inserts.
+ */
+enum { __rb_tree_parallel_height = 8 };
+
+
+template <class Key, class Value, class KeyOfValue, class Compare = std::less<Key>, class Alloc = alloc,
+          class NodeBase = __rb_tree_node_base>
 class rb_tree {
 protected:
     typedef void *void_pointer;     // TODO any usage?
-    typedef __rb_tree_node_base *base_ptr;
-    typedef __rb_tree_node<Value> rb_tree_node;
+    typedef NodeBase *base_ptr;
+    typedef __rb_tree_node<Value, NodeBase> rb_tree_node;
     typedef simple_alloc<rb_tree_node, Alloc> rb_tree_node_allocator;
     typedef __rb_tree_color_type color_type;
 
@@ -278,12 +673,13 @@ public:
 
 protected:
     link_type get_node() { return rb_tree_node_allocator::allocate();   }
-    void put_node(link_type p) {    rb_tree_node_allocator::deallocate(p);  }
+    static void put_node(link_type p) {    rb_tree_node_allocator::deallocate(p);  }
 
-    link_type create_node(const value_type &x) {
+    template <class... Args>
+    link_type create_node(Args&&... args) {
         link_type tmp = get_node();
         __STL_TRY {     // TODO what is this tag and what does it work
-                construct(&tmp->value_field, x);
+                construct(&tmp->value_field, std::forward<Args>(args)...);
         }
         __STL_UNWIND(put_node(tmp));
         return tmp;
@@ -291,13 +687,13 @@ protected:
 
     link_type clone_node(link_type x) {
         link_type tmp = create_node(x->value_field);
-        tmp->color = x->color;
+        *(NodeBase*)tmp = *(NodeBase*)x;   // color and augmented data
         tmp->left = 0;
         tmp->right = 0;
         return tmp;
     }
 
-    void destroy_node(link_type p) {
+    static void destroy_node(link_type p) {
         destroy(&p->value_field);
         put_node(p);
     }
@@ -307,37 +703,37 @@ protected:
     link_type header;
     Compare key_compare; // function object
 
-    link_type &root() const { return (link_type&)header->parent;    }
-    link_type &leftmost() const { return (link_type&)header->left;  }
-    link_type &rightmost() const { return (link_type&)header->right;}
+    /*
+     *  the links are stored as base_ptr but handed out as link_type&.
+     *  writing a pointer through one type and reading it through the
+     *  other breaks strict aliasing, and at -O3 gcc really does reorder
+     *  them (a map of ten ints double-freed), so the references are
+     *  declared may_alias.
+     */
+    typedef link_type __attribute__((__may_alias__)) link_ref_type;
 
-    static link_type &left(link_type x) {
-        return (link_type&)(x->left);
-    }
-    static link_type &right(link_type x) {
-        return (link_type&)(x->right);
+    link_ref_type &root() const { return (link_ref_type&)header->root_link();  }
+    link_ref_type &leftmost() const { return (link_ref_type&)header->left;  }
+    link_ref_type &rightmost() const { return (link_ref_type&)header->right;}
+
+    static link_ref_type &left(link_type x) {
+        return (link_ref_type&)(x->left);
     }
-    static link_type  &parent(link_type x) {
-        return (link_type&)(x->parent);
+    static link_ref_type &right(link_type x) {
+        return (link_ref_type&)(x->right);
     }
-    static reference  &value(link_type x) {
-        return (link_type&)(x->value_field);
+    static reference value(link_type x) {
+        return x->value_field;
     }
     static const Key &key(link_type x) {
         return KeyOfValue()(value(x));      //TODO grammar issue
     }
-    static color_type  &color(link_type x) {
-        return (color_type&)(x->color);
-    }
 
-    static link_type  &left(base_ptr x) {
-        return (link_type&)(x->left);
-    }
-    static link_type  &right(base_ptr x) {
-        return (link_type&)(x->right);
+    static link_ref_type &left(base_ptr x) {
+        return (link_ref_type&)(x->left);
     }
-    static link_type  &parent(base_ptr x) {
-        return (link_type&)(x->parent);
+    static link_ref_type &right(base_ptr x) {
+        return (link_ref_type&)(x->right);
     }
     static reference value(base_ptr x) {
         return ((link_type)x)->value_field;
@@ -345,29 +741,94 @@ protected:
     static const Key &key(base_ptr x) {
         return KeyOfValue()(value(link_type(x)));
     }
-    static color_type &color(base_ptr x) {
-        return (color_type&)(link_type(x)->color);
-    }
 
     static link_type minimum(link_type x) {
-        return (link_type)__rb_tree_node_base::minimum(x);
+        return (link_type)NodeBase::minimum(x);
     }
     static link_type maximum(link_type x) {
-        return (link_type)__rb_tree_node_base::maximum(x);
+        return (link_type)NodeBase::maximum(x);
     }
 
 public:
-    typedef __rb_tree_iterator<value_type , reference , pointer > iterator;
+    typedef __rb_tree_iterator<value_type, reference, pointer, NodeBase> iterator;
+    typedef __rb_tree_iterator<value_type, const_reference, const_pointer, NodeBase> const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef __node_handle<rb_tree_node, Value, Alloc> node_type;
+    typedef __insert_return_type<iterator, node_type> insert_return_type;
 
 private:
-    iterator __insert(base_ptr x, base_ptr y, const value_type &v);
+    template <class... Args>
+    iterator __insert(base_ptr x, base_ptr y, Args&&... args) {
+        return __insert_node(x, y, create_node(std::forward<Args>(args)...));
+    }
+    iterator __insert_node(base_ptr x, base_ptr y, link_type z);
+    std::pair<base_ptr, base_ptr> __get_insert_unique_pos(const key_type &k);
+    base_ptr __get_insert_equal_pos(const key_type &k);
+    std::pair<base_ptr, base_ptr> __get_insert_hint_unique_pos(iterator position, const key_type &k);
+    std::pair<base_ptr, base_ptr> __get_insert_hint_equal_pos(iterator position, const key_type &k);
+    template <class Arg>
+    std::pair<iterator, bool> __insert_unique(Arg &&v);
+    template <class Arg>
+    iterator __insert_equal(Arg &&v) {
+        return __insert(0, __get_insert_equal_pos(KeyOfValue()(v)), std::forward<Arg>(v));
+    }
+    template <class Arg>
+    iterator __insert_unique(iterator position, Arg &&v) {
+        std::pair<base_ptr, base_ptr> pos = __get_insert_hint_unique_pos(position, KeyOfValue()(v));
+        if (pos.second != 0)
+            return __insert(pos.first, pos.second, std::forward<Arg>(v));
+        return iterator((link_type)pos.first);
+    }
+    template <class Arg>
+    iterator __insert_equal(iterator position, Arg &&v) {
+        std::pair<base_ptr, base_ptr> pos = __get_insert_hint_equal_pos(position, KeyOfValue()(v));
+        return __insert(pos.first, pos.second, std::forward<Arg>(v));
+    }
     link_type __copy(link_type x, link_type p);
-    void __erase(link_type x);
+    link_type __copy(link_type x, link_type p, int bh, unsigned threads);
+    static void __erase(link_type x);
+    static void __erase(link_type x, int bh, unsigned threads);
+    static unsigned __usable_threads(unsigned threads, __true_type /* is_thread_safe */) {
+        return threads;
+    }
+    static unsigned __usable_threads(unsigned, __false_type /* is_thread_safe */) {   return 1;   }
+
+    template <class InputIterator>
+    void __insert_unique_range(InputIterator first, InputIterator last, __false_type);
+    template <class ForwardIterator>
+    void __insert_unique_range(ForwardIterator first, ForwardIterator last, __true_type);
+    template <class ForwardIterator>
+    bool __is_sorted_unique(ForwardIterator first, ForwardIterator last, size_type &n) const;
+    template <class ForwardIterator>
+    void __build_sorted(ForwardIterator first, size_type n);
+    template <class ForwardIterator>
+    link_type __build_sorted(ForwardIterator &first, size_type n,
+                             size_type depth, size_type red_depth);
+
+    /*
+     *  like list's, ends the life of every value; with a monotonic Alloc
+     *  the nodes are left to the arena and, for trivially destructible
+     *  values, not visited at all.
+     */
+    void destroy_all(__false_type /* is_monotonic */) { clear(); }
+    void destroy_all(__true_type /* is_monotonic */) {
+        if (root() != 0)
+            destroy_values(root(), typename __type_traits<value_type>::has_trivial_destructor());
+    }
+    void destroy_values(link_type, __true_type /* has_trivial_destructor */) {  }
+    void destroy_values(link_type x, __false_type /* has_trivial_destructor */) {
+        while (x != 0) {
+            destroy_values(right(x), __false_type());
+            destroy(&x->value_field);
+            x = left(x);
+        }
+    }
+
     void init() {
         header = get_node();
-        color(header) = __rb_tree_red;
+        header->set_parent_and_color(0, __rb_tree_red);
 
-        root() = 0;
         leftmost() = header;
         rightmost() = header;
     }
@@ -375,6 +836,39 @@ private:
 public:
     explicit rb_tree(const Compare &comp = Compare())
             : node_count(0), key_compare(comp) {    init(); }
+
+    rb_tree(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &x)
+            : node_count(0), key_compare(x.key_compare) {
+        init();
+        if (x.root() != 0) {
+            __STL_TRY {
+                root() = __copy(x.root(), header);
+            }
+            __STL_UNWIND(put_node(header));
+            leftmost() = minimum(root());
+            rightmost() = maximum(root());
+            node_count = x.node_count;
+        }
+    }
+
+    /*
+     *  the copy with subtrees copied on threads of their own, see clear()
+     *  below.
+     */
+    rb_tree(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &x, unsigned threads)
+            : node_count(0), key_compare(x.key_compare) {
+        init();
+        if (x.root() != 0) {
+            threads = __usable_threads(threads, typename __alloc_traits<Alloc>::is_thread_safe());
+            __STL_TRY {
+                root() = __copy(x.root(), header, __black_height(x.root()), threads);
+            }
+            __STL_UNWIND(put_node(header));
+            leftmost() = minimum(root());
+            rightmost() = maximum(root());
+            node_count = x.node_count;
+        }
+    }
     /*
      * Clion suggests using explicit to this constructor because of
      *      its single-parameter constructor structure.
@@ -382,140 +876,1555 @@ public:
      *      explicit does not allow implicit cast or copy initialization.
      */
     ~rb_tree() {
-        clear();    //TODO where is clear()
+        destroy_all(typename __alloc_traits<Alloc>::is_monotonic());
         put_node(header);
     }
 
-    rb_tree<Key, Value, KeyOfValue, Compare, Alloc>&
-            operator=(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc> &x);
+    /*
+     *  a moved tree takes over the nodes by swapping headers, the source
+     *  is left empty. O(1), no node is copied.
+     */
+    rb_tree(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &&x)
+            : node_count(0), key_compare(x.key_compare) {
+        init();
+        swap(x);
+    }
+
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>&
+            operator=(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &x);
+
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>&
+            operator=(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &&x) {
+        if (this != &x) {
+            clear();
+            swap(x);
+        }
+        return *this;
+    }
 
 public:
     Compare key_comp() const { return key_compare;  }
     iterator begin() { return leftmost();   }
+    const_iterator begin() const { return leftmost();   }
     iterator end() { return header; }
+    const_iterator end() const { return header; }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
     bool empty() const { return node_count == 0;    }
     size_type size() const { return node_count; }
     size_type max_size() const { return size_type(-1);  } //TODO what is size_type(-1)
 
+    void swap(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &t) {
+        std::swap(header, t.header);
+        std::swap(node_count, t.node_count);
+        std::swap(key_compare, t.key_compare);
+    }
+
 public:
-    std::pair<iterator, bool> insert_unique(const value_type &v);
-    iterator insert_equal(const value_type &v);
+    std::pair<iterator, bool> insert_unique(const value_type &v) { return __insert_unique(v);   }
+    std::pair<iterator, bool> insert_unique(value_type &&v) { return __insert_unique(std::move(v));    }
+    iterator insert_equal(const value_type &v) {    return __insert_equal(v);   }
+    iterator insert_equal(value_type &&v) { return __insert_equal(std::move(v));    }
 
-};
+    /*
+     *  with a hint: if the value belongs right before position, or right
+     *  after it, it is linked there without a descent from the root. so
+     *  appending in key order with position == end() costs amortized O(1).
+     *  a wrong hint only costs the usual O(log n).
+     */
+    iterator insert_unique(iterator position, const value_type &v) {
+        return __insert_unique(position, v);
+    }
+    iterator insert_unique(iterator position, value_type &&v) {
+        return __insert_unique(position, std::move(v));
+    }
+    iterator insert_equal(iterator position, const value_type &v) {
+        return __insert_equal(position, v);
+    }
+    iterator insert_equal(iterator position, value_type &&v) {
+        return __insert_equal(position, std::move(v));
+    }
 
+    /*
+     *  emplace_* build the node from args first and only then look for
+     *  its place, a duplicate is destroyed again. emplace_unique_key takes
+     *  the key the args will produce and builds nothing if it is there.
+     */
+    template <class... Args>
+    std::pair<iterator, bool> emplace_unique(Args&&... args);
+    template <class... Args>
+    iterator emplace_hint_unique(iterator position, Args&&... args);
+    template <class... Args>
+    iterator emplace_equal(Args&&... args);
+    template <class... Args>
+    std::pair<iterator, bool> emplace_unique_key(const key_type &k, Args&&... args);
 
-template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::insert_equal(const value_type &v) {
-    link_type y = header;
-    link_type x = root();
-    while (x != 0) {
-        y = x;
-        x = key_compare(KeyOfValue()(v), key(x)) ? left(x) : right(x);
+    /*
+     *  into an empty tree, a forward range that turns out to be strictly
+     *  sorted is built directly in O(n) by __build_sorted; anything else
+     *  goes through insert_unique one by one.
+     */
+    template <class InputIterator>
+    void insert_unique(InputIterator first, InputIterator last) {
+        __insert_unique_range(first, last, typename __is_forward_iterator<InputIterator>::type());
     }
-    return __insert(x, y, v);
-}
 
-template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
-std::pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator, bool>
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::insert_unique(const value_type &v) {
-    link_type y = header;
-    link_type x = root();
-    bool comp = true;
-    while (x != 0) {
-        y = x;
-        comp = key_compare(KeyOfValue()(v), key(x));
-        x = comp ? left(x) : right(x);
+    /*
+     *  replaces the contents with [first, last), which must be sorted by
+     *  key_comp() (equal keys allowed). O(n), no comparisons at all.
+     */
+    template <class ForwardIterator>
+    void assign_sorted(ForwardIterator first, ForwardIterator last) {
+        clear();
+        size_type n = 0;
+        ::distance(first, last, n);
+        __build_sorted(first, n);
     }
 
-    iterator j = iterator(y);
-    if(comp)
-        if(j == begin())
-            return std::pair<iterator, bool >(__insert(x, y, v), true);
-        else
-            --j;
-    if (key_compare(key(j.node), KeyOfValue()(v)))
-        return std::pair<iterator, bool >(__insert(x, y, v), true);
+    template <class InputIterator>
+    void insert_equal(InputIterator first, InputIterator last) {
+        for ( ; first != last; ++first)
+            insert_equal(*first);
+    }
 
-    return std::pair<iterator, bool >(j, false);
-}
+    void erase(iterator position);
+    size_type erase(const key_type &x);
+    void erase(iterator first, iterator last);
+    void clear();
 
-/*!
- *
- * @tparam Key
- * @tparam Value
- * @tparam KeyOfValue
- * @tparam Compare
- * @tparam Alloc
- * @param x_ the new value inserting node location
- * @param y_ parent of x_
- * @param v new value
- * @return iterator pointing to new node
- */
+    /*
+     *  clearing a big tree without holding up its owner. with threads > 1
+     *  the two subtrees of a node above __rb_tree_parallel_height are
+     *  freed on threads of their own, as the set operations split their
+     *  work, and so are the copies of the constructor above. the values
+     *  are destroyed (or copied) on those threads, and Alloc has to take
+     *  calls from any thread (is_thread_safe in __alloc_traits, as
+     *  malloc_alloc and mt_pool_alloc do); with any other the work stays
+     *  on the calling thread.
+     *
+     *  clear_async() empties the tree in O(log n) and leaves the nodes
+     *  to a thread of their own. the future is ready when they are all
+     *  gone: wait on it before whatever the values refer to goes away,
+     *  and before the program ends. a tree whose Alloc is not thread
+     *  safe is cleared right here and the future is ready at once.
+     */
+    void clear(unsigned threads);
+    std::future<void> clear_async(unsigned threads = 1);
 
-template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::
-__insert(base_ptr x_, base_ptr y_, const value_type &v) {
-    //link_type x = (link_type)x_;        //Clion warn: use auto when initializing with a cast to
-    //link_type y = (link_type)y_;        //      avoid duplicating type name
-    auto x = (link_type)x_;
-    auto y = (link_type)y_;
-    link_type z;
+    /*
+     *  node handles: extract unlinks a node the way erase does, but
+     *  hands it out instead of destroying it (an empty handle if k is
+     *  not there). inserting the handle links that very node into this
+     *  or another tree with the same Value, Alloc and NodeBase. the
+     *  augmented data is recomputed there, so the value may be changed
+     *  while the node is out.
+     */
+    node_type extract(iterator position);
+    node_type extract(const key_type &k) {
+        iterator it = find(k);
+        return it == end() ? node_type() : extract(it);
+    }
+    insert_return_type insert_unique(node_type &&nh);
+    iterator insert_unique(iterator position, node_type &&nh);
+    iterator insert_equal(node_type &&nh);
+    iterator insert_equal(iterator position, node_type &&nh);
 
-    if (y == header || x != 0 || key_compare(KeyOfValue()(v), key(y))) {
-        z = create_node(v);
-        left(y) = z;
-        if(y == header) {
-            root() = z;
-            rightmost() = z;
-        }
-        else if (y == leftmost())
-            leftmost() = z;
+    /*
+     *  empties the tree, in O(1) when Alloc is monotonic and value_type
+     *  is trivially destructible.
+     */
+    void release() {
+        destroy_all(typename __alloc_traits<Alloc>::is_monotonic());
+        leftmost() = header;
+        root() = 0;
+        rightmost() = header;
+        node_count = 0;
     }
-    else {
-        z = create_node(v);
-        right(y) = z;
-        if(y == rightmost())
-            rightmost() = z;
+
+public:
+    iterator find(const key_type &k);
+    const_iterator find(const key_type &k) const {
+        return const_cast<rb_tree*>(this)->find(k);
+    }
+    size_type count(const key_type &k) const;
+    iterator lower_bound(const key_type &k);
+    const_iterator lower_bound(const key_type &k) const {
+        return const_cast<rb_tree*>(this)->lower_bound(k);
+    }
+    iterator upper_bound(const key_type &k);
+    const_iterator upper_bound(const key_type &k) const {
+        return const_cast<rb_tree*>(this)->upper_bound(k);
+    }
+    std::pair<iterator, iterator> equal_range(const key_type &k) {
+        return std::pair<iterator, iterator>(lower_bound(k), upper_bound(k));
+    }
+    std::pair<const_iterator, const_iterator> equal_range(const key_type &k) const {
+        return std::pair<const_iterator, const_iterator>(lower_bound(k), upper_bound(k));
     }
 
-    parent(z) = y;
-    left(z) = 0;
-    right(z) = 0;
+    /*
+     *  find() for every key of [first, last), writing one iterator per
+     *  key (end() for a miss) to out, in order. the lookups of a group
+     *  go down the tree together, one level per round, so their cache
+     *  misses overlap instead of following one another.
+     */
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator find_batch(ForwardIterator first, ForwardIterator last, OutputIterator out);
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator find_batch(ForwardIterator first, ForwardIterator last, OutputIterator out) const {
+        return const_cast<rb_tree*>(this)->find_batch(first, last, out);
+    }
 
-    __rb_tree_rebalance(z, header->parent);
-    ++node_count;
-    return iterator(z);
-}
+public:
+    /*
+     *  order statistics, O(log n). they need a NodeBase that keeps
+     *  subtree sizes, such as rb_order_node.
+     *
+     *  rank(k) is the number of values with keys less than k, that is
+     *  the position of lower_bound(k). nth(i) is the value at position
+     *  i, end() past the last one. index(it) is the position of it,
+     *  size() for end().
+     */
+    size_type rank(const key_type &k) const;
+    iterator nth(size_type i);
+    const_iterator nth(size_type i) const {
+        return const_cast<rb_tree*>(this)->nth(i);
+    }
+    size_type index(const_iterator it) const;
+    difference_type distance(const_iterator first, const_iterator last) const {
+        return difference_type(index(last)) - difference_type(index(first));
+    }
 
+    /*
+     *  the aggregate of the values with keys in [lo, hi), O(log n). it
+     *  needs a NodeBase that keeps one, an rb_aggregate_node.
+     */
+    template <class N = NodeBase>
+    typename N::aggregate_type range_aggregate(const key_type &lo, const key_type &hi) const;
+
+    /*
+     *  a value changed in place, through an iterator or map's
+     *  operator[], is not seen by the aggregates above it. refresh(it)
+     *  recomputes them, O(log n).
+     */
+    void refresh(iterator position) {
+        __rb_tree_update_path<NodeBase>(position.node, root(), typename NodeBase::augmented());
+    }
 
-template <class Key, class T, class Compare = less<Key>, class Alloc = alloc>
-class map {
 public:
+    /*
+     *  bulk set operations on trees with unique keys, built on join and
+     *  split. x is taken apart and its nodes relinked into *this, no
+     *  value is copied and no node allocated. for sizes m <= n they do
+     *  O(m log(n / m + 1)) work, against O(m log n) for inserting one
+     *  tree into the other.
+     *
+     *      merge(x)                moves in the nodes of x whose keys
+     *                              are missing here, the others stay
+     *                              in x (like std::map::merge).
+     *      set_union(x)            *this | x, values of *this win.
+     *      set_intersection(x)     *this & x, values of *this kept.
+     *      set_difference(x)       *this - x.
+     *
+     *  nodes left out are destroyed and x is left empty. with threads
+     *  > 1 the two halves of big enough subproblems run on their own
+     *  threads; only links are touched there, so any Alloc will do.
+     */
+    void merge(rb_tree &x, unsigned threads = 1);
+    void set_union(rb_tree &&x, unsigned threads = 1);
+    void set_intersection(rb_tree &&x, unsigned threads = 1);
+    void set_difference(rb_tree &&x, unsigned threads = 1);
 
-    typedef Key key_type;
-    typedef T data_type;
-    typedef T mapped_type;
-    typedef std::pair<const Key, T> value_type;
-    typedef Compare key_compare;
+private:
+    typedef __rb_tree_node_list<NodeBase> node_list;
+
+    static base_ptr __make(base_ptr l, base_ptr k, base_ptr r, color_type c);
+    static base_ptr __join_right(base_ptr l, int lbh, base_ptr k, base_ptr r, int rbh);
+    static base_ptr __join_left(base_ptr l, int lbh, base_ptr k, base_ptr r, int rbh);
+    static base_ptr __join(base_ptr l, int lbh, base_ptr k, base_ptr r, int rbh, int &bh);
+    static base_ptr __join2(base_ptr l, int lbh, base_ptr r, int rbh, int &bh);
+    static base_ptr __split_last(base_ptr t, int tbh, int &bh, base_ptr &last);
+    base_ptr __split(base_ptr t, int tbh, const key_type &k,
+                     base_ptr &l, int &lbh, base_ptr &r, int &rbh) const;
+    base_ptr __union(base_ptr t1, int bh1, base_ptr t2, int bh2,
+                     int &bh, node_list &dropped, unsigned threads) const;
+    base_ptr __intersection(base_ptr t1, int bh1, base_ptr t2, int bh2,
+                            int &bh, node_list &dropped, unsigned threads) const;
+    base_ptr __difference(base_ptr t1, int bh1, base_ptr t2, int bh2,
+                          int &bh, node_list &dropped, unsigned threads) const;
+    typedef base_ptr (rb_tree::*set_operation)(base_ptr, int, base_ptr, int,
+                                               int&, node_list&, unsigned) const;
+    void __halves(set_operation op, base_ptr l1, base_ptr l2, int l2bh,
+                  base_ptr r1, base_ptr r2, int r2bh, int cbh,
+                  base_ptr &l, int &lbh, base_ptr &r, int &rbh,
+                  node_list &dropped, unsigned threads) const;
+    static int __black_height(base_ptr t);
+    base_ptr __detach(int &bh, size_type &n);
+    void __attach(base_ptr t, size_type n);
+    void __destroy_list(node_list &dropped);
 
-    class value_compare
-            : public std::binary_function<value_type, value_type, bool > {
-        friend class map<Key, T, Compare, Alloc>;
+};
+
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>&
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+operator=(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &x) {
+    if (this != &x) {
+        clear();
+        key_compare = x.key_compare;
+        if (x.root() != 0) {
+            root() = __copy(x.root(), header);
+            leftmost() = minimum(root());
+            rightmost() = maximum(root());
+            node_count = x.node_count;
+        }
+    }
+    return *this;
+}
+
+/*
+ *  structural copy of the subtree x, hung under p. the right subtrees
+ *  recurse, the left spine is walked in a loop.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::link_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::__copy(link_type x, link_type p) {
+    link_type top = clone_node(x);
+    top->set_parent(p);
+
+    __STL_TRY {
+        if (x->right)
+            top->right = __copy(right(x), top);
+        p = top;
+        x = left(x);
+
+        while (x != 0) {
+            link_type y = clone_node(x);
+            p->left = y;
+            y->set_parent(p);
+            if (x->right)
+                y->right = __copy(right(x), y);
+            p = y;
+            x = left(x);
+        }
+    }
+    __STL_UNWIND(__erase(top));
+
+    return top;
+}
+
+/*
+ *  __copy with the left subtree of x copied on a thread of its own and
+ *  the right one here, down to subtrees under __rb_tree_parallel_height
+ *  or until the threads run out. bh is the black height of x, so both
+ *  subtrees have that of x less its own black.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::link_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__copy(link_type x, link_type p, int bh, unsigned threads) {
+    if (threads < 2 || bh < __rb_tree_parallel_height)
+        return __copy(x, p);
+
+    link_type top = clone_node(x);
+    top->set_parent(p);
+    int cbh = x->get_color() == __rb_tree_black ? bh - 1 : bh;
+    std::future<link_type> left_half = std::async(std::launch::async, [&]() {
+        return __copy(left(x), top, cbh, threads / 2);
+    });
+    top->right = __copy(right(x), top, cbh, threads - threads / 2);
+    top->left = left_half.get();
+    return top;
+}
+
+/*
+ *  destroys the subtree x without rebalancing.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::__erase(link_type x) {
+    while (x != 0) {
+        __erase(right(x));
+        link_type y = left(x);
+        destroy_node(x);
+        x = y;
+    }
+}
+
+/*
+ *  __erase split over threads the way __copy above is.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__erase(link_type x, int bh, unsigned threads) {
+    if (threads < 2 || bh < __rb_tree_parallel_height) {
+        __erase(x);
+        return;
+    }
+
+    int cbh = x->get_color() == __rb_tree_black ? bh - 1 : bh;
+    std::future<void> left_half = std::async(std::launch::async, [&]() {
+        __erase(left(x), cbh, threads / 2);
+    });
+    __erase(right(x), cbh, threads - threads / 2);
+    left_half.get();
+    destroy_node(x);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class InputIterator>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__insert_unique_range(InputIterator first, InputIterator last, __false_type) {
+    for ( ; first != last; ++first)
+        insert_unique(end(), *first);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class ForwardIterator>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__insert_unique_range(ForwardIterator first, ForwardIterator last, __true_type) {
+    size_type n = 0;
+    if (node_count == 0 && __is_sorted_unique(first, last, n))
+        __build_sorted(first, n);
+    else
+        __insert_unique_range(first, last, __false_type());
+}
+
+/*
+ *  true if every key in [first, last) is less than the next one, n is
+ *  set to the length of the range then. stops at the first pair out of
+ *  order.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class ForwardIterator>
+bool rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__is_sorted_unique(ForwardIterator first, ForwardIterator last, size_type &n) const {
+    n = 0;
+    if (first == last)
+        return true;
+
+    ForwardIterator next = first;
+    for (++n; ++next != last; ++n, first = next) {
+        if (!key_compare(KeyOfValue()(*first), KeyOfValue()(*next)))
+            return false;
+    }
+    return true;
+}
+
+/*
+ *  builds the tree, which must be empty, from the n sorted values
+ *  starting at first.
+ *
+ *  each subtree puts its middle value at the top and splits the rest
+ *  evenly, so all levels but the last are full. with red_depth the
+ *  depth of that last level, coloring its nodes red and all the others
+ *  black gives every path the same number of black nodes, and a red
+ *  node never has children. if n + 1 is a power of two the last level
+ *  is full too, and red_depth lies below the tree, leaving it all black.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class ForwardIterator>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__build_sorted(ForwardIterator first, size_type n) {
+    if (n == 0)
+        return;
+
+    size_type red_depth = 0;
+    for (size_type m = n + 1; m > 1; m >>= 1)
+        ++red_depth;
+
+    root() = __build_sorted(first, n, 0, red_depth);
+    root()->set_parent(header);
+    leftmost() = minimum(root());
+    rightmost() = maximum(root());
+    node_count = n;
+}
+
+/*
+ *  the subtree of the next n values of first, which is advanced past
+ *  them. the values are consumed in order, so the nodes are allocated
+ *  in one pass over the input.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class ForwardIterator>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::link_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__build_sorted(ForwardIterator &first, size_type n, size_type depth, size_type red_depth) {
+    if (n == 0)
+        return 0;
+
+    size_type left_n = (n - 1) / 2;
+    link_type l = __build_sorted(first, left_n, depth + 1, red_depth);
+    link_type z = 0;
+    __STL_TRY {
+        z = create_node(*first);
+    }
+    __STL_UNWIND(__erase(l));
+    ++first;
+
+    z->set_parent_and_color(0, depth == red_depth ? __rb_tree_red : __rb_tree_black);
+    z->left = l;
+    z->right = 0;
+    if (l) l->set_parent(z);
+    __STL_TRY {
+        z->right = __build_sorted(first, n - 1 - left_n, depth + 1, red_depth);
+    }
+    __STL_UNWIND(__erase(z));
+    if (z->right) z->right->set_parent(z);
+    z->update();
+    return z;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::clear() {
+    if (node_count != 0) {
+        __erase(root());
+        leftmost() = header;
+        root() = 0;
+        rightmost() = header;
+        node_count = 0;
+    }
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::clear(unsigned threads) {
+    int bh;
+    size_type n;
+    link_type t = (link_type)__detach(bh, n);
+    __erase(t, bh, __usable_threads(threads, typename __alloc_traits<Alloc>::is_thread_safe()));
+}
+
+/*
+ *  the nodes are taken out first, so the thread needs nothing of *this
+ *  and the tree can be used, or destroyed, while they are freed.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+std::future<void> rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::clear_async(unsigned threads) {
+    typedef typename __alloc_traits<Alloc>::is_thread_safe is_thread_safe;
+    int bh;
+    size_type n;
+    link_type t = (link_type)__detach(bh, n);
+    if (!std::is_same<is_thread_safe, __true_type>::value) {
+        __erase(t);
+        std::promise<void> done;
+        done.set_value();
+        return done.get_future();
+    }
+
+    threads = __usable_threads(threads, is_thread_safe());
+    std::packaged_task<void()> task([t, bh, threads]() {
+        __erase(t, bh, threads);
+    });
+    std::future<void> done = task.get_future();
+    std::thread(std::move(task)).detach();
+    return done;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::erase(iterator position) {
+    link_type y = (link_type)__rb_tree_rebalance_for_erase(position.node,
+                                                           header->root_link(),
+                                                           header->left,
+                                                           header->right);
+    destroy_node(y);
+    --node_count;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::node_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::extract(iterator position) {
+    link_type y = (link_type)__rb_tree_rebalance_for_erase(position.node,
+                                                           header->root_link(),
+                                                           header->left,
+                                                           header->right);
+    --node_count;
+    return node_type(y);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::insert_return_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::insert_unique(node_type &&nh) {
+    insert_return_type r;
+    if (nh.empty()) {
+        r.position = end();
+        r.inserted = false;
+        return r;
+    }
+    std::pair<base_ptr, base_ptr> pos = __get_insert_unique_pos(KeyOfValue()(nh.value()));
+    if (pos.second != 0) {
+        r.position = __insert_node(pos.first, pos.second, nh.__release());
+        r.inserted = true;
+    }
+    else {
+        r.position = iterator((link_type)pos.first);
+        r.inserted = false;
+        r.node = std::move(nh);
+    }
+    return r;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+insert_unique(iterator position, node_type &&nh) {
+    if (nh.empty())
+        return end();
+    std::pair<base_ptr, base_ptr> pos = __get_insert_hint_unique_pos(position, KeyOfValue()(nh.value()));
+    if (pos.second != 0)
+        return __insert_node(pos.first, pos.second, nh.__release());
+    return iterator((link_type)pos.first);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::insert_equal(node_type &&nh) {
+    if (nh.empty())
+        return end();
+    base_ptr y = __get_insert_equal_pos(KeyOfValue()(nh.value()));
+    return __insert_node(0, y, nh.__release());
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+insert_equal(iterator position, node_type &&nh) {
+    if (nh.empty())
+        return end();
+    std::pair<base_ptr, base_ptr> pos = __get_insert_hint_equal_pos(position, KeyOfValue()(nh.value()));
+    return __insert_node(pos.first, pos.second, nh.__release());
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::erase(const key_type &x) {
+    std::pair<iterator, iterator> p = equal_range(x);
+    size_type n = 0;
+    ::distance(p.first, p.second, n);
+    erase(p.first, p.second);
+    return n;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::erase(iterator first, iterator last) {
+    if (first == begin() && last == end())
+        clear();
+    else
+        while (first != last)
+            erase(first++);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::find(const key_type &k) {
+    link_type y = header;       // last node which is not less than k
+    link_type x = root();
+
+    while (x != 0) {
+        if (!key_compare(key(x), k))
+            y = x, x = left(x);
+        else
+            x = right(x);
+    }
+
+    iterator j = iterator(y);
+    return (j == end() || key_compare(k, key(j.node))) ? end() : j;
+}
+
+/*
+ *  group prefetching: __rb_tree_batch_size lookups walk in lock-step.
+ *  each round moves every unfinished one a level down and prefetches
+ *  the node it will read next round, by which time the rest of the
+ *  group has given the line time to arrive. the trees are balanced, so
+ *  the lookups of a group finish within a round or two of each other
+ *  and little work is spent on idle slots. a tree that fits in cache
+ *  has no misses to hide, and there the plain loop is faster.
+ */
+enum { __rb_tree_batch_size = 16 };
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class ForwardIterator, class OutputIterator>
+OutputIterator rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+find_batch(ForwardIterator first, ForwardIterator last, OutputIterator out) {
+    const key_type *k[__rb_tree_batch_size];
+    link_type x[__rb_tree_batch_size];
+    link_type y[__rb_tree_batch_size];
+
+    while (first != last) {
+        int n = 0;
+        for ( ; n < __rb_tree_batch_size && first != last; ++n, ++first) {
+            k[n] = &*first;
+            x[n] = root();
+            y[n] = header;
+        }
+
+        bool active = root() != 0;
+        while (active) {
+            active = false;
+            for (int i = 0; i < n; ++i) {
+                if (x[i] == 0) continue;
+                if (!key_compare(key(x[i]), *k[i]))
+                    y[i] = x[i], x[i] = left(x[i]);
+                else
+                    x[i] = right(x[i]);
+                if (x[i] != 0) {
+                    __builtin_prefetch(x[i]);
+                    active = true;
+                }
+            }
+        }
+
+        for (int i = 0; i < n; ++i)
+            *out++ = (y[i] == header || key_compare(*k[i], key(y[i]))) ? end() : iterator(y[i]);
+    }
+    return out;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::rank(const key_type &k) const {
+    link_type x = root();
+    size_type r = 0;
+
+    while (x != 0) {
+        if (!key_compare(key(x), k))
+            x = left(x);
+        else {
+            r += NodeBase::size_of(x->left) + 1;
+            x = right(x);
+        }
+    }
+    return r;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::nth(size_type i) {
+    link_type x = root();
+
+    while (x != 0) {
+        size_type l = NodeBase::size_of(x->left);
+        if (i < l)
+            x = left(x);
+        else if (i == l)
+            return iterator(x);
+        else {
+            i -= l + 1;
+            x = right(x);
+        }
+    }
+    return end();
+}
+
+/*
+ *  goes down to the first node inside [lo, hi), where the paths to lo
+ *  and to hi part. all of the range lies below it: a suffix of its left
+ *  subtree, itself, and a prefix of its right subtree. each is summed
+ *  on one more walk down, taking whole subtrees from their aggregate.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class N>
+typename N::aggregate_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+range_aggregate(const key_type &lo, const key_type &hi) const {
+    typedef typename N::aggregate_type aggregate_type;
+    typename N::aggregate_functor a;
+    link_type x = root();
+
+    while (x != 0) {
+        if (key_compare(key(x), lo))
+            x = right(x);
+        else if (!key_compare(key(x), hi))
+            x = left(x);
+        else
+            break;
+    }
+    if (x == 0)
+        return a.identity();
+
+    aggregate_type before = a.identity();   // [lo, x) from x's left subtree
+    for (link_type y = left(x); y != 0; ) {
+        if (!key_compare(key(y), lo)) {
+            aggregate_type r = a.measure(value(y));
+            if (y->right)
+                r = a.combine(r, y->right->aggregate);
+            before = a.combine(r, before);
+            y = left(y);
+        }
+        else
+            y = right(y);
+    }
+
+    aggregate_type after = a.identity();    // (x, hi) from x's right subtree
+    for (link_type y = right(x); y != 0; ) {
+        if (key_compare(key(y), hi)) {
+            aggregate_type r = a.measure(value(y));
+            if (y->left)
+                r = a.combine(y->left->aggregate, r);
+            after = a.combine(after, r);
+            y = right(y);
+        }
+        else
+            y = left(y);
+    }
+
+    return a.combine(a.combine(before, a.measure(value(x))), after);
+}
+
+/*
+ *  the nodes before it are its left subtree plus, for every ancestor
+ *  it lies right of, that ancestor and the ancestor's left subtree.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::index(const_iterator it) const {
+    if (it == end())
+        return node_count;
+
+    base_ptr x = it.node;
+    size_type r = NodeBase::size_of(x->left);
+    while (x != root()) {
+        base_ptr p = x->get_parent();
+        if (x == p->right)
+            r += NodeBase::size_of(p->left) + 1;
+        x = p;
+    }
+    return r;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::count(const key_type &k) const {
+    std::pair<const_iterator, const_iterator> p = equal_range(k);
+    size_type n = 0;
+    ::distance(p.first, p.second, n);
+    return n;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::lower_bound(const key_type &k) {
+    link_type y = header;       // last node which is not less than k
+    link_type x = root();
+
+    while (x != 0) {
+        if (!key_compare(key(x), k))
+            y = x, x = left(x);
+        else
+            x = right(x);
+    }
+    return iterator(y);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::upper_bound(const key_type &k) {
+    link_type y = header;       // last node which is greater than k
+    link_type x = root();
+
+    while (x != 0) {
+        if (key_compare(k, key(x)))
+            y = x, x = left(x);
+        else
+            x = right(x);
+    }
+    return iterator(y);
+}
+
+
+/*
+ *  the parent a new node with key k hangs from, equal keys go right.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::__get_insert_equal_pos(const key_type &k) {
+    link_type y = header;
+    link_type x = root();
+    while (x != 0) {
+        y = x;
+        x = key_compare(k, key(x)) ? left(x) : right(x);
+    }
+    return y;
+}
+
+/*
+ *  where a node with key k goes if k is not in the tree yet: (x, y) to
+ *  pass on to __insert. if k is there, (the node holding it, 0).
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+std::pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr,
+          typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::__get_insert_unique_pos(const key_type &k) {
+    link_type y = header;
+    link_type x = root();
+    bool comp = true;
+    while (x != 0) {
+        y = x;
+        comp = key_compare(k, key(x));
+        x = comp ? left(x) : right(x);
+    }
+
+    iterator j = iterator(y);
+    if(comp) {
+        if (j == begin())
+            return std::pair<base_ptr, base_ptr>(x, y);
+        else
+            --j;
+    }
+    if (key_compare(key(j.node), k))
+        return std::pair<base_ptr, base_ptr>(x, y);
+
+    return std::pair<base_ptr, base_ptr>(j.node, 0);
+}
+
+/*
+ *  like __get_insert_unique_pos, but first tries the neighbours of
+ *  position, using leftmost() and rightmost() for the two ends.
+ *  (x, y) with x != 0 makes __insert hang the node left of y.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+std::pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr,
+          typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__get_insert_hint_unique_pos(iterator position, const key_type &k) {
+    if (position.node == header) {
+        if (node_count > 0 && key_compare(key(rightmost()), k))
+            return std::pair<base_ptr, base_ptr>(0, rightmost());
+        return __get_insert_unique_pos(k);
+    }
+    else if (key_compare(k, key(position.node))) {
+        // k goes before position, check it goes after the one before
+        if (position.node == leftmost())
+            return std::pair<base_ptr, base_ptr>(leftmost(), leftmost());
+        iterator before = position;
+        --before;
+        if (key_compare(key(before.node), k)) {
+            if (before.node->right == 0)
+                return std::pair<base_ptr, base_ptr>(0, before.node);
+            return std::pair<base_ptr, base_ptr>(position.node, position.node);
+        }
+        return __get_insert_unique_pos(k);
+    }
+    else if (key_compare(key(position.node), k)) {
+        // k goes after position, check it goes before the one after
+        if (position.node == rightmost())
+            return std::pair<base_ptr, base_ptr>(0, rightmost());
+        iterator after = position;
+        ++after;
+        if (key_compare(k, key(after.node))) {
+            if (position.node->right == 0)
+                return std::pair<base_ptr, base_ptr>(0, position.node);
+            return std::pair<base_ptr, base_ptr>(after.node, after.node);
+        }
+        return __get_insert_unique_pos(k);
+    }
+    return std::pair<base_ptr, base_ptr>(position.node, 0);     // equal key
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+std::pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr,
+          typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__get_insert_hint_equal_pos(iterator position, const key_type &k) {
+    if (position.node == header) {
+        if (node_count > 0 && !key_compare(k, key(rightmost())))
+            return std::pair<base_ptr, base_ptr>(0, rightmost());
+        return std::pair<base_ptr, base_ptr>(0, __get_insert_equal_pos(k));
+    }
+    else if (!key_compare(key(position.node), k)) {
+        // k is not greater than position, try right before it
+        if (position.node == leftmost())
+            return std::pair<base_ptr, base_ptr>(leftmost(), leftmost());
+        iterator before = position;
+        --before;
+        if (!key_compare(k, key(before.node))) {
+            if (before.node->right == 0)
+                return std::pair<base_ptr, base_ptr>(0, before.node);
+            return std::pair<base_ptr, base_ptr>(position.node, position.node);
+        }
+    }
+    else {
+        // k is greater than position, try right after it
+        if (position.node == rightmost())
+            return std::pair<base_ptr, base_ptr>(0, rightmost());
+        iterator after = position;
+        ++after;
+        if (!key_compare(key(after.node), k)) {
+            if (position.node->right == 0)
+                return std::pair<base_ptr, base_ptr>(0, position.node);
+            return std::pair<base_ptr, base_ptr>(after.node, after.node);
+        }
+    }
+    return std::pair<base_ptr, base_ptr>(0, __get_insert_equal_pos(k));
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class Arg>
+std::pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator, bool>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::__insert_unique(Arg &&v) {
+    std::pair<base_ptr, base_ptr> pos = __get_insert_unique_pos(KeyOfValue()(v));
+    if (pos.second != 0)
+        return std::pair<iterator, bool>(__insert(pos.first, pos.second, std::forward<Arg>(v)), true);
+    return std::pair<iterator, bool>(iterator((link_type)pos.first), false);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class... Args>
+std::pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator, bool>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::emplace_unique(Args&&... args) {
+    link_type z = create_node(std::forward<Args>(args)...);
+    std::pair<base_ptr, base_ptr> pos(0, 0);
+    __STL_TRY {
+        pos = __get_insert_unique_pos(key(z));
+    }
+    __STL_UNWIND(destroy_node(z));
+
+    if (pos.second != 0)
+        return std::pair<iterator, bool>(__insert_node(pos.first, pos.second, z), true);
+    destroy_node(z);
+    return std::pair<iterator, bool>(iterator((link_type)pos.first), false);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class... Args>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+emplace_hint_unique(iterator position, Args&&... args) {
+    link_type z = create_node(std::forward<Args>(args)...);
+    std::pair<base_ptr, base_ptr> pos(0, 0);
+    __STL_TRY {
+        pos = __get_insert_hint_unique_pos(position, key(z));
+    }
+    __STL_UNWIND(destroy_node(z));
+
+    if (pos.second != 0)
+        return __insert_node(pos.first, pos.second, z);
+    destroy_node(z);
+    return iterator((link_type)pos.first);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class... Args>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::emplace_equal(Args&&... args) {
+    link_type z = create_node(std::forward<Args>(args)...);
+    base_ptr y = 0;
+    __STL_TRY {
+        y = __get_insert_equal_pos(key(z));
+    }
+    __STL_UNWIND(destroy_node(z));
+    return __insert_node(0, y, z);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+template <class... Args>
+std::pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator, bool>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::emplace_unique_key(const key_type &k, Args&&... args) {
+    std::pair<base_ptr, base_ptr> pos = __get_insert_unique_pos(k);
+    if (pos.second != 0)
+        return std::pair<iterator, bool>(__insert(pos.first, pos.second, std::forward<Args>(args)...), true);
+    return std::pair<iterator, bool>(iterator((link_type)pos.first), false);
+}
+
+/*!
+ *
+ * @tparam Key
+ * @tparam Value
+ * @tparam KeyOfValue
+ * @tparam Compare
+ * @tparam Alloc
+ * @param x_ the new value inserting node location
+ * @param y_ parent of x_
+ * @param z the new node, already holding its value
+ * @return iterator pointing to new node
+ */
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__insert_node(base_ptr x_, base_ptr y_, link_type z) {
+    //link_type x = (link_type)x_;        //Clion warn: use auto when initializing with a cast to
+    //link_type y = (link_type)y_;        //      avoid duplicating type name
+    auto x = (link_type)x_;
+    auto y = (link_type)y_;
+
+    if (y == header || x != 0 || key_compare(key(z), key(y))) {
+        left(y) = z;
+        if(y == header) {
+            root() = z;
+            rightmost() = z;
+        }
+        else if (y == leftmost())
+            leftmost() = z;
+    }
+    else {
+        right(y) = z;
+        if(y == rightmost())
+            rightmost() = z;
+    }
+
+    z->set_parent_and_color(y, __rb_tree_red);
+    left(z) = 0;
+    right(z) = 0;
+
+    __rb_tree_update_path<NodeBase>(z, root(), typename NodeBase::augmented());
+    __rb_tree_rebalance<NodeBase>(z, header->root_link());
+    ++node_count;
+    return iterator(z);
+}
+
+
+/*
+ *  join and split, after Blelloch, Ferizovic and Sun, "just join for
+ *  parallel ordered sets". a subtree travels with its black height bh,
+ *  the number of black nodes on any path from its root down to a null,
+ *  the root included (so a null tree has 0). its root may be red.
+ *
+ *  join(l, k, r) needs every key of l before k and k before every key
+ *  of r. it walks down the right spine of the taller tree (or the left
+ *  spine of r) to a black subtree as tall as the other one, hangs k
+ *  there as a red node and repairs a red-red pair on the way back up
+ *  with one rotation. O(|bh(l) - bh(r)| + 1).
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__make(base_ptr l, base_ptr k, base_ptr r, color_type c) {
+    k->left = l;
+    k->right = r;
+    if (l) l->set_parent(k);
+    if (r) r->set_parent(k);
+    k->set_color(c);
+    k->update();
+    return k;
+}
+
+/*
+ *  bh(l) >= rbh and r's root is black. the result is as tall as l, its
+ *  root may be red over a red right child, which the caller repairs.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__join_right(base_ptr l, int lbh, base_ptr k, base_ptr r, int rbh) {
+    if (lbh == rbh && (l == 0 || l->get_color() == __rb_tree_black))
+        return __make(l, k, r, __rb_tree_red);
+
+    int cbh = l->get_color() == __rb_tree_black ? lbh - 1 : lbh;
+    base_ptr t = __join_right(l->right, cbh, k, r, rbh);
+    l->right = t;
+    t->set_parent(l);
+    if (l->get_color() == __rb_tree_black && t->get_color() == __rb_tree_red &&
+            t->right != 0 && t->right->get_color() == __rb_tree_red) {
+        t->right->set_color(__rb_tree_black);
+        base_ptr top = l;
+        __rb_tree_rotate_left(l, top);
+        return top;
+    }
+    l->update();
+    return l;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__join_left(base_ptr l, int lbh, base_ptr k, base_ptr r, int rbh) {
+    if (rbh == lbh && (r == 0 || r->get_color() == __rb_tree_black))
+        return __make(l, k, r, __rb_tree_red);
+
+    int cbh = r->get_color() == __rb_tree_black ? rbh - 1 : rbh;
+    base_ptr t = __join_left(l, lbh, k, r->left, cbh);
+    r->left = t;
+    t->set_parent(r);
+    if (r->get_color() == __rb_tree_black && t->get_color() == __rb_tree_red &&
+            t->left != 0 && t->left->get_color() == __rb_tree_red) {
+        t->left->set_color(__rb_tree_black);
+        base_ptr top = r;
+        __rb_tree_rotate_right(r, top);
+        return top;
+    }
+    r->update();
+    return r;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__join(base_ptr l, int lbh, base_ptr k, base_ptr r, int rbh, int &bh) {
+    if (l != 0 && l->get_color() == __rb_tree_red) {
+        l->set_color(__rb_tree_black);
+        ++lbh;
+    }
+    if (r != 0 && r->get_color() == __rb_tree_red) {
+        r->set_color(__rb_tree_black);
+        ++rbh;
+    }
+
+    if (lbh > rbh) {
+        base_ptr t = __join_right(l, lbh, k, r, rbh);
+        bh = lbh;
+        if (t->get_color() == __rb_tree_red && t->right != 0 &&
+                t->right->get_color() == __rb_tree_red) {
+            t->set_color(__rb_tree_black);
+            ++bh;
+        }
+        return t;
+    }
+    if (rbh > lbh) {
+        base_ptr t = __join_left(l, lbh, k, r, rbh);
+        bh = rbh;
+        if (t->get_color() == __rb_tree_red && t->left != 0 &&
+                t->left->get_color() == __rb_tree_red) {
+            t->set_color(__rb_tree_black);
+            ++bh;
+        }
+        return t;
+    }
+    bh = lbh;
+    return __make(l, k, r, __rb_tree_red);
+}
+
+/*
+ *  takes the last node of t out as last, returning the rest.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__split_last(base_ptr t, int tbh, int &bh, base_ptr &last) {
+    int cbh = t->get_color() == __rb_tree_black ? tbh - 1 : tbh;
+    base_ptr l = t->left;
+    base_ptr r = t->right;
+    if (r == 0) {
+        last = t;
+        bh = cbh;
+        return l;
+    }
+    int rbh;
+    base_ptr rest = __split_last(r, cbh, rbh, last);
+    return __join(l, cbh, t, rest, rbh, bh);
+}
+
+/*
+ *  join without a middle node.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__join2(base_ptr l, int lbh, base_ptr r, int rbh, int &bh) {
+    if (l == 0) {
+        bh = rbh;
+        return r;
+    }
+    if (r == 0) {
+        bh = lbh;
+        return l;
+    }
+    base_ptr k;
+    int bh2;
+    base_ptr rest = __split_last(l, lbh, bh2, k);
+    return __join(rest, bh2, k, r, rbh, bh);
+}
+
+/*
+ *  splits t into l, the keys before k, and r, the keys after it. the
+ *  node holding k itself, if any, is returned and belongs to neither.
+ *  O(log n): one join per level, and their costs telescope.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__split(base_ptr t, int tbh, const key_type &k,
+        base_ptr &l, int &lbh, base_ptr &r, int &rbh) const {
+    if (t == 0) {
+        l = r = 0;
+        lbh = rbh = 0;
+        return 0;
+    }
+
+    int cbh = t->get_color() == __rb_tree_black ? tbh - 1 : tbh;
+    base_ptr tl = t->left;
+    base_ptr tr = t->right;
+    if (key_compare(k, key(t))) {
+        base_ptr rl;
+        int rlbh;
+        base_ptr found = __split(tl, cbh, k, l, lbh, rl, rlbh);
+        r = __join(rl, rlbh, t, tr, cbh, rbh);
+        return found;
+    }
+    if (key_compare(key(t), k)) {
+        base_ptr lr;
+        int lrbh;
+        base_ptr found = __split(tr, cbh, k, lr, lrbh, r, rbh);
+        l = __join(tl, cbh, t, lr, lrbh, lbh);
+        return found;
+    }
+    l = tl;
+    lbh = cbh;
+    r = tr;
+    rbh = cbh;
+    return t;
+}
+
+/*
+ *  the two recursive calls of a set operation, the left one on a
+ *  thread of its own when there are threads to spare and the subtree
+ *  is big enough to pay for one.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__halves(set_operation op, base_ptr l1, base_ptr l2, int l2bh,
+         base_ptr r1, base_ptr r2, int r2bh, int cbh,
+         base_ptr &l, int &lbh, base_ptr &r, int &rbh,
+         node_list &dropped, unsigned threads) const {
+    if (threads > 1 && cbh + 1 >= __rb_tree_parallel_height) {
+        node_list left_dropped;
+        std::future<base_ptr> left_half = std::async(std::launch::async, [&]() {
+            return (this->*op)(l1, cbh, l2, l2bh, lbh, left_dropped, threads / 2);
+        });
+        r = (this->*op)(r1, cbh, r2, r2bh, rbh, dropped, threads - threads / 2);
+        l = left_half.get();
+        dropped.splice(left_dropped);
+    }
+    else {
+        l = (this->*op)(l1, cbh, l2, l2bh, lbh, dropped, threads);
+        r = (this->*op)(r1, cbh, r2, r2bh, rbh, dropped, threads);
+    }
+}
+
+/*
+ *  the set operations split t2 around the root of t1, recurse on the
+ *  two sides and join the results, keeping t1's root or not.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__union(base_ptr t1, int bh1, base_ptr t2, int bh2,
+        int &bh, node_list &dropped, unsigned threads) const {
+    if (t1 == 0) {
+        bh = bh2;
+        return t2;
+    }
+    if (t2 == 0) {
+        bh = bh1;
+        return t1;
+    }
+
+    base_ptr l2, r2;
+    int l2bh, r2bh;
+    base_ptr found = __split(t2, bh2, key(t1), l2, l2bh, r2, r2bh);
+    if (found) dropped.push(found);
+
+    int cbh = t1->get_color() == __rb_tree_black ? bh1 - 1 : bh1;
+    base_ptr l, r;
+    int lbh, rbh;
+    __halves(&rb_tree::__union, t1->left, l2, l2bh, t1->right, r2, r2bh, cbh,
+             l, lbh, r, rbh, dropped, threads);
+    return __join(l, lbh, t1, r, rbh, bh);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__intersection(base_ptr t1, int bh1, base_ptr t2, int bh2,
+               int &bh, node_list &dropped, unsigned threads) const {
+    if (t1 == 0 || t2 == 0) {
+        dropped.push_subtree(t1);
+        dropped.push_subtree(t2);
+        bh = 0;
+        return 0;
+    }
+
+    base_ptr l2, r2;
+    int l2bh, r2bh;
+    base_ptr found = __split(t2, bh2, key(t1), l2, l2bh, r2, r2bh);
+    if (found) dropped.push(found);
+
+    int cbh = t1->get_color() == __rb_tree_black ? bh1 - 1 : bh1;
+    base_ptr l, r;
+    int lbh, rbh;
+    __halves(&rb_tree::__intersection, t1->left, l2, l2bh, t1->right, r2, r2bh, cbh,
+             l, lbh, r, rbh, dropped, threads);
+    if (found)
+        return __join(l, lbh, t1, r, rbh, bh);
+    dropped.push(t1);
+    return __join2(l, lbh, r, rbh, bh);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::
+__difference(base_ptr t1, int bh1, base_ptr t2, int bh2,
+             int &bh, node_list &dropped, unsigned threads) const {
+    if (t1 == 0 || t2 == 0) {
+        dropped.push_subtree(t2);
+        bh = bh1;
+        return t1;
+    }
+
+    base_ptr l2, r2;
+    int l2bh, r2bh;
+    base_ptr found = __split(t2, bh2, key(t1), l2, l2bh, r2, r2bh);
+    if (found) dropped.push(found);
+
+    int cbh = t1->get_color() == __rb_tree_black ? bh1 - 1 : bh1;
+    base_ptr l, r;
+    int lbh, rbh;
+    __halves(&rb_tree::__difference, t1->left, l2, l2bh, t1->right, r2, r2bh, cbh,
+             l, lbh, r, rbh, dropped, threads);
+    if (!found)
+        return __join(l, lbh, t1, r, rbh, bh);
+    dropped.push(t1);
+    return __join2(l, lbh, r, rbh, bh);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+int rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::__black_height(base_ptr t) {
+    int bh = 0;
+    for ( ; t != 0; t = t->left)
+        if (t->get_color() == __rb_tree_black)
+            ++bh;
+    return bh;
+}
+
+/*
+ *  takes the nodes out of the tree, leaving it empty.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::base_ptr
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::__detach(int &bh, size_type &n) {
+    base_ptr t = root();
+    bh = __black_height(t);
+    n = node_count;
+    root() = 0;
+    leftmost() = header;
+    rightmost() = header;
+    node_count = 0;
+    return t;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::__attach(base_ptr t, size_type n) {
+    if (t != 0) {
+        t->set_color(__rb_tree_black);
+        t->set_parent(header);
+        root() = (link_type)t;
+        leftmost() = minimum(root());
+        rightmost() = maximum(root());
+    }
+    node_count = n;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::__destroy_list(node_list &dropped) {
+    for (base_ptr x = dropped.first; x != 0; ) {
+        base_ptr next = x->left;
+        destroy_node((link_type)x);
+        x = next;
+    }
+    dropped = node_list();
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::set_union(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &&x, unsigned threads) {
+    if (&x == this) return;
+    int bh1, bh2, bh;
+    size_type n1, n2;
+    node_list dropped;
+    base_ptr t1 = __detach(bh1, n1);
+    base_ptr t2 = x.__detach(bh2, n2);
+    base_ptr t = __union(t1, bh1, t2, bh2, bh, dropped, threads);
+    __attach(t, n1 + n2 - dropped.n);
+    __destroy_list(dropped);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::set_intersection(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &&x, unsigned threads) {
+    if (&x == this) return;
+    int bh1, bh2, bh;
+    size_type n1, n2;
+    node_list dropped;
+    base_ptr t1 = __detach(bh1, n1);
+    base_ptr t2 = x.__detach(bh2, n2);
+    base_ptr t = __intersection(t1, bh1, t2, bh2, bh, dropped, threads);
+    __attach(t, n1 + n2 - dropped.n);
+    __destroy_list(dropped);
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::set_difference(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &&x, unsigned threads) {
+    if (&x == this) {
+        clear();
+        return;
+    }
+    int bh1, bh2, bh;
+    size_type n1, n2;
+    node_list dropped;
+    base_ptr t1 = __detach(bh1, n1);
+    base_ptr t2 = x.__detach(bh2, n2);
+    base_ptr t = __difference(t1, bh1, t2, bh2, bh, dropped, threads);
+    __attach(t, n1 + n2 - dropped.n);
+    __destroy_list(dropped);
+}
+
+/*
+ *  a union that hands the nodes it would drop back to x. they come out
+ *  of the recursion in no particular order, so they are sorted and
+ *  appended to the empty x one by one at its right end.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc, class NodeBase>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase>::merge(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, NodeBase> &x, unsigned threads) {
+    if (&x == this) return;
+    int bh1, bh2, bh;
+    size_type n1, n2;
+    node_list dropped;
+    base_ptr t1 = __detach(bh1, n1);
+    base_ptr t2 = x.__detach(bh2, n2);
+    base_ptr t = __union(t1, bh1, t2, bh2, bh, dropped, threads);
+    __attach(t, n1 + n2 - dropped.n);
+
+    std::vector<link_type> back;
+    back.reserve(dropped.n);
+    for (base_ptr y = dropped.first; y != 0; y = y->left)
+        back.push_back((link_type)y);
+    std::sort(back.begin(), back.end(), [this](link_type a, link_type b) {
+        return key_compare(key(a), key(b));
+    });
+    for (size_t i = 0; i < back.size(); ++i)
+        x.__insert_node(0, x.rightmost(), back[i]);
+}
+
+
+template <class Key, class T, class Compare = std::less<Key>, class Alloc = alloc,
+          class NodeBase = __rb_tree_node_base>
+class map {
+public:
+
+    typedef Key key_type;
+    typedef T data_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef Compare key_compare;
+
+    class value_compare {
+        friend class map<Key, T, Compare, Alloc, NodeBase>;
 
     protected:
         Compare comp;
         value_compare(Compare c) : comp(c) {    }
 
     public:
+        typedef value_type first_argument_type;
+        typedef value_type second_argument_type;
+        typedef bool result_type;
+
         bool operator()(const value_type &x, const value_type &y) const {
             return comp(x.first, y.first);
         }
     };
 
 private:
-    typedef rb_tree<key_type ,value_type, select1st<value_type>, key_compare, Alloc> rep_type;
+    typedef rb_tree<key_type, value_type, select1st<value_type>, key_compare, Alloc, NodeBase> rep_type;
     rep_type t;
 
 public:
@@ -529,6 +2438,8 @@ public:
     typedef typename rep_type::const_reverse_iterator const_reverse_iterator;   //TODO same as above
     typedef typename rep_type::size_type size_type;
     typedef typename rep_type::difference_type difference_type;
+    typedef typename rep_type::node_type node_type;
+    typedef typename rep_type::insert_return_type insert_return_type;
 
     map() : t(Compare() ) { }
     explicit map(const Compare &comp) : t(comp) {   }
@@ -541,13 +2452,173 @@ public:
             map(InputIterator first, InputIterator last, const Compare &comp)
                     : t(comp) { t.insert_unique(first, last);   }
 
-    map(const map<Key, T, Compare, Alloc> &x) : t(x.t) {    }
+    /*
+     *  [first, last) must be sorted by comp with no duplicate keys, the
+     *  tree is then built in O(n) without a single comparison.
+     */
+    template <class ForwardIterator>
+            map(sorted_unique_t, ForwardIterator first, ForwardIterator last,
+                const Compare &comp = Compare())
+                    : t(comp) { t.assign_sorted(first, last);   }
+
+    map(const map<Key, T, Compare, Alloc, NodeBase> &x) : t(x.t) {    }
+    map(const map<Key, T, Compare, Alloc, NodeBase> &x, unsigned threads) : t(x.t, threads) {  }
+    map(map<Key, T, Compare, Alloc, NodeBase> &&x) : t(std::move(x.t)) {  }
 
-    map<Key, T, Compare, Alloc>& operator=(const map<Key, T, Compare, Alloc> &x) {
+    map<Key, T, Compare, Alloc, NodeBase>& operator=(const map<Key, T, Compare, Alloc, NodeBase> &x) {
         t = x.t;
         return *this;
     };
-    
+
+    map<Key, T, Compare, Alloc, NodeBase>& operator=(map<Key, T, Compare, Alloc, NodeBase> &&x) {
+        t = std::move(x.t);
+        return *this;
+    }
+
+public:
+    key_compare key_comp() const { return t.key_comp();  }
+    value_compare value_comp() const { return value_compare(t.key_comp());  }
+    iterator begin() { return t.begin();    }
+    const_iterator begin() const { return t.begin();    }
+    iterator end() { return t.end();    }
+    const_iterator end() const { return t.end();    }
+    reverse_iterator rbegin() { return t.rbegin();  }
+    const_reverse_iterator rbegin() const { return t.rbegin();  }
+    reverse_iterator rend() { return t.rend();  }
+    const_reverse_iterator rend() const { return t.rend();  }
+    bool empty() const { return t.empty();  }
+    size_type size() const { return t.size();   }
+    size_type max_size() const { return t.max_size();   }
+
+    T &operator[](const key_type &k) {
+        return (*(try_emplace(k).first)).second;
+    }
+
+    T &operator[](key_type &&k) {
+        return (*(try_emplace(std::move(k)).first)).second;
+    }
+
+    void swap(map<Key, T, Compare, Alloc, NodeBase> &x) { t.swap(x.t);   }
+
+public:
+    std::pair<iterator, bool> insert(const value_type &x) {
+        return t.insert_unique(x);
+    }
+
+    std::pair<iterator, bool> insert(value_type &&x) {
+        return t.insert_unique(std::move(x));
+    }
+
+    iterator insert(iterator position, const value_type &x) {
+        return t.insert_unique(position, x);
+    }
+
+    iterator insert(iterator position, value_type &&x) {
+        return t.insert_unique(position, std::move(x));
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        return t.emplace_unique(std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    iterator emplace_hint(iterator position, Args&&... args) {
+        return t.emplace_hint_unique(position, std::forward<Args>(args)...);
+    }
+
+    /*
+     *  unlike emplace, constructs nothing (and leaves k and args alone)
+     *  when k is already in the map.
+     */
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const key_type &k, Args&&... args) {
+        return t.emplace_unique_key(k, std::piecewise_construct,
+                                    std::forward_as_tuple(k),
+                                    std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(key_type &&k, Args&&... args) {
+        return t.emplace_unique_key(k, std::piecewise_construct,
+                                    std::forward_as_tuple(std::move(k)),
+                                    std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template <class InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        t.insert_unique(first, last);
+    }
+
+    void erase(iterator position) { t.erase(position);  }
+    size_type erase(const key_type &x) { return t.erase(x);    }
+    void erase(iterator first, iterator last) { t.erase(first, last);   }
+    void clear() { t.clear();   }
+    void clear(unsigned threads) { t.clear(threads);    }
+    std::future<void> clear_async(unsigned threads = 1) {   return t.clear_async(threads);    }
+    void release() { t.release();   }
+
+    /*
+     *  moving single entries between maps without reallocating them,
+     *  see rb_tree::extract. merge() below moves whole maps.
+     */
+    node_type extract(iterator position) { return t.extract(position); }
+    node_type extract(const key_type &x) { return t.extract(x);    }
+    insert_return_type insert(node_type &&nh) { return t.insert_unique(std::move(nh));  }
+    iterator insert(iterator position, node_type &&nh) {
+        return t.insert_unique(position, std::move(nh));
+    }
+
+public:
+    iterator find(const key_type &x) { return t.find(x);   }
+    const_iterator find(const key_type &x) const { return t.find(x);   }
+    size_type count(const key_type &x) const { return t.count(x);  }
+    iterator lower_bound(const key_type &x) { return t.lower_bound(x); }
+    const_iterator lower_bound(const key_type &x) const { return t.lower_bound(x); }
+    iterator upper_bound(const key_type &x) { return t.upper_bound(x); }
+    const_iterator upper_bound(const key_type &x) const { return t.upper_bound(x); }
+    std::pair<iterator, iterator> equal_range(const key_type &x) {
+        return t.equal_range(x);
+    }
+    std::pair<const_iterator, const_iterator> equal_range(const key_type &x) const {
+        return t.equal_range(x);
+    }
+
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator find_batch(ForwardIterator first, ForwardIterator last, OutputIterator out) {
+        return t.find_batch(first, last, out);
+    }
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator find_batch(ForwardIterator first, ForwardIterator last, OutputIterator out) const {
+        return t.find_batch(first, last, out);
+    }
+
+    size_type rank(const key_type &x) const { return t.rank(x);    }
+    iterator nth(size_type i) { return t.nth(i);    }
+    const_iterator nth(size_type i) const { return t.nth(i);    }
+    size_type index(const_iterator it) const { return t.index(it);  }
+    difference_type distance(const_iterator first, const_iterator last) const {
+        return t.distance(first, last);
+    }
+    template <class N = NodeBase>
+    typename N::aggregate_type range_aggregate(const key_type &lo, const key_type &hi) const {
+        return t.template range_aggregate<N>(lo, hi);
+    }
+    void refresh(iterator position) { t.refresh(position);   }
+
+    void merge(map<Key, T, Compare, Alloc, NodeBase> &x, unsigned threads = 1) {
+        t.merge(x.t, threads);
+    }
+    void set_union(map<Key, T, Compare, Alloc, NodeBase> &&x, unsigned threads = 1) {
+        t.set_union(std::move(x.t), threads);
+    }
+    void set_intersection(map<Key, T, Compare, Alloc, NodeBase> &&x, unsigned threads = 1) {
+        t.set_intersection(std::move(x.t), threads);
+    }
+    void set_difference(map<Key, T, Compare, Alloc, NodeBase> &&x, unsigned threads = 1) {
+        t.set_difference(std::move(x.t), threads);
+    }
+
 };
 
 
@@ -0,0 +1,396 @@
+#ifndef LIST_MAPPED_MAP_H
+#define LIST_MAPPED_MAP_H
+
+/*
+ *  a read-only map straight from a file, for tables that would
+ *  otherwise be rebuilt at every start. write() stores a sorted map
+ *  (map, rb_tree, flat_map, or any sorted range of pairs) as a binary
+ *  file. mapped_map opens one with mmap and searches the mapped pages
+ *  as they are: opening reads nothing but the header and allocates
+ *  nothing per element, and the pages come in as lookups touch them.
+ *
+ *  the file, every section 64-byte aligned:
+ *
+ *      header      magic, byte order, version, element count, the sizes
+ *                  and alignments of Key and T, section offsets
+ *      keys        count Keys, sorted
+ *      values      count Ts, values[i] belongs to keys[i]
+ *      index       every __mapped_map_block-th key, keys[0] first
+ *
+ *  a lookup searches the index, which is small and soon stays resident,
+ *  and then one block of keys, so a cold lookup touches a page or two of
+ *  keys rather than log n of them. Key and T have to be trivially
+ *  copyable. the header records their sizes and the byte order, and a
+ *  file that does not match is refused. iteration is over the key and
+ *  value arrays, with flat_map's iterators.
+ */
+
+#include "flat_map.h"
+#include "search.h"
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+enum { __mapped_map_version = 1 };
+enum { __mapped_map_block = 64 };       // keys per index entry
+enum { __mapped_map_align = 64 };
+
+struct __mapped_map_header {
+    char magic[8];              // "listmap\0"
+    uint32_t byte_order;        // 0x01020304 as the writer stored it
+    uint32_t version;
+    uint64_t count;
+    uint32_t key_size;
+    uint32_t key_align;
+    uint32_t value_size;
+    uint32_t value_align;
+    uint64_t keys_offset;
+    uint64_t values_offset;
+    uint64_t index_offset;
+    uint64_t index_count;
+    uint64_t file_size;
+};
+
+static const char __mapped_map_magic[8] = { 'l', 'i', 's', 't', 'm', 'a', 'p', 0 };
+
+inline uint64_t __mapped_map_round(uint64_t n) {
+    return (n + __mapped_map_align - 1) / __mapped_map_align * __mapped_map_align;
+}
+
+/*
+ *  one section of a file being written, through a buffer, at offset on.
+ */
+class __mapped_map_section {
+public:
+    __mapped_map_section(int f, uint64_t offset) : fd(f), at(offset), used(0) {  }
+
+    void put(const void *p, size_t n) {
+        if (used + n > sizeof buffer)
+            flush();
+        if (n > sizeof buffer)
+            write_out((const char*)p, n);
+        else {
+            memcpy(buffer + used, p, n);
+            used += n;
+        }
+    }
+
+    void flush() {
+        write_out(buffer, used);
+        used = 0;
+    }
+
+private:
+    int fd;
+    uint64_t at;
+    size_t used;
+    char buffer[1 << 15];
+
+    void write_out(const char *p, size_t n) {
+        while (n != 0) {
+            ssize_t done = pwrite(fd, p, n, (off_t)at);
+            if (done <= 0)
+                throw std::runtime_error("mapped_map: write failed");
+            p += done;
+            n -= (size_t)done;
+            at += (uint64_t)done;
+        }
+    }
+};
+
+
+template <class Key, class T, class Compare = std::less<Key> >
+class mapped_map {
+public:
+    typedef Key key_type;
+    typedef T data_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef Compare key_compare;
+    typedef __flat_map_iterator<Key, T, const T&, const T*> const_iterator;
+    typedef const_iterator iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef const_reverse_iterator reverse_iterator;
+    typedef typename const_iterator::reference const_reference;
+    typedef const_reference reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value,
+                  "mapped_map stores Key and T as raw bytes");
+
+private:
+    typedef __sorted_search<Key, Compare> search;
+
+    void *base;
+    size_t bytes;
+    const Key *keys;
+    const T *mapped;
+    const Key *index;
+    size_type length;
+    size_type index_length;
+    Compare compare;
+
+    template <class ForwardIterator>
+    static void __write(int fd, ForwardIterator first, ForwardIterator last, size_type n);
+    template <class ForwardIterator>
+    static void __write_file(const char *path, ForwardIterator first, ForwardIterator last,
+                             size_type n);
+
+public:
+    mapped_map() : base(0), bytes(0), keys(0), mapped(0), index(0), length(0), index_length(0) {  }
+
+    explicit mapped_map(const char *path, const Compare &comp = Compare())
+            : base(0), bytes(0), keys(0), mapped(0), index(0), length(0), index_length(0),
+              compare(comp) {
+        open(path);
+    }
+
+    mapped_map(mapped_map &&x)
+            : base(0), bytes(0), keys(0), mapped(0), index(0), length(0), index_length(0),
+              compare(x.compare) {
+        swap(x);
+    }
+
+    mapped_map &operator=(mapped_map &&x) {
+        if (this != &x) {
+            close();
+            swap(x);
+        }
+        return *this;
+    }
+
+    mapped_map(const mapped_map&) = delete;
+    mapped_map &operator=(const mapped_map&) = delete;
+
+    ~mapped_map() { close();    }
+
+    void swap(mapped_map &x) {
+        std::swap(base, x.base);
+        std::swap(bytes, x.bytes);
+        std::swap(keys, x.keys);
+        std::swap(mapped, x.mapped);
+        std::swap(index, x.index);
+        std::swap(length, x.length);
+        std::swap(index_length, x.index_length);
+        std::swap(compare, x.compare);
+    }
+
+    /*
+     *  maps the file, throws runtime_error when it cannot be opened or
+     *  is not a table of these types.
+     */
+    void open(const char *path);
+    void close();
+    bool is_open() const { return base != 0;    }
+
+    /*
+     *  writes [first, last), sorted by Compare without duplicate keys,
+     *  to path. the file is written under path.tmp and renamed over
+     *  path, so a reader never sees half of it.
+     */
+    template <class ForwardIterator>
+    static void write(const char *path, ForwardIterator first, ForwardIterator last) {
+        size_type n = 0;
+        distance(first, last, n);
+        __write_file(path, first, last, n);
+    }
+
+    template <class Container>
+    static void write(const char *path, const Container &c) {
+        __write_file(path, c.begin(), c.end(), c.size());
+    }
+
+public:
+    key_compare key_comp() const { return compare;   }
+
+    const_iterator begin() const { return const_iterator(keys, mapped);  }
+    const_iterator end() const { return const_iterator(keys + length, mapped + length);   }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end());    }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin());    }
+
+    bool empty() const { return length == 0;    }
+    size_type size() const { return length;  }
+
+    /*
+     *  the index narrows the search to the block before the first index
+     *  key not less than k (not greater, for upper_bound), and the
+     *  answer is in that block or is the start of the next.
+     */
+    const_iterator lower_bound(const key_type &k) const {
+        size_type j = search::lower(index, index_length, k, compare);
+        if (j == 0)
+            return begin();
+        size_type first = (j - 1) * __mapped_map_block;
+        size_type n = std::min<size_type>(__mapped_map_block, length - first);
+        return begin() + (first + search::lower(keys + first, n, k, compare));
+    }
+
+    const_iterator upper_bound(const key_type &k) const {
+        size_type j = search::upper(index, index_length, k, compare);
+        if (j == 0)
+            return begin();
+        size_type first = (j - 1) * __mapped_map_block;
+        size_type n = std::min<size_type>(__mapped_map_block, length - first);
+        return begin() + (first + search::upper(keys + first, n, k, compare));
+    }
+
+    const_iterator find(const key_type &k) const {
+        const_iterator it = lower_bound(k);
+        return (it == end() || compare(k, (*it).first)) ? end() : it;
+    }
+
+    size_type count(const key_type &k) const { return find(k) != end();    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const key_type &k) const {
+        const_iterator it = find(k);
+        return std::pair<const_iterator, const_iterator>(it, it == end() ? it : it + 1);
+    }
+
+    const T &at(const key_type &k) const {
+        const_iterator it = find(k);
+        if (it == end())
+            throw std::out_of_range("mapped_map::at");
+        return (*it).second;
+    }
+};
+
+template <class Key, class T, class Compare>
+void mapped_map<Key, T, Compare>::open(const char *path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error(std::string("mapped_map: cannot open ") + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(__mapped_map_header)) {
+        ::close(fd);
+        throw std::runtime_error(std::string("mapped_map: not a table: ") + path);
+    }
+    size_t n = (size_t)st.st_size;
+    void *p = mmap(0, n, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);        // the mapping keeps the file
+    if (p == MAP_FAILED)
+        throw std::runtime_error(std::string("mapped_map: cannot map ") + path);
+
+    const __mapped_map_header &h = *(const __mapped_map_header*)p;
+    bool ok = memcmp(h.magic, __mapped_map_magic, sizeof h.magic) == 0 &&
+              h.byte_order == 0x01020304 &&
+              h.version == __mapped_map_version &&
+              h.key_size == sizeof(Key) && h.key_align == alignof(Key) &&
+              h.value_size == sizeof(T) && h.value_align == alignof(T) &&
+              h.file_size == n &&
+              h.keys_offset % alignof(Key) == 0 && h.index_offset % alignof(Key) == 0 &&
+              h.values_offset % alignof(T) == 0 &&
+              h.count <= n && h.keys_offset + h.count * sizeof(Key) <= n &&
+              h.values_offset + h.count * sizeof(T) <= n &&
+              h.index_count == (h.count + __mapped_map_block - 1) / __mapped_map_block &&
+              h.index_offset + h.index_count * sizeof(Key) <= n;
+    if (!ok) {
+        munmap(p, n);
+        throw std::runtime_error(std::string("mapped_map: not a table of these types: ") + path);
+    }
+
+    base = p;
+    bytes = n;
+    keys = (const Key*)((const char*)p + h.keys_offset);
+    mapped = (const T*)((const char*)p + h.values_offset);
+    index = (const Key*)((const char*)p + h.index_offset);
+    length = h.count;
+    index_length = h.index_count;
+}
+
+template <class Key, class T, class Compare>
+void mapped_map<Key, T, Compare>::close() {
+    if (base != 0)
+        munmap(base, bytes);
+    base = 0;
+    bytes = 0;
+    keys = 0;
+    mapped = 0;
+    index = 0;
+    length = index_length = 0;
+}
+
+/*
+ *  the sizes, and so every offset, are known before anything is
+ *  written: the walk over the source is a single pass that feeds the
+ *  three sections at once, each through its own buffer at its own
+ *  offset. the padding between them is left to ftruncate's zeros.
+ */
+template <class Key, class T, class Compare>
+template <class ForwardIterator>
+void mapped_map<Key, T, Compare>::__write(int fd, ForwardIterator first, ForwardIterator last,
+                                          size_type n) {
+    __mapped_map_header h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, __mapped_map_magic, sizeof h.magic);
+    h.byte_order = 0x01020304;
+    h.version = __mapped_map_version;
+    h.count = n;
+    h.key_size = sizeof(Key);
+    h.key_align = alignof(Key);
+    h.value_size = sizeof(T);
+    h.value_align = alignof(T);
+    h.keys_offset = __mapped_map_round(sizeof h);
+    h.values_offset = __mapped_map_round(h.keys_offset + n * sizeof(Key));
+    h.index_offset = __mapped_map_round(h.values_offset + n * sizeof(T));
+    h.index_count = (n + __mapped_map_block - 1) / __mapped_map_block;
+    h.file_size = h.index_offset + h.index_count * sizeof(Key);
+    if (ftruncate(fd, (off_t)h.file_size) != 0)
+        throw std::runtime_error("mapped_map: write failed");
+
+    __mapped_map_section keys_out(fd, h.keys_offset);
+    __mapped_map_section values_out(fd, h.values_offset);
+    __mapped_map_section index_out(fd, h.index_offset);
+    size_type i = 0;
+    for ( ; first != last; ++first, ++i) {
+        Key k = (*first).first;
+        T v = (*first).second;
+        keys_out.put(&k, sizeof k);
+        values_out.put(&v, sizeof v);
+        if (i % __mapped_map_block == 0)
+            index_out.put(&k, sizeof k);
+    }
+    if (i != n)
+        throw std::runtime_error("mapped_map: the range changed while written");
+    keys_out.flush();
+    values_out.flush();
+    index_out.flush();
+
+    __mapped_map_section header_out(fd, 0);
+    header_out.put(&h, sizeof h);
+    header_out.flush();
+}
+
+template <class Key, class T, class Compare>
+template <class ForwardIterator>
+void mapped_map<Key, T, Compare>::__write_file(const char *path, ForwardIterator first,
+                                               ForwardIterator last, size_type n) {
+    std::string tmp = std::string(path) + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("mapped_map: cannot create " + tmp);
+    try {
+        __write(fd, first, last, n);
+    }
+    catch (...) {
+        ::close(fd);
+        unlink(tmp.c_str());
+        throw;
+    }
+    bool synced = fsync(fd) == 0;
+    if (::close(fd) != 0 || !synced || rename(tmp.c_str(), path) != 0) {
+        unlink(tmp.c_str());
+        throw std::runtime_error(std::string("mapped_map: cannot write ") + path);
+    }
+}
+
+
+#endif //LIST_MAPPED_MAP_H
@@ -0,0 +1,810 @@
+#ifndef LIST_PERSISTENT_MAP_H
+#define LIST_PERSISTENT_MAP_H
+
+/*
+ *  a persistent red-black tree. a copy, or snapshot(), shares every
+ *  node with the original and costs O(1). a later change copies only
+ *  the nodes it touches: the path down from the root, plus the few
+ *  siblings the rebalancing recolors or rotates. all other subtrees
+ *  stay shared. any number of versions can be kept, each still
+ *  readable as it was, at O(log n) extra nodes per change.
+ *
+ *  nodes count the links pointing at them. a change walks down from
+ *  the root and copies a node only if it is shared. a node that only
+ *  this tree can reach is changed in place, so with no snapshots
+ *  around this works like rb_tree, minus the parent pointers.
+ *
+ *  a shared node has more than one parent, so nodes keep no parent
+ *  pointer. a change keeps the path it came down on a stack instead,
+ *  and runs sgi's rebalancing (__rb_tree_rebalance and
+ *  __rb_tree_rebalance_for_erase) over that stack, case for case.
+ *  iterators keep the same kind of stack.
+ *
+ *  the counts are atomic. versions may be read and dropped on other
+ *  threads, given an Alloc that can free from any thread. one version
+ *  is still changed by one thread at a time. keys are unique.
+ */
+
+#include "map.h"
+#include <atomic>
+#include <stdexcept>
+
+
+/*
+ *  no parent, and a 32-bit count: 24 bytes of links per node, like the
+ *  compact rb_tree nodes.
+ */
+struct __persistent_node_base {
+    typedef __rb_tree_color_type color_type;
+    typedef __persistent_node_base *base_ptr;
+
+    base_ptr left;
+    base_ptr right;
+    std::atomic<unsigned> refs;     // links and trees pointing here
+    color_type color;
+};
+
+template <class Value>
+struct __persistent_node : public __persistent_node_base {
+    Value value_field;
+};
+
+/*
+ *  the height of a red-black tree is at most 2 log2(n + 1). nodes take
+ *  at least 32 bytes in a 48-bit address space, so n < 2^43 and 96
+ *  levels always fit.
+ */
+enum { __persistent_max_height = 96 };
+
+
+/*
+ *  an iterator keeps the path from the root down to its node. end()
+ *  has an empty path, but it keeps the root so it can be decremented.
+ */
+template <class Value>
+struct __persistent_iterator {
+    typedef bidirectional_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef const Value &reference;
+    typedef const Value *pointer;
+    typedef ptrdiff_t difference_type;
+    typedef __persistent_iterator<Value> self;
+    typedef __persistent_node_base *base_ptr;
+    typedef __persistent_node<Value> *link_type;
+
+    base_ptr root;
+    base_ptr path[__persistent_max_height];     // root first, the node last
+    int depth;                                  // 0 for end()
+
+    __persistent_iterator() : root(0), depth(0) {  }
+    explicit __persistent_iterator(base_ptr r) : root(r), depth(0) {  }
+
+    base_ptr node() const { return depth ? path[depth - 1] : 0;   }
+
+    reference operator*() const { return ((link_type)path[depth - 1])->value_field;   }
+    pointer operator->() const { return &(operator*());  }
+
+    bool operator==(const self &x) const { return node() == x.node();  }
+    bool operator!=(const self &x) const { return node() != x.node();  }
+
+    self &operator++() {    increment(); return *this;  }
+    self operator++(int) {  self tmp = *this; increment(); return tmp; }
+    self &operator--() {    decrement(); return *this;  }
+    self operator--(int) {  self tmp = *this; decrement(); return tmp; }
+
+    void push_leftmost(base_ptr x) {
+        for ( ; x != 0; x = x->left)
+            path[depth++] = x;
+    }
+
+    void push_rightmost(base_ptr x) {
+        for ( ; x != 0; x = x->right)
+            path[depth++] = x;
+    }
+
+    void increment() {
+        base_ptr x = path[depth - 1];
+        if (x->right != 0) {
+            push_leftmost(x->right);
+            return;
+        }
+        --depth;    // climb while we are a right child
+        while (depth > 0 && path[depth - 1]->right == x)
+            x = path[--depth];
+    }
+
+    void decrement() {
+        if (depth == 0) {
+            push_rightmost(root);
+            return;
+        }
+        base_ptr x = path[depth - 1];
+        if (x->left != 0) {
+            push_rightmost(x->left);
+            return;
+        }
+        --depth;    // climb while we are a left child
+        while (depth > 0 && path[depth - 1]->left == x)
+            x = path[--depth];
+    }
+};
+
+
+template <class Key, class Value, class KeyOfValue, class Compare = std::less<Key>, class Alloc = alloc>
+class persistent_rb_tree {
+protected:
+    typedef __persistent_node_base *base_ptr;
+    typedef __persistent_node<Value> persistent_node;
+    typedef simple_alloc<persistent_node, Alloc> node_allocator;
+    typedef __rb_tree_color_type color_type;
+
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef const value_type *pointer;
+    typedef const value_type *const_pointer;
+    typedef const value_type &reference;
+    typedef const value_type &const_reference;
+    typedef persistent_node *link_type;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef __persistent_iterator<Value> const_iterator;
+    typedef const_iterator iterator;        // shared values are never written through
+
+protected:
+    link_type get_node() { return node_allocator::allocate();    }
+    void put_node(link_type p) {    node_allocator::deallocate(p);   }
+
+    template <class... Args>
+    link_type create_node(Args&&... args) {
+        link_type tmp = get_node();
+        try {
+            construct(&tmp->value_field, std::forward<Args>(args)...);
+        }
+        catch (...) {
+            put_node(tmp);
+            throw;
+        }
+        construct(&tmp->refs, 1u);
+        return tmp;
+    }
+
+    /*
+     *  the copy shares the children, which gain a link each.
+     */
+    link_type clone_node(base_ptr x) {
+        link_type tmp = create_node(value(x));
+        tmp->left = x->left;
+        tmp->right = x->right;
+        tmp->color = x->color;
+        __retain(tmp->left);
+        __retain(tmp->right);
+        return tmp;
+    }
+
+    void destroy_node(link_type p) {
+        destroy(&p->value_field);
+        put_node(p);
+    }
+
+protected:
+    base_ptr root_;
+    size_type node_count;
+    Compare key_compare;
+
+    static const value_type &value(base_ptr x) {
+        return ((link_type)x)->value_field;
+    }
+    static const Key &key(base_ptr x) {
+        return KeyOfValue()(value(x));
+    }
+
+    static void __retain(base_ptr x) {
+        if (x != 0)
+            x->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*
+     *  drops a link to x, and frees whatever only that link kept.
+     */
+    void __release(base_ptr x) {
+        while (x != 0 && x->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            __release(x->right);
+            base_ptr y = x->left;
+            destroy_node((link_type)x);
+            x = y;
+        }
+    }
+
+    /*
+     *  makes the node link points to this tree's own before it is
+     *  written to. link itself must be in a node (or root_) already
+     *  owned.
+     */
+    base_ptr __unshare(base_ptr &link) {
+        base_ptr x = link;
+        if (x->refs.load(std::memory_order_acquire) != 1) {
+            link = clone_node(x);
+            __release(x);
+        }
+        return link;
+    }
+
+    /*
+     *  the link path[i] hangs from.
+     */
+    base_ptr &__link(base_ptr *path, int i) {
+        if (i == 0)
+            return root_;
+        base_ptr p = path[i - 1];
+        return p->left == path[i] ? p->left : p->right;
+    }
+
+    /*
+     *  rotations relink owned nodes only, the subtrees moved along keep
+     *  their counts.
+     */
+    static void __rotate_left(base_ptr x, base_ptr &link) {
+        base_ptr y = x->right;
+        x->right = y->left;
+        y->left = x;
+        link = y;
+    }
+
+    static void __rotate_right(base_ptr x, base_ptr &link) {
+        base_ptr y = x->left;
+        x->left = y->right;
+        y->right = x;
+        link = y;
+    }
+
+    base_ptr __find(const key_type &k) const {
+        base_ptr x = root_;
+        while (x != 0) {
+            if (key_compare(k, key(x)))
+                x = x->left;
+            else if (key_compare(key(x), k))
+                x = x->right;
+            else
+                return x;
+        }
+        return 0;
+    }
+
+    template <class Arg>
+    bool __insert_unique(Arg &&v);
+    void __unshare_for_insert(base_ptr *path, int depth);
+    void __unshare_for_erase(base_ptr *path, int d);
+    void __rebalance(base_ptr *path, int i);
+    void __rebalance_for_erase(base_ptr x, base_ptr *path, int i);
+
+public:
+    explicit persistent_rb_tree(const Compare &comp = Compare())
+            : root_(0), node_count(0), key_compare(comp) {  }
+
+    /*
+     *  a copy is a snapshot: O(1), all nodes shared.
+     */
+    persistent_rb_tree(const persistent_rb_tree &x)
+            : root_(x.root_), node_count(x.node_count), key_compare(x.key_compare) {
+        __retain(root_);
+    }
+
+    persistent_rb_tree(persistent_rb_tree &&x)
+            : root_(0), node_count(0), key_compare(x.key_compare) {
+        swap(x);
+    }
+
+    ~persistent_rb_tree() { __release(root_);   }
+
+    persistent_rb_tree &operator=(persistent_rb_tree x) {
+        swap(x);
+        return *this;
+    }
+
+    void swap(persistent_rb_tree &x) {
+        std::swap(root_, x.root_);
+        std::swap(node_count, x.node_count);
+        std::swap(key_compare, x.key_compare);
+    }
+
+    persistent_rb_tree snapshot() const { return *this;  }
+
+public:
+    Compare key_comp() const { return key_compare;  }
+    const_iterator begin() const {
+        const_iterator it(root_);
+        it.push_leftmost(root_);
+        return it;
+    }
+    const_iterator end() const { return const_iterator(root_);  }
+    bool empty() const { return node_count == 0;    }
+    size_type size() const { return node_count; }
+    size_type max_size() const { return size_type(-1);  }
+
+    /*
+     *  iterators stay valid as long as the version they came from is
+     *  not changed; those of a snapshot outlive any change to the tree
+     *  it was taken from.
+     */
+    const_iterator find(const key_type &k) const {
+        const_iterator it = lower_bound(k);
+        return (it == end() || key_compare(k, key(it.node()))) ? end() : it;
+    }
+    size_type count(const key_type &k) const { return __find(k) != 0;    }
+    const_iterator lower_bound(const key_type &k) const;
+    const_iterator upper_bound(const key_type &k) const;
+    std::pair<const_iterator, const_iterator> equal_range(const key_type &k) const {
+        return std::pair<const_iterator, const_iterator>(lower_bound(k), upper_bound(k));
+    }
+
+public:
+    bool insert_unique(const value_type &v) {   return __insert_unique(v);  }
+    bool insert_unique(value_type &&v) {    return __insert_unique(std::move(v));   }
+
+    template <class InputIterator>
+    void insert_unique(InputIterator first, InputIterator last) {
+        for ( ; first != last; ++first)
+            insert_unique(*first);
+    }
+
+    size_type erase(const key_type &k);
+
+    /*
+     *  the value with key k, made this version's own so it can be
+     *  changed in place unseen by any snapshot (but not in its key).
+     *  0 if k is not there.
+     */
+    value_type *find_mutable(const key_type &k);
+
+    void clear() {
+        __release(root_);
+        root_ = 0;
+        node_count = 0;
+    }
+};
+
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+typename persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator
+persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::lower_bound(const key_type &k) const {
+    const_iterator it(root_);
+    int found = 0;      // the depth of the last node not less than k
+    for (base_ptr x = root_; x != 0; ) {
+        it.path[it.depth++] = x;
+        if (!key_compare(key(x), k)) {
+            found = it.depth;
+            x = x->left;
+        }
+        else
+            x = x->right;
+    }
+    it.depth = found;
+    return it;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+typename persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator
+persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::upper_bound(const key_type &k) const {
+    const_iterator it(root_);
+    int found = 0;      // the depth of the last node greater than k
+    for (base_ptr x = root_; x != 0; ) {
+        it.path[it.depth++] = x;
+        if (key_compare(k, key(x))) {
+            found = it.depth;
+            x = x->left;
+        }
+        else
+            x = x->right;
+    }
+    it.depth = found;
+    return it;
+}
+
+/*
+ *  a present key copies nothing. otherwise the path is made this tree's
+ *  own on the way down, then the uncles the fix-up will recolor, and
+ *  the node is built last. nothing is copied once it is linked, so a
+ *  throwing copy leaves the tree as it was.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+template <class Arg>
+bool persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::__insert_unique(Arg &&v) {
+    const key_type &k = KeyOfValue()(v);
+    if (__find(k) != 0)
+        return false;
+
+    base_ptr path[__persistent_max_height];
+    int depth = 0;
+    base_ptr *link = &root_;
+    while (*link != 0) {
+        base_ptr x = __unshare(*link);
+        path[depth++] = x;
+        link = key_compare(k, key(x)) ? &x->left : &x->right;
+    }
+    __unshare_for_insert(path, depth);
+
+    link_type z = create_node(std::forward<Arg>(v));
+    z->left = 0;
+    z->right = 0;
+    z->color = __rb_tree_red;
+    *link = z;
+    path[depth] = z;
+    ++node_count;
+    __rebalance(path, depth);
+    return true;
+}
+
+/*
+ *  the uncles __rebalance recolors when a red node goes under
+ *  path[depth - 1]: it climbs two levels at a time while the parent and
+ *  the uncle are both red, and the colors it reads on the way are not
+ *  changed before it reads them, so they can be read ahead of time.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::
+__unshare_for_insert(base_ptr *path, int depth) {
+    for (int i = depth; i > 1 && path[i - 1]->color == __rb_tree_red; i -= 2) {
+        base_ptr g = path[i - 2];
+        base_ptr &u = g->left == path[i - 1] ? g->right : g->left;
+        if (u == 0 || u->color != __rb_tree_red)
+            return;
+        __unshare(u);
+    }
+}
+
+/*
+ *  __rb_tree_rebalance, with path[i - 1] for x's parent. the path and
+ *  the uncles are owned already (__unshare_for_insert), so nothing is
+ *  copied here.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::__rebalance(base_ptr *path, int i) {
+    while (i > 0 && path[i - 1]->color == __rb_tree_red) {
+        base_ptr x = path[i];
+        base_ptr p = path[i - 1];
+        base_ptr g = path[i - 2];       // p is red, so it is not the root
+        if (p == g->left) {
+            if (g->right != 0 && g->right->color == __rb_tree_red) {
+                p->color = __rb_tree_black;
+                g->right->color = __rb_tree_black;
+                g->color = __rb_tree_red;
+                i -= 2;
+            }
+            else {
+                if (x == p->right) {
+                    __rotate_left(p, g->left);
+                    p = x;
+                }
+                p->color = __rb_tree_black;
+                g->color = __rb_tree_red;
+                __rotate_right(g, __link(path, i - 2));
+                break;
+            }
+        }
+        else {
+            if (g->left != 0 && g->left->color == __rb_tree_red) {
+                p->color = __rb_tree_black;
+                g->left->color = __rb_tree_black;
+                g->color = __rb_tree_red;
+                i -= 2;
+            }
+            else {
+                if (x == p->left) {
+                    __rotate_right(p, g->right);
+                    p = x;
+                }
+                p->color = __rb_tree_black;
+                g->color = __rb_tree_red;
+                __rotate_left(g, __link(path, i - 2));
+                break;
+            }
+        }
+    }
+    root_->color = __rb_tree_black;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+typename persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::size_type
+persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::erase(const key_type &k) {
+    if (__find(k) == 0)
+        return 0;
+
+    base_ptr path[__persistent_max_height];
+    int depth = 0;
+    base_ptr *link = &root_;
+    for (;;) {
+        base_ptr x = __unshare(*link);
+        path[depth++] = x;
+        if (key_compare(k, key(x)))
+            link = &x->left;
+        else if (key_compare(key(x), k))
+            link = &x->right;
+        else
+            break;
+    }
+
+    /*
+     *  as in sgi, a z with two children is replaced by its successor y,
+     *  which takes over z's color; the node taken out of the shape
+     *  always has one child x at most. z's links move to y, so z is
+     *  freed alone.
+     */
+    int zi = depth - 1;
+    base_ptr z = path[zi];
+    if (z->left != 0 && z->right != 0) {
+        link = &z->right;
+        for (;;) {
+            base_ptr y = __unshare(*link);
+            path[depth++] = y;
+            if (y->left == 0) break;
+            link = &y->left;
+        }
+    }
+    __unshare_for_erase(path, depth - 1);
+
+    base_ptr x;
+    color_type removed;
+    if (z->left != 0 && z->right != 0) {
+        base_ptr y = path[--depth];
+        x = y->right;
+        *link = x;
+        y->left = z->left;
+        y->right = z->right;
+        removed = y->color;
+        y->color = z->color;
+        __link(path, zi) = y;
+        path[zi] = y;
+    }
+    else {
+        x = z->left != 0 ? z->left : z->right;
+        __link(path, zi) = x;
+        removed = z->color;
+        --depth;
+    }
+    destroy_node((link_type)z);
+    --node_count;
+
+    if (removed == __rb_tree_black)
+        __rebalance_for_erase(x, path, depth);
+    return 1;
+}
+
+/*
+ *  the nodes __rebalance_for_erase will recolor or rotate once path[d]
+ *  is taken out, made this tree's own while the tree is still whole: a
+ *  dry run of its cases over the colors. taking the node out leaves
+ *  every color on the path in its place (the successor takes z's), and
+ *  the sibling of each path node stays its sibling, so the run can look
+ *  at the tree as it is now. per level that is the sibling, the near
+ *  nephew if the sibling is red (it becomes the sibling after the
+ *  rotation), and the one nephew the last case recolors.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::
+__unshare_for_erase(base_ptr *path, int d) {
+    base_ptr r = path[d];
+    if (r->color != __rb_tree_black)
+        return;
+    base_ptr &x = r->left != 0 ? r->left : r->right;
+    if (x != 0 && x->color == __rb_tree_red) {
+        __unshare(x);       // only recolored
+        return;
+    }
+
+    for (int i = d; i > 0; ) {
+        base_ptr p = path[i - 1];
+        bool left = p->left == path[i];
+        base_ptr w = __unshare(left ? p->right : p->left);
+        color_type pc = p->color;
+        if (w->color == __rb_tree_red) {
+            w = __unshare(left ? w->left : w->right);
+            pc = __rb_tree_red;
+        }
+        base_ptr &near = left ? w->left : w->right;
+        base_ptr &far = left ? w->right : w->left;
+        bool near_black = near == 0 || near->color == __rb_tree_black;
+        bool far_black = far == 0 || far->color == __rb_tree_black;
+        if (near_black && far_black) {
+            if (pc == __rb_tree_red)
+                return;
+            --i;
+            continue;
+        }
+        __unshare(far_black ? near : far);
+        return;
+    }
+}
+
+/*
+ *  the fix-up half of __rb_tree_rebalance_for_erase, with path[i - 1]
+ *  for x's parent (i == 0: x is the root). the siblings and nephews it
+ *  touches are owned already (__unshare_for_erase), so nothing is
+ *  copied here.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+void persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::
+__rebalance_for_erase(base_ptr x, base_ptr *path, int i) {
+    while (i > 0 && (x == 0 || x->color == __rb_tree_black)) {
+        base_ptr p = path[i - 1];
+        if (x == p->left) {
+            base_ptr w = p->right;
+            if (w->color == __rb_tree_red) {
+                w->color = __rb_tree_black;
+                p->color = __rb_tree_red;
+                __rotate_left(p, __link(path, i - 1));
+                path[i - 1] = w;    // p now hangs from w
+                path[i++] = p;
+                w = p->right;
+            }
+            if ((w->left == 0 || w->left->color == __rb_tree_black) &&
+                (w->right == 0 || w->right->color == __rb_tree_black)) {
+                w->color = __rb_tree_red;
+                x = p;
+                --i;
+            }
+            else {
+                if (w->right == 0 || w->right->color == __rb_tree_black) {
+                    w->left->color = __rb_tree_black;
+                    w->color = __rb_tree_red;
+                    __rotate_right(w, p->right);
+                    w = p->right;
+                }
+                w->color = p->color;
+                p->color = __rb_tree_black;
+                if (w->right != 0)
+                    w->right->color = __rb_tree_black;
+                __rotate_left(p, __link(path, i - 1));
+                return;
+            }
+        }
+        else {
+            base_ptr w = p->left;
+            if (w->color == __rb_tree_red) {
+                w->color = __rb_tree_black;
+                p->color = __rb_tree_red;
+                __rotate_right(p, __link(path, i - 1));
+                path[i - 1] = w;
+                path[i++] = p;
+                w = p->left;
+            }
+            if ((w->right == 0 || w->right->color == __rb_tree_black) &&
+                (w->left == 0 || w->left->color == __rb_tree_black)) {
+                w->color = __rb_tree_red;
+                x = p;
+                --i;
+            }
+            else {
+                if (w->left == 0 || w->left->color == __rb_tree_black) {
+                    w->right->color = __rb_tree_black;
+                    w->color = __rb_tree_red;
+                    __rotate_left(w, p->left);
+                    w = p->left;
+                }
+                w->color = p->color;
+                p->color = __rb_tree_black;
+                if (w->left != 0)
+                    w->left->color = __rb_tree_black;
+                __rotate_right(p, __link(path, i - 1));
+                return;
+            }
+        }
+    }
+    if (x != 0 && x->color == __rb_tree_red)
+        x->color = __rb_tree_black;
+}
+
+template <class Key, class Value, class KeyOfValue, class Compare, class Alloc>
+typename persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::value_type *
+persistent_rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::find_mutable(const key_type &k) {
+    if (__find(k) == 0)
+        return 0;
+    base_ptr *link = &root_;
+    for (;;) {
+        base_ptr x = __unshare(*link);
+        if (key_compare(k, key(x)))
+            link = &x->left;
+        else if (key_compare(key(x), k))
+            link = &x->right;
+        else
+            return &((link_type)x)->value_field;
+    }
+}
+
+
+/*
+ *  map on the persistent tree. values are changed through insert and
+ *  insert_or_assign rather than operator[], which would have to copy
+ *  the path on every read.
+ */
+template <class Key, class T, class Compare = std::less<Key>, class Alloc = alloc>
+class persistent_map {
+public:
+    typedef Key key_type;
+    typedef T data_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef Compare key_compare;
+
+private:
+    typedef persistent_rb_tree<key_type, value_type, select1st<value_type>, key_compare, Alloc> rep_type;
+    rep_type t;
+
+public:
+    typedef typename rep_type::pointer pointer;
+    typedef typename rep_type::const_pointer const_pointer;
+    typedef typename rep_type::reference reference;
+    typedef typename rep_type::const_reference const_reference;
+    typedef typename rep_type::iterator iterator;
+    typedef typename rep_type::const_iterator const_iterator;
+    typedef typename rep_type::size_type size_type;
+    typedef typename rep_type::difference_type difference_type;
+
+    persistent_map() : t(Compare()) {  }
+    explicit persistent_map(const Compare &comp) : t(comp) {   }
+
+    template <class InputIterator>
+    persistent_map(InputIterator first, InputIterator last, const Compare &comp = Compare())
+            : t(comp) { t.insert_unique(first, last);   }
+
+    /*
+     *  O(1): the new map and this one share all nodes until either
+     *  changes.
+     */
+    persistent_map snapshot() const { return *this;  }
+
+    void swap(persistent_map &x) {  t.swap(x.t);   }
+
+public:
+    key_compare key_comp() const { return t.key_comp();  }
+    const_iterator begin() const { return t.begin();    }
+    const_iterator end() const { return t.end();    }
+    bool empty() const { return t.empty();  }
+    size_type size() const { return t.size();   }
+    size_type max_size() const { return t.max_size();   }
+
+    const T &at(const key_type &k) const {
+        const_iterator it = t.find(k);
+        if (it == t.end())
+            throw std::out_of_range("persistent_map::at");
+        return it->second;
+    }
+
+public:
+    bool insert(const value_type &x) {  return t.insert_unique(x);  }
+    bool insert(value_type &&x) {   return t.insert_unique(std::move(x));   }
+
+    template <class InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        t.insert_unique(first, last);
+    }
+
+    /*
+     *  true if k was inserted, false if it was there and its value has
+     *  been replaced.
+     */
+    template <class M>
+    bool insert_or_assign(const key_type &k, M &&obj) {
+        value_type *p = t.find_mutable(k);
+        if (p != 0) {
+            p->second = std::forward<M>(obj);
+            return false;
+        }
+        return t.insert_unique(value_type(k, std::forward<M>(obj)));
+    }
+
+    size_type erase(const key_type &x) { return t.erase(x);    }
+    void clear() { t.clear();   }
+
+public:
+    const_iterator find(const key_type &x) const { return t.find(x);   }
+    size_type count(const key_type &x) const { return t.count(x);  }
+    const_iterator lower_bound(const key_type &x) const { return t.lower_bound(x); }
+    const_iterator upper_bound(const key_type &x) const { return t.upper_bound(x); }
+    std::pair<const_iterator, const_iterator> equal_range(const key_type &x) const {
+        return t.equal_range(x);
+    }
+};
+
+
+#endif //LIST_PERSISTENT_MAP_H
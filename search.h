@@ -0,0 +1,193 @@
+#ifndef LIST_SEARCH_H
+#define LIST_SEARCH_H
+
+/*
+ *  searching sorted runs of keys, shared by the contiguous containers.
+ *
+ *      __node_search       a short run, such as the keys of one btree
+ *                          node.
+ *      __sorted_search     a sorted array of any length, as in flat_map.
+ *
+ *  both return positions the way lower_bound and upper_bound do. for
+ *  arithmetic keys ordered by std::less they never branch on the keys.
+ */
+
+#include "map.h"      // for identity
+#include <type_traits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/*
+ *  searching a node: lower() is the number of keys less than k, upper()
+ *  the number not greater than k. the generic version is a binary
+ *  search through the comparator and KeyOfValue.
+ */
+template <class Key, class Value, class KeyOfValue, class Compare, class = void>
+struct __node_search {
+    static int lower(const Value *v, int n, const Key &k, const Compare &comp) {
+        int first = 0;
+        while (n > 0) {
+            int half = n >> 1;
+            if (comp(KeyOfValue()(v[first + half]), k)) {
+                first += half + 1;
+                n -= half + 1;
+            }
+            else
+                n = half;
+        }
+        return first;
+    }
+
+    static int upper(const Value *v, int n, const Key &k, const Compare &comp) {
+        int first = 0;
+        while (n > 0) {
+            int half = n >> 1;
+            if (!comp(k, KeyOfValue()(v[first + half]))) {
+                first += half + 1;
+                n -= half + 1;
+            }
+            else
+                n = half;
+        }
+        return first;
+    }
+};
+
+/*
+ *  arithmetic keys ordered by std::less: a node holds a few dozen keys
+ *  at most, so counting them all without a branch beats the binary
+ *  search's unpredictable jumps, and the loop vectorizes.
+ */
+template <class Key, class Value, class KeyOfValue>
+struct __node_search<Key, Value, KeyOfValue, std::less<Key>,
+                     typename std::enable_if<std::is_arithmetic<Key>::value>::type> {
+    static int lower(const Value *v, int n, const Key &k, const std::less<Key> &) {
+        int result = 0;
+        for (int i = 0; i < n; ++i)
+            result += KeyOfValue()(v[i]) < k;
+        return result;
+    }
+
+    static int upper(const Value *v, int n, const Key &k, const std::less<Key> &) {
+        int result = 0;
+        for (int i = 0; i < n; ++i)
+            result += !(k < KeyOfValue()(v[i]));
+        return result;
+    }
+};
+
+#ifdef __SSE2__
+/*
+ *  separators of int keys, four compares at a time.
+ */
+template <>
+struct __node_search<int, int, identity<int>, std::less<int>, void> {
+    static int lower(const int *v, int n, const int &k, const std::less<int> &) {
+        __m128i key = _mm_set1_epi32(k);
+        int result = 0;
+        int i = 0;
+        for ( ; i + 4 <= n; i += 4) {
+            __m128i lt = _mm_cmplt_epi32(_mm_loadu_si128((const __m128i*)(v + i)), key);
+            result += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(lt)));
+        }
+        for ( ; i < n; ++i)
+            result += v[i] < k;
+        return result;
+    }
+
+    static int upper(const int *v, int n, const int &k, const std::less<int> &) {
+        __m128i key = _mm_set1_epi32(k);
+        int result = 0;
+        int i = 0;
+        for ( ; i + 4 <= n; i += 4) {
+            __m128i gt = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(v + i)), key);
+            result += 4 - __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(gt)));
+        }
+        for ( ; i < n; ++i)
+            result += !(k < v[i]);
+        return result;
+    }
+};
+#endif
+
+
+enum { __sorted_search_window = 16 };
+
+/*
+ *  a sorted array of any length. the generic version is the usual
+ *  binary search.
+ */
+template <class Key, class Compare, class = void>
+struct __sorted_search {
+    static size_t lower(const Key *first, size_t n, const Key &k, const Compare &comp) {
+        size_t result = 0;
+        while (n > 0) {
+            size_t half = n >> 1;
+            if (comp(first[result + half], k)) {
+                result += half + 1;
+                n -= half + 1;
+            }
+            else
+                n = half;
+        }
+        return result;
+    }
+
+    static size_t upper(const Key *first, size_t n, const Key &k, const Compare &comp) {
+        size_t result = 0;
+        while (n > 0) {
+            size_t half = n >> 1;
+            if (!comp(k, first[result + half])) {
+                result += half + 1;
+                n -= half + 1;
+            }
+            else
+                n = half;
+        }
+        return result;
+    }
+};
+
+/*
+ *  arithmetic keys under std::less. the range is halved without a
+ *  branch, the compare only picks the next base (a conditional move),
+ *  while both places the next probe can land are prefetched. once
+ *  __sorted_search_window keys are left __node_search counts them.
+ *
+ *  the answer always stays within [base, base + n]: keys before base
+ *  are known to be less than k, keys from base + n on are not.
+ */
+template <class Key>
+struct __sorted_search<Key, std::less<Key>,
+                       typename std::enable_if<std::is_arithmetic<Key>::value>::type> {
+    typedef __node_search<Key, Key, identity<Key>, std::less<Key> > window_search;
+
+    static size_t lower(const Key *first, size_t n, const Key &k, const std::less<Key> &comp) {
+        const Key *base = first;
+        while (n > __sorted_search_window) {
+            size_t half = n >> 1;
+            __builtin_prefetch(base + (half >> 1));
+            __builtin_prefetch(base + half + (half >> 1));
+            base = base[half] < k ? base + half : base;
+            n -= half;
+        }
+        return (base - first) + window_search::lower(base, (int)n, k, comp);
+    }
+
+    static size_t upper(const Key *first, size_t n, const Key &k, const std::less<Key> &comp) {
+        const Key *base = first;
+        while (n > __sorted_search_window) {
+            size_t half = n >> 1;
+            __builtin_prefetch(base + (half >> 1));
+            __builtin_prefetch(base + half + (half >> 1));
+            base = !(k < base[half]) ? base + half : base;
+            n -= half;
+        }
+        return (base - first) + window_search::upper(base, (int)n, k, comp);
+    }
+};
+
+
+#endif //LIST_SEARCH_H
@@ -0,0 +1,338 @@
+#ifndef LIST_SHARDED_MAP_H
+#define LIST_SHARDED_MAP_H
+
+/*
+ *  a map for write-heavy use from many threads, split by key range into
+ *  K shards. each shard is a map of its own, with its own mutex and
+ *  its own node_pool. shard i holds the keys in [splits[i - 1],
+ *  splits[i]). an operation locks only the shard its key falls into,
+ *  and walking the shards one after the other walks every key in order.
+ *
+ *  the single-key operations copy values out rather than return
+ *  iterators, which would outlive the lock. iterators take no locks:
+ *  use them, and lower_bound, only while nothing writes. for_each and
+ *  parallel_for_each lock each shard while they visit it.
+ */
+
+#include "map.h"
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <vector>
+#include <algorithm>
+
+
+/*
+ *  the merged iterator: the shard it is in, and an iterator of that
+ *  shard's map. it moves on to the next non-empty shard at the end of
+ *  one. end() is the end of the last shard.
+ */
+template <class Value, class Ref, class Ptr, class Map, class Iterator>
+struct __sharded_iterator {
+    typedef bidirectional_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef Ref reference;
+    typedef Ptr pointer;
+    typedef ptrdiff_t difference_type;
+    typedef __sharded_iterator<Value, Ref, Ptr, Map, Iterator> self;
+
+    Map *const *maps;
+    size_t count;       // of shards
+    size_t index;       // the shard it is in
+    Iterator it;
+
+    __sharded_iterator() : maps(0), count(0), index(0) {  }
+    __sharded_iterator(Map *const *m, size_t n, size_t i, Iterator x)
+            : maps(m), count(n), index(i), it(x) {  skip();    }
+
+    template <class R, class P, class M, class I>
+    __sharded_iterator(const __sharded_iterator<Value, R, P, M, I> &x)
+            : maps(x.maps), count(x.count), index(x.index), it(x.it) {  }
+
+    reference operator*() const { return *it;  }
+    pointer operator->() const { return &(operator*());  }
+
+    bool operator==(const self &x) const { return index == x.index && it == x.it;   }
+    bool operator!=(const self &x) const { return !(*this == x);   }
+
+    self &operator++() {
+        ++it;
+        skip();
+        return *this;
+    }
+    self operator++(int) {  self tmp = *this; ++*this; return tmp;  }
+
+    self &operator--() {
+        while (it == maps[index]->begin() && index > 0) {
+            --index;
+            it = maps[index]->end();
+        }
+        --it;
+        return *this;
+    }
+    self operator--(int) {  self tmp = *this; --*this; return tmp;  }
+
+    void skip() {
+        while (it == maps[index]->end() && index + 1 < count) {
+            ++index;
+            it = maps[index]->begin();
+        }
+    }
+};
+
+
+template <class Key, class T, class Compare = std::less<Key> >
+class sharded_map {
+public:
+    typedef Key key_type;
+    typedef T data_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef Compare key_compare;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef map<Key, T, Compare, bound_pool_alloc> shard_type;
+    typedef __sharded_iterator<value_type, value_type&, value_type*,
+                               shard_type, typename shard_type::iterator> iterator;
+    typedef __sharded_iterator<value_type, const value_type&, const value_type*,
+                               const shard_type, typename shard_type::const_iterator> const_iterator;
+
+private:
+    /*
+     *  shards are allocated one by one, so the mutexes of two of them
+     *  never share a cache line. the map is built and destroyed with
+     *  the pool bound, like every other call into it.
+     */
+    struct shard {
+        std::mutex mutex;
+        node_pool pool;
+        shard_type *map;
+
+        explicit shard(const Compare &comp) : map(0) {
+            bound_pool_alloc::scope s(pool);
+            map = new shard_type(comp);
+        }
+        ~shard() {
+            bound_pool_alloc::scope s(pool);
+            delete map;
+        }
+    };
+
+    /*
+     *  holds a shard's mutex and binds its pool.
+     */
+    class shard_lock {
+    public:
+        explicit shard_lock(shard &s) : lock(s.mutex), scope(s.pool) {  }
+
+    private:
+        std::lock_guard<std::mutex> lock;
+        bound_pool_alloc::scope scope;
+    };
+
+    std::vector<Key> splits;
+    std::vector<shard*> shards;
+    std::vector<shard_type*> maps;      // shards[i]->map, for the iterators
+    Compare comp;
+
+    size_type shard_of(const key_type &k) const {
+        return std::upper_bound(splits.begin(), splits.end(), k, comp) - splits.begin();
+    }
+
+public:
+    /*
+     *  splits.size() + 1 shards. splits must be strictly increasing
+     *  under comp.
+     */
+    explicit sharded_map(const std::vector<Key> &bounds, const Compare &c = Compare())
+            : splits(bounds), comp(c) {
+        try {
+            for (size_type i = 0; i <= splits.size(); ++i) {
+                shards.push_back(0);
+                shards.back() = new shard(comp);
+                maps.push_back(shards.back()->map);
+            }
+        }
+        catch (...) {
+            __destroy();
+            throw;
+        }
+    }
+
+    ~sharded_map() {    __destroy();    }
+
+    sharded_map(const sharded_map&) = delete;
+    sharded_map &operator=(const sharded_map&) = delete;
+
+private:
+    void __destroy() {
+        for (size_type i = 0; i < shards.size(); ++i)
+            delete shards[i];
+        shards.clear();
+        maps.clear();
+    }
+
+public:
+    key_compare key_comp() const { return comp;  }
+    size_type shard_count() const { return shards.size();   }
+
+    /*
+     *  locks the shards one at a time, so under concurrent writes the
+     *  sum is not of any one moment.
+     */
+    size_type size() const {
+        size_type n = 0;
+        for (size_type i = 0; i < shards.size(); ++i) {
+            shard_lock lock(*shards[i]);
+            n += shards[i]->map->size();
+        }
+        return n;
+    }
+
+    bool empty() const { return size() == 0;    }
+
+    iterator begin() { return iterator(maps.data(), maps.size(), 0, maps[0]->begin());    }
+    const_iterator begin() const {
+        return const_iterator(maps.data(), maps.size(), 0, maps[0]->begin());
+    }
+    iterator end() {
+        return iterator(maps.data(), maps.size(), maps.size() - 1, maps.back()->end());
+    }
+    const_iterator end() const {
+        return const_iterator(maps.data(), maps.size(), maps.size() - 1, maps.back()->end());
+    }
+
+    iterator lower_bound(const key_type &k) {
+        size_type i = shard_of(k);
+        return iterator(maps.data(), maps.size(), i, maps[i]->lower_bound(k));
+    }
+    const_iterator lower_bound(const key_type &k) const {
+        size_type i = shard_of(k);
+        return const_iterator(maps.data(), maps.size(), i, maps[i]->lower_bound(k));
+    }
+
+public:
+    /*
+     *  single keys, locking only their shard.
+     */
+    bool find(const key_type &k, T &out) const {
+        shard &s = *shards[shard_of(k)];
+        shard_lock lock(s);
+        typename shard_type::const_iterator it = s.map->find(k);
+        if (it == s.map->end())
+            return false;
+        out = it->second;
+        return true;
+    }
+
+    size_type count(const key_type &k) const {
+        shard &s = *shards[shard_of(k)];
+        shard_lock lock(s);
+        return s.map->count(k);
+    }
+
+    /*
+     *  f(value_type&) on the value with key k, under the shard's lock.
+     */
+    template <class Function>
+    bool visit(const key_type &k, Function f) {
+        shard &s = *shards[shard_of(k)];
+        shard_lock lock(s);
+        typename shard_type::iterator it = s.map->find(k);
+        if (it == s.map->end())
+            return false;
+        f(*it);
+        return true;
+    }
+
+    bool insert(const value_type &x) {
+        shard &s = *shards[shard_of(x.first)];
+        shard_lock lock(s);
+        return s.map->insert(x).second;
+    }
+
+    bool insert(value_type &&x) {
+        shard &s = *shards[shard_of(x.first)];
+        shard_lock lock(s);
+        return s.map->insert(std::move(x)).second;
+    }
+
+    template <class M>
+    bool insert_or_assign(const key_type &k, M &&obj) {
+        shard &s = *shards[shard_of(k)];
+        shard_lock lock(s);
+        std::pair<typename shard_type::iterator, bool> r = s.map->try_emplace(k, std::forward<M>(obj));
+        if (!r.second)
+            r.first->second = std::forward<M>(obj);
+        return r.second;
+    }
+
+    size_type erase(const key_type &k) {
+        shard &s = *shards[shard_of(k)];
+        shard_lock lock(s);
+        return s.map->erase(k);
+    }
+
+    void clear() {
+        for (size_type i = 0; i < shards.size(); ++i) {
+            shard_lock lock(*shards[i]);
+            shards[i]->map->clear();
+        }
+    }
+
+public:
+    /*
+     *  f(value_type&) on every value in key order, each shard locked
+     *  while it is visited.
+     */
+    template <class Function>
+    void for_each(Function f) {
+        for (size_type i = 0; i < shards.size(); ++i)
+            __visit_shard(i, f);
+    }
+
+    /*
+     *  the same, with the shards spread over threads (the calling one
+     *  included), each taking the next shard not yet visited. values of
+     *  one shard are visited in order, f must be safe to run on
+     *  different values at once.
+     */
+    template <class Function>
+    void parallel_for_each(Function f, unsigned threads = std::thread::hardware_concurrency());
+
+private:
+    template <class Function>
+    void __visit_shard(size_type i, Function &f) {
+        shard_lock lock(*shards[i]);
+        shard_type &m = *shards[i]->map;
+        for (typename shard_type::iterator it = m.begin(); it != m.end(); ++it)
+            f(*it);
+    }
+};
+
+template <class Key, class T, class Compare>
+template <class Function>
+void sharded_map<Key, T, Compare>::parallel_for_each(Function f, unsigned threads) {
+    if (threads > shards.size())
+        threads = shards.size();
+    if (threads < 2) {
+        for_each(f);
+        return;
+    }
+
+    std::atomic<size_type> next(0);
+    auto work = [this, &next, &f]() {
+        for (size_type i; (i = next.fetch_add(1)) < shards.size(); )
+            __visit_shard(i, f);
+    };
+    std::vector<std::future<void> > helpers;
+    for (unsigned t = 1; t < threads; ++t)
+        helpers.push_back(std::async(std::launch::async, work));
+    work();
+    for (size_type t = 0; t < helpers.size(); ++t)
+        helpers[t].get();
+}
+
+
+#endif //LIST_SHARDED_MAP_H